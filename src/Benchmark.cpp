@@ -0,0 +1,818 @@
+#include "Benchmark.hpp"
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <optional>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <memory>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include <glm/glm.hpp>
+#include <SDL2/SDL.h>
+
+#include "Parser.hpp"
+#include "Renderer.hpp"
+#include "Random.hpp"
+
+/**
+ * The settings for a run of the benchmark suite
+ */
+struct BenchmarkOptions
+{
+	/// The scenes to render. Each is either the path of a scene file or a
+	/// procedural scene of the form <type>:<count>
+	std::vector<std::string>	scenes;
+
+	/// The number of timed renders of each scene
+	int							runs = 5;
+
+	/// Resolution to render every scene at, or 0 to use the scene's own
+	int							width = 0, height = 0;
+
+	/// Samples per pixel for every scene, or 0 to use the scene's own
+	int							samples = 0;
+
+	/// The number of threads to render with, or 0 to use one per core
+	int							threads = 0;
+
+	/// The number of lights picked at each intersection, or 0 to shade with every light
+	int							lightSamples = 0;
+
+	/// Whether shadow rays test the last occluder of their light first
+	bool						shadowCache = true;
+
+	/// Whether the pixels are traced with a loop compiled for the scene's number of samples
+	bool						specialize = true;
+
+	/// Whether scenes are traced in wavefront order
+	bool						wavefront = false;
+
+	/// Whether triangles are intersected with the watertight test
+	bool						watertight = false;
+
+	/// How the bounding volume hierarchy of each scene is built, if not by the scene's settings
+	std::optional<BvhBuilder>	bvhBuilder;
+
+	/// Whether the hierarchy is collapsed into one with eight children per node
+	bool						wideBvh = false;
+
+	/// Whether spheres are put in a uniform grid instead of the hierarchy
+	bool						sphereGrid = false;
+
+	/// The instruction set to run the vectorized kernels with, if not the newest supported
+	std::optional<IsaLevel>		isa;
+
+	/// The baseline to compare against, if any
+	std::string					baselinePath;
+
+	/// Where to write the results as a new baseline, if anywhere
+	std::string					savePath;
+
+	/// How much slower than the baseline a scene may get before it counts as a regression
+	double						tolerance = 0.10;
+};
+
+/**
+ * The timings measured for a single scene
+ */
+struct BenchmarkResult
+{
+	/// The scene file or procedural scene that was rendered
+	std::string	name;
+
+	/// The resolution and samples per pixel the scene was rendered with
+	int			width, height, samples;
+
+	/// The median and 95th percentile of the render times, in seconds
+	double		median, p95;
+
+	/// The number of rays traced per second, at the median time
+	double		raysPerSecond;
+
+	/// The peak resident memory of the process after the scene was rendered, in MB
+	double		peakMemory;
+
+	/// The fraction of shadow rays that were blocked by the cached occluder
+	double		shadowCacheHitRate;
+
+	/// The number of nodes in the bounding volume hierarchy, and the bytes it takes per node
+	double		bvhNodes, bvhBytesPerNode;
+};
+
+/// The number of spheres in the generated many lights scene
+static const int LIGHTS_SCENE_SPHERES = 200;
+
+/// The number of materials the particles of the generated particle scene pick from
+static const int PARTICLE_SCENE_MATERIALS = 64;
+
+/// The number of materials the second keyframe of the looping particle scene adds
+static const int PARTICLE_LOOP_MATERIALS = 4;
+
+/**
+ * The suite that is run when no scenes are given. The large procedural scenes
+ * (up to spheres:1e6 and triangles:1e6) can be added with --scene.
+ */
+static const char* DEFAULT_SCENES[] = {
+	"resources/Box.txt",
+	"resources/input.txt",
+	"exe/TestScene.txt",
+	"exe/Walk.txt",
+	"spheres:1000",
+	"triangles:1000",
+};
+
+/**
+ * Gets the largest amount of memory the process has had resident so far
+ *
+ * @return The peak resident set size in MB
+ */
+static double peakMemoryMB()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return counters.PeakWorkingSetSize / (1024.0 * 1024.0);
+
+	return 0.0;
+#else
+	rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+
+#ifdef __APPLE__
+	return usage.ru_maxrss / (1024.0 * 1024.0);
+#else
+	return usage.ru_maxrss / 1024.0;
+#endif
+#endif
+}
+
+/**
+ * Picks a value from a sorted list of samples
+ *
+ * @param sorted		The samples, in ascending order
+ * @param percentile	The percentile to pick, between 0 and 1
+ * @return				The smallest sample that at least that fraction of the samples are below or equal to
+ */
+static double percentile(const std::vector<double>& sorted, double percentile)
+{
+	size_t index = (size_t)std::ceil(percentile * sorted.size());
+
+	return sorted[index > 0 ? index - 1 : 0];
+}
+
+Animation generateScene(const std::string& type, int count)
+{
+	Animation animation;
+	animation.width = 320;
+	animation.height = 240;
+	animation.samples = 1;
+
+	Frame frame;
+	frame.background = { 0.1, 0.1, 0.15 };
+	frame.timeOffset = 0.0;
+
+	frame.camera.position = { 0.0, 0.0, -2.0 };
+	frame.camera.lookat = { 0.0, 0.0, 0.0 };
+	frame.camera.up = { 0.0, 1.0, 0.0 };
+	// Match the field of view of the bundled scenes
+	frame.camera.fov = 90.0;
+
+	// The many lights scene lights a fixed number of spheres with the requested
+	// number of lights, the others use two lights
+	bool manyLights = type == "lights";
+	int objectCount = manyLights ? LIGHTS_SCENE_SPHERES : count;
+
+	if (!manyLights) {
+		auto key = std::make_shared<Light>();
+		key->position = { 3.0, 4.0, -4.0 };
+		key->diffuse = { 0.8, 0.8, 0.8 };
+		key->specular = { 0.6, 0.6, 0.6 };
+		frame.lights.push_back(key);
+
+		auto fill = std::make_shared<Light>();
+		fill->position = { -3.0, 2.0, -2.0 };
+		fill->diffuse = { 0.3, 0.3, 0.35 };
+		fill->specular = { 0.1, 0.1, 0.1 };
+		frame.lights.push_back(fill);
+	}
+
+	auto floor = std::make_shared<Plane>();
+	floor->point = { 0.0, -1.2, 0.0 };
+	floor->norm = { 0.0, 1.0, 0.0 };
+	Material floorMaterial;
+	floorMaterial.diffuse = { 0.5, 0.5, 0.5 };
+	floorMaterial.specular = { 0.1, 0.1, 0.1 };
+	floorMaterial.shininess = 2.0;
+	floor->material = frame.materials.add(floorMaterial);
+	frame.objects.push_back(floor);
+
+	// Seed the generator with the count so every size is its own fixed scene
+	SampleRandom random(0x5eed, (uint32_t)count, 0, 0);
+	auto inCube = [&]() {
+		return glm::dvec3(random.nextDouble(), random.nextDouble(), random.nextDouble()) * 2.0 - 1.0;
+	};
+
+	// Keep about a tenth of the 2x2x2 cube filled
+	double size = std::cbrt(0.8 / std::max(objectCount, 1));
+
+	// Particles are stored together, with their colors picked from a fixed list
+	if (type == "particles" || type == "particle-loop") {
+		auto arrays = std::make_shared<ParticleArrays>();
+		arrays->positions.reserve(3 * (size_t)objectCount);
+		arrays->radii.reserve(objectCount);
+		arrays->materials.reserve(objectCount);
+
+		for (int i = 0; i < objectCount; i++) {
+			glm::dvec3 position = inCube();
+			arrays->positions.insert(arrays->positions.end(), { (float)position.x, (float)position.y, (float)position.z });
+			arrays->radii.push_back((float)(size * 0.6));
+			arrays->materials.push_back((uint32_t)(random.nextDouble() * PARTICLE_SCENE_MATERIALS));
+		}
+
+		auto particles = std::make_shared<Particles>();
+		for (int i = 0; i < PARTICLE_SCENE_MATERIALS; i++) {
+			Material material;
+			material.diffuse = glm::dvec3(random.nextDouble(), random.nextDouble(), random.nextDouble()) * 0.7 + 0.2;
+			material.specular = { 0.3, 0.3, 0.3 };
+			material.shininess = 8.0;
+			particles->materials.push_back(frame.materials.add(material));
+		}
+
+		particles->assign(arrays);
+		frame.objects.push_back(particles);
+	}
+	else {
+		frame.objects.reserve(frame.objects.size() + objectCount);
+		for (int i = 0; i < objectCount; i++) {
+			std::shared_ptr<Object> object;
+
+			if (type != "triangles") {
+				auto sphere = std::make_shared<Sphere>();
+				sphere->position = inCube();
+				sphere->radius = size * 0.6;
+				object = sphere;
+			}
+			else {
+				auto triangle = std::make_shared<Triangle>();
+				glm::dvec3 center = inCube();
+				triangle->v1 = center + inCube() * size;
+				triangle->v2 = center + inCube() * size;
+				triangle->v3 = center + inCube() * size;
+				triangle->precompute();
+				object = triangle;
+			}
+
+			Material material;
+			material.diffuse = glm::dvec3(random.nextDouble(), random.nextDouble(), random.nextDouble()) * 0.7 + 0.2;
+			material.specular = { 0.3, 0.3, 0.3 };
+			material.shininess = 8.0;
+			object->material = frame.materials.add(material);
+			frame.objects.push_back(object);
+		}
+	}
+
+	// Scatter the lights around and between the objects, dimmed so that the
+	// total amount of light stays the same
+	if (manyLights) {
+		frame.lights.reserve(count);
+		for (int i = 0; i < count; i++) {
+			auto light = std::make_shared<Light>();
+			light->position = inCube() * 2.0 + glm::dvec3(0.0, 0.8, 0.0);
+			light->diffuse = glm::dvec3(random.nextDouble(), random.nextDouble(), random.nextDouble()) * (2.0 / count);
+			light->specular = light->diffuse * 0.5;
+			frame.lights.push_back(light);
+		}
+	}
+
+	animation.keyFrames.push_back(frame);
+
+	// The looping particle scene adds a keyframe where the particles have moved and
+	// pick from a longer list of materials, and the floor has changed color. Going
+	// from it back to the first keyframe interpolates towards the smaller table.
+	if (type == "particle-loop") {
+		Particles& start = static_cast<Particles&>(*frame.objects.back());
+
+		auto arrays = std::make_shared<ParticleArrays>();
+		arrays->positions.reserve(3 * start.count);
+		arrays->radii.assign(start.radii, start.radii + start.count);
+		arrays->materials.reserve(start.count);
+
+		for (size_t i = 0; i < start.count; i++) {
+			glm::dvec3 offset = inCube() * size;
+			for (int axis = 0; axis < 3; axis++)
+				arrays->positions.push_back(start.positions[3 * i + axis] + (float)offset[axis]);
+			arrays->materials.push_back((uint32_t)(random.nextDouble() * (PARTICLE_SCENE_MATERIALS + PARTICLE_LOOP_MATERIALS)));
+		}
+
+		Frame next = frame;
+
+		auto particles = std::make_shared<Particles>();
+		particles->materials = start.materials;
+		for (int i = 0; i < PARTICLE_LOOP_MATERIALS; i++) {
+			Material material;
+			material.diffuse = glm::dvec3(random.nextDouble(), random.nextDouble(), random.nextDouble()) * 0.7 + 0.2;
+			material.specular = { 0.6, 0.6, 0.6 };
+			material.shininess = 32.0;
+			particles->materials.push_back(next.materials.add(material));
+		}
+		particles->assign(arrays);
+		next.objects.back() = particles;
+
+		auto nextFloor = std::make_shared<Plane>(*floor);
+		floorMaterial.diffuse = { 0.3, 0.4, 0.6 };
+		nextFloor->material = next.materials.add(floorMaterial);
+		next.objects.front() = nextFloor;
+
+		animation.keyFrames.push_back(next);
+		animation.loop = true;
+	}
+
+	return animation;
+}
+
+std::optional<Animation> loadScene(const std::string& name)
+{
+	size_t colon = name.find(':');
+	std::string type = name.substr(0, colon);
+
+	if (colon != std::string::npos && (type == "spheres" || type == "triangles" || type == "particles" || type == "particle-loop" || type == "lights")) {
+		double count = 0.0;
+		try {
+			count = std::stod(name.substr(colon + 1));
+		}
+		catch (std::exception&) {
+		}
+
+		if (count < 1.0 || count > 1e8) {
+			std::cerr << "Invalid object count in \"" << name << "\"" << std::endl;
+			return std::nullopt;
+		}
+
+		return generateScene(type, (int)count);
+	}
+
+	std::ifstream file(name);
+	if (!file) {
+		std::cerr << "Could not open scene \"" << name << "\"" << std::endl;
+		return std::nullopt;
+	}
+
+	// The parser reports its progress on stdout, which would bury the results
+	std::ostringstream discard;
+	std::streambuf* out = std::cout.rdbuf(discard.rdbuf());
+
+	Animation animation;
+	Parser parser(file);
+	parser.doParse(animation);
+
+	std::cout.rdbuf(out);
+
+	if (animation.keyFrames.empty()) {
+		std::cerr << "Scene \"" << name << "\" has no keyframes" << std::endl;
+		return std::nullopt;
+	}
+
+	return animation;
+}
+
+/**
+ * Escapes a string so it can be written inside quotes in a JSON file
+ *
+ * @param string	The string to escape
+ * @return			The escaped string
+ */
+static std::string escapeJson(const std::string& string)
+{
+	std::string escaped;
+
+	for (char c : string) {
+		if (c == '"' || c == '\\')
+			escaped += '\\';
+		escaped += c;
+	}
+
+	return escaped;
+}
+
+/**
+ * Writes the results of the benchmark so they can be used as a baseline later
+ *
+ * @param path		The file to write
+ * @param options	The settings the benchmark was run with
+ * @param results	The results for every scene
+ * @return			True if the file was written
+ */
+static bool saveBaseline(const std::string& path, const BenchmarkOptions& options, const std::vector<BenchmarkResult>& results)
+{
+	std::ofstream out(path);
+	if (!out)
+		return false;
+
+	out << "{\n"
+		<< "  \"runs\": " << options.runs << ",\n"
+		<< "  \"cases\": [\n";
+
+	for (size_t i = 0; i < results.size(); i++) {
+		const BenchmarkResult& result = results[i];
+
+		out << "    { \"name\": \"" << escapeJson(result.name) << "\""
+			<< ", \"width\": " << result.width
+			<< ", \"height\": " << result.height
+			<< ", \"samples\": " << result.samples
+			<< ", \"median_seconds\": " << std::setprecision(9) << result.median
+			<< ", \"p95_seconds\": " << result.p95
+			<< ", \"rays_per_second\": " << std::setprecision(12) << result.raysPerSecond
+			<< ", \"peak_rss_mb\": " << std::setprecision(6) << result.peakMemory
+			<< ", \"shadow_cache_hit_rate\": " << result.shadowCacheHitRate
+			<< ", \"bvh_nodes\": " << std::setprecision(12) << result.bvhNodes
+			<< ", \"bvh_bytes_per_node\": " << std::setprecision(6) << result.bvhBytesPerNode
+			<< " }" << (i + 1 < results.size() ? "," : "") << "\n";
+	}
+
+	out << "  ]\n"
+		<< "}\n";
+
+	return (bool)out;
+}
+
+/**
+ * Finds the value of a string field in a flat JSON object
+ *
+ * @param object	The text of the object
+ * @param key		The name of the field
+ * @return			The unescaped value, or std::nullopt if the field is missing
+ */
+static std::optional<std::string> jsonString(const std::string& object, const std::string& key)
+{
+	size_t pos = object.find("\"" + key + "\"");
+	if (pos == std::string::npos)
+		return std::nullopt;
+
+	pos = object.find('"', object.find(':', pos) + 1);
+	if (pos == std::string::npos)
+		return std::nullopt;
+
+	std::string value;
+	for (pos++; pos < object.size() && object[pos] != '"'; pos++) {
+		if (object[pos] == '\\')
+			pos++;
+		value += object[pos];
+	}
+
+	return value;
+}
+
+/**
+ * Finds the value of a numeric field in a flat JSON object
+ *
+ * @param object	The text of the object
+ * @param key		The name of the field
+ * @return			The value, or std::nullopt if the field is missing
+ */
+static std::optional<double> jsonNumber(const std::string& object, const std::string& key)
+{
+	size_t pos = object.find("\"" + key + "\"");
+	if (pos == std::string::npos)
+		return std::nullopt;
+
+	try {
+		return std::stod(object.substr(object.find(':', pos) + 1));
+	}
+	catch (std::exception&) {
+		return std::nullopt;
+	}
+}
+
+/**
+ * Reads a baseline written by an earlier run of the benchmark. This only
+ * understands the layout that saveBaseline writes, not JSON in general.
+ *
+ * @param path	The file to read
+ * @return		The results stored in the baseline, or std::nullopt if it could not be read
+ */
+static std::optional<std::vector<BenchmarkResult>> loadBaseline(const std::string& path)
+{
+	std::ifstream in(path);
+	if (!in)
+		return std::nullopt;
+
+	std::ostringstream contents;
+	contents << in.rdbuf();
+	std::string text = contents.str();
+
+	size_t pos = text.find("\"cases\"");
+	if (pos == std::string::npos)
+		return std::nullopt;
+
+	std::vector<BenchmarkResult> results;
+	while ((pos = text.find('{', pos)) != std::string::npos) {
+		size_t end = text.find('}', pos);
+		if (end == std::string::npos)
+			return std::nullopt;
+
+		std::string object = text.substr(pos, end - pos);
+		pos = end;
+
+		auto name = jsonString(object, "name");
+		auto median = jsonNumber(object, "median_seconds");
+		if (!name.has_value() || !median.has_value())
+			return std::nullopt;
+
+		BenchmarkResult result;
+		result.name = name.value();
+		result.width = (int)jsonNumber(object, "width").value_or(0);
+		result.height = (int)jsonNumber(object, "height").value_or(0);
+		result.samples = (int)jsonNumber(object, "samples").value_or(0);
+		result.median = median.value();
+		result.p95 = jsonNumber(object, "p95_seconds").value_or(0.0);
+		result.raysPerSecond = jsonNumber(object, "rays_per_second").value_or(0.0);
+		result.peakMemory = jsonNumber(object, "peak_rss_mb").value_or(0.0);
+		result.shadowCacheHitRate = jsonNumber(object, "shadow_cache_hit_rate").value_or(0.0);
+		result.bvhNodes = jsonNumber(object, "bvh_nodes").value_or(0.0);
+		result.bvhBytesPerNode = jsonNumber(object, "bvh_bytes_per_node").value_or(0.0);
+		results.push_back(result);
+	}
+
+	return results;
+}
+
+/**
+ * Parses the arguments given after --benchmark
+ *
+ * @param argc	The number of arguments
+ * @param argv	The arguments
+ * @return		The parsed settings, or std::nullopt if an error occurred
+ */
+static std::optional<BenchmarkOptions> parseBenchmarkArguments(int argc, char** argv)
+{
+	BenchmarkOptions options;
+
+	for (int i = 0; i < argc; i++) {
+		std::string arg(argv[i]);
+
+		if (arg == "--no-shadow-cache") {
+			options.shadowCache = false;
+			continue;
+		}
+
+		if (arg == "--no-specialize") {
+			options.specialize = false;
+			continue;
+		}
+
+		if (arg == "--wavefront") {
+			options.wavefront = true;
+			continue;
+		}
+
+		if (arg == "--watertight") {
+			options.watertight = true;
+			continue;
+		}
+
+		if (arg == "--wide-bvh") {
+			options.wideBvh = true;
+			continue;
+		}
+
+		if (arg == "--sphere-grid") {
+			options.sphereGrid = true;
+			continue;
+		}
+
+		if (i + 1 >= argc) {
+			std::cerr << "Missing value after " << arg << std::endl;
+			return std::nullopt;
+		}
+		std::string value(argv[++i]);
+
+		try {
+			if (arg == "--scene") {
+				options.scenes.push_back(value);
+			}
+			else if (arg == "--runs") {
+				options.runs = std::stoi(value);
+			}
+			else if (arg == "--resolution") {
+				size_t x = value.find('x');
+				if (x == std::string::npos)
+					throw std::invalid_argument(value);
+
+				options.width = std::stoi(value.substr(0, x));
+				options.height = std::stoi(value.substr(x + 1));
+			}
+			else if (arg == "--samples") {
+				options.samples = std::stoi(value);
+			}
+			else if (arg == "--threads") {
+				options.threads = std::stoi(value);
+			}
+			else if (arg == "--light-samples") {
+				options.lightSamples = std::stoi(value);
+			}
+			else if (arg == "--isa") {
+				std::optional<IsaLevel> isa = parseIsa(value);
+				if (!isa.has_value())
+					throw std::invalid_argument(value);
+
+				options.isa = isa.value();
+			}
+			else if (arg == "--bvh") {
+				std::optional<BvhBuilder> builder = parseBvhBuilder(value);
+				if (!builder.has_value())
+					throw std::invalid_argument(value);
+
+				options.bvhBuilder = builder.value();
+			}
+			else if (arg == "--baseline") {
+				options.baselinePath = value;
+			}
+			else if (arg == "--save-baseline") {
+				options.savePath = value;
+			}
+			else if (arg == "--tolerance") {
+				options.tolerance = std::stod(value) / 100.0;
+			}
+			else {
+				std::cerr << "Unknown benchmark option \"" << arg << "\"" << std::endl;
+				return std::nullopt;
+			}
+		}
+		catch (std::exception&) {
+			std::cerr << "Invalid value \"" << value << "\" after " << arg << std::endl;
+			return std::nullopt;
+		}
+	}
+
+	if (options.runs < 1 || options.width < 0 || options.height < 0 || options.samples < 0 || options.lightSamples < 0 || options.tolerance < 0.0) {
+		std::cerr << "Benchmark settings must not be negative, and at least one run is needed" << std::endl;
+		return std::nullopt;
+	}
+
+	if (options.scenes.empty())
+		options.scenes.assign(std::begin(DEFAULT_SCENES), std::end(DEFAULT_SCENES));
+
+	return options;
+}
+
+int runBenchmark(int argc, char** argv)
+{
+	std::optional<BenchmarkOptions> optionsOpt = parseBenchmarkArguments(argc, argv);
+	if (!optionsOpt.has_value())
+		return -1;
+	BenchmarkOptions options = optionsOpt.value();
+
+	std::optional<std::vector<BenchmarkResult>> baseline;
+	if (!options.baselinePath.empty()) {
+		baseline = loadBaseline(options.baselinePath);
+		if (!baseline.has_value()) {
+			std::cerr << "Could not read baseline \"" << options.baselinePath << "\"" << std::endl;
+			return -1;
+		}
+	}
+
+#ifdef _OPENMP
+	if (options.threads > 0)
+		omp_set_num_threads(options.threads);
+#endif
+
+	selectIsa(options.isa);
+
+	Triangle::watertight = options.watertight;
+
+	std::cout << "Scene                     Resolution   Samples   Median (s)    P95 (s)   MRays/s   Peak RSS (MB)   Shadow cache hits   BVH nodes   Bytes/node" << std::endl;
+
+	std::vector<BenchmarkResult> results;
+	bool regressed = false;
+
+	for (const std::string& name : options.scenes) {
+		std::optional<Animation> animationOpt = loadScene(name);
+		if (!animationOpt.has_value())
+			continue;
+		Animation& animation = animationOpt.value();
+
+		if (options.width > 0 && options.height > 0) {
+			animation.width = options.width;
+			animation.height = options.height;
+		}
+		if (options.samples > 0)
+			animation.samples = options.samples;
+
+		// Every scene is timed on its first keyframe, rendered headless
+		SDL_Surface* surface = createFramebuffer(animation.width, animation.height);
+		if (surface == nullptr) {
+			std::cerr << "Could not create a surface for \"" << name << "\": " << SDL_GetError() << std::endl;
+			return -1;
+		}
+
+		Frame& frame = animation.keyFrames[0];
+		Configuration config;
+		config.lightSamples = options.lightSamples;
+		config.shadowCache = options.shadowCache;
+		config.specialize = options.specialize;
+		config.wavefront = options.wavefront;
+		config.bvhBuilder = options.bvhBuilder;
+		config.wideBvh = options.wideBvh;
+		config.sphereGrid = options.sphereGrid;
+		applySceneSettings(config, animation);
+
+		// One untimed render first so caches and thread pools are warmed up
+		RenderStats stats = renderFrame(nullptr, surface, frame, 0, animation.maxDepth, animation.samples, animation.pattern, config);
+
+		std::vector<double> times;
+		for (int run = 0; run < options.runs; run++) {
+			auto start = std::chrono::steady_clock::now();
+			stats = renderFrame(nullptr, surface, frame, 0, animation.maxDepth, animation.samples, animation.pattern, config);
+			auto end = std::chrono::steady_clock::now();
+
+			times.push_back(std::chrono::duration<double>(end - start).count());
+		}
+		std::sort(times.begin(), times.end());
+
+		freeFramebuffer(surface);
+
+		BenchmarkResult result;
+		result.name = name;
+		result.width = animation.width;
+		result.height = animation.height;
+		result.samples = animation.samples;
+		result.median = percentile(times, 0.5);
+		result.p95 = percentile(times, 0.95);
+		result.raysPerSecond = stats.rays / std::max(result.median, 1e-9);
+		result.shadowCacheHitRate = stats.shadowRays > 0 ? (double)stats.shadowCacheHits / stats.shadowRays : 0.0;
+		result.peakMemory = peakMemoryMB();
+		result.bvhNodes = (double)stats.bvhNodes;
+		result.bvhBytesPerNode = stats.bvhNodes > 0 ? (double)stats.bvhMemory / stats.bvhNodes : 0.0;
+		results.push_back(result);
+
+		std::cout << std::left << std::setw(26) << name << std::right
+				  << std::setw(5) << result.width << "x" << std::left << std::setw(7) << result.height << std::right
+				  << std::setw(8) << result.samples
+				  << std::fixed << std::setprecision(4)
+				  << std::setw(13) << result.median
+				  << std::setw(11) << result.p95
+				  << std::setprecision(2)
+				  << std::setw(10) << result.raysPerSecond / 1e6
+				  << std::setprecision(1)
+				  << std::setw(16) << result.peakMemory
+				  << std::setw(19) << result.shadowCacheHitRate * 100.0 << "%"
+				  << std::setprecision(0)
+				  << std::setw(12) << result.bvhNodes
+				  << std::setprecision(1)
+				  << std::setw(13) << result.bvhBytesPerNode
+				  << std::defaultfloat << std::endl;
+
+		if (!baseline.has_value())
+			continue;
+
+		auto previous = std::find_if(baseline->begin(), baseline->end(), [&](const BenchmarkResult& b) { return b.name == name; });
+		if (previous == baseline->end()) {
+			std::cout << "    Not in the baseline" << std::endl;
+		}
+		else if (previous->width != result.width || previous->height != result.height || previous->samples != result.samples) {
+			std::cout << "    Baseline was rendered with different settings, not comparing" << std::endl;
+		}
+		else {
+			double change = result.median / previous->median - 1.0;
+
+			std::cout << "    " << std::showpos << std::fixed << std::setprecision(1) << change * 100.0
+					  << std::noshowpos << std::defaultfloat << "% compared to the baseline";
+
+			if (change > options.tolerance) {
+				std::cout << " -- REGRESSION (allowed " << options.tolerance * 100.0 << "%)";
+				regressed = true;
+			}
+			std::cout << std::endl;
+		}
+	}
+
+	if (!options.savePath.empty()) {
+		if (saveBaseline(options.savePath, options, results))
+			std::cout << "Wrote baseline to \"" << options.savePath << "\"" << std::endl;
+		else
+			std::cerr << "Could not write baseline \"" << options.savePath << "\"" << std::endl;
+	}
+
+	if (regressed) {
+		std::cerr << "Benchmark FAILED: at least one scene is slower than the baseline allows" << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
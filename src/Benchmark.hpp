@@ -0,0 +1,43 @@
+#ifndef BENCHMARK_HPP
+#define BENCHMARK_HPP
+
+#include <string>
+#include <optional>
+
+#include "Scene.hpp"
+
+/**
+ * Builds a large scene for benchmarking. The objects are spread randomly through
+ * a cube in front of the camera and are sized so that roughly the same fraction
+ * of the cube is filled no matter how many there are. The same count always
+ * produces the same scene.
+ *
+ * @param type	The type of object to fill the scene with, "spheres" or "triangles",
+ *				"particles" for spheres in a single particle set, "particle-loop" for
+ *				particles moving between two looping keyframes, or "lights" for a
+ *				fixed set of spheres lit by many lights
+ * @param count	The number of objects, or of lights, to generate
+ * @return		An animation containing a single keyframe, or two for "particle-loop"
+ */
+Animation generateScene(const std::string& type, int count);
+
+/**
+ * Loads a scene without printing the parser's progress
+ *
+ * @param name	The path of a scene file, or a generated scene of the form <type>:<count>
+ * @return		The scene, or std::nullopt if it could not be loaded
+ */
+std::optional<Animation> loadScene(const std::string& name);
+
+/**
+ * Runs the benchmark suite. Each scene is rendered headless a number of times
+ * and the timings are compared against a stored baseline, if one is given.
+ *
+ * @param argc	The number of arguments after --benchmark
+ * @param argv	The arguments after --benchmark
+ * @return		0 if the benchmark ran and nothing regressed, 1 if a scene got
+ *				slower than the baseline allows, or -1 on an error
+ */
+int runBenchmark(int argc, char** argv);
+
+#endif//BENCHMARK_HPP
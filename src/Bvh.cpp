@@ -0,0 +1,1007 @@
+#include "Bvh.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <memory>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include "CpuFeatures.hpp"
+#include "RadixSort.hpp"
+
+/// The number of bins the objects are sorted into to find the best split of a node
+const int BVH_BINS = 16;
+
+/// Nodes with at most this many objects become leaves if splitting them does not pay off
+const int BVH_MAX_LEAF = 4;
+
+/// The cost of visiting a node, relative to testing a ray against an object
+const double BVH_TRAVERSAL_COST = 1.0;
+
+/// The number of nodes that can wait to be visited while tracing a ray, which
+/// is the deepest a tree can get. Linear BVHs split off at least one bit of the
+/// Morton codes or of the object index with every level, so they stay within this.
+const int BVH_STACK_SIZE = 128;
+
+/// From this depth on, nodes are split in half instead of where the surface area
+/// heuristic says. Halving the nodes ends the tree within 32 more levels.
+const int BVH_MAX_SAH_DEPTH = 32;
+
+/// Linear BVHs over more objects than this use 63 bit Morton codes instead of 30 bit
+/// ones, so that fewer objects share a code
+const int LBVH_MAX_30_BIT = 1 << 16;
+
+/// Linear BVHs over fewer objects than this are built on a single thread
+const int LBVH_MIN_PARALLEL = 1024;
+
+/// The most leaves a treelet is grown to before it is rearranged
+const int TREELET_LEAVES = 5;
+
+/// How many times every treelet is rearranged
+const int TREELET_PASSES = 3;
+
+/// The number of slabs a node is cut into to find the best plane to split its objects at
+const int SBVH_BINS = 32;
+
+/// Spatial splits are only tried for nodes where the sides of the best object split
+/// overlap by more than this fraction of the root's surface area
+const double SBVH_MIN_OVERLAP = 1e-5;
+
+/**
+ * Counts the zero bits above the highest set bit
+ *
+ * @param value	The value. Must not be 0
+ * @return		The number of leading zeros
+ */
+static inline int leadingZeros(uint64_t value)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanReverse64(&index, value);
+	return 63 - (int)index;
+#else
+	return __builtin_clzll(value);
+#endif
+}
+
+/**
+ * Spreads out the lowest 21 bits of a number so there are two zero bits between each
+ *
+ * @param v	The number
+ * @return	The spread out bits
+ */
+static uint64_t expandBits(uint64_t v)
+{
+	v &= 0x1fffff;
+	v = (v | v << 32) & 0x1f00000000ffffull;
+	v = (v | v << 16) & 0x1f0000ff0000ffull;
+	v = (v | v << 8) & 0x100f00f00f00f00full;
+	v = (v | v << 4) & 0x10c30c30c30c30c3ull;
+	v = (v | v << 2) & 0x1249249249249249ull;
+	return v;
+}
+
+/**
+ * Computes the length of the common prefix of two sorted Morton codes. Equal codes
+ * are told apart by the positions of their objects.
+ *
+ * @param objects	The sorted objects
+ * @param i, j		The positions of the codes to compare
+ * @return			The number of leading bits the codes share, or -1 if j is out of range
+ */
+static inline int commonPrefix(const std::vector<SortKey>& objects, int i, int j)
+{
+	if (j < 0 || j >= (int)objects.size())
+		return -1;
+
+	uint64_t a = objects[i].code;
+	uint64_t b = objects[j].code;
+
+	// Past the end of the codes, the positions are compared as if they were the next 32 bits
+	if (a == b)
+		return 32 + leadingZeros((uint64_t)(i ^ j));
+
+	return leadingZeros(a ^ b);
+}
+
+/**
+ * Computes the surface area of a box, which is proportional to the chance that
+ * a random ray passes through it
+ *
+ * @param box	The box
+ * @return		The surface area of the box, or 0 if it is empty
+ */
+static double surfaceArea(const BoundingBox& box)
+{
+	glm::dvec3 size = glm::max(box.max - box.min, glm::dvec3(0.0));
+	return 2.0 * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+/**
+ * Checks whether a box has no points, either because it was never extended or
+ * because it is the overlap of boxes that do not overlap
+ *
+ * @param box	The box
+ * @return		True if the box is empty
+ */
+static inline bool isEmpty(const BoundingBox& box)
+{
+	return box.min.x > box.max.x || box.min.y > box.max.y || box.min.z > box.max.z;
+}
+
+/**
+ * Finds the overlap of two boxes
+ *
+ * @param a		The first box
+ * @param b		The second box
+ * @return		The points in both boxes, which may be empty
+ */
+static inline BoundingBox overlapOf(const BoundingBox& a, const BoundingBox& b)
+{
+	return { glm::max(a.min, b.min), glm::min(a.max, b.max) };
+}
+
+/**
+ * Intersects a ray with a box
+ *
+ * @param box		The box
+ * @param origin	The origin of the ray
+ * @param invDir	One over each component of the ray's direction
+ * @param tMax		The distance along the ray beyond which the box is not needed
+ * @return			True if the ray passes through the box between its origin and tMax
+ */
+static FORCE_INLINE bool hitsBox(const BoundingBox& box, const glm::dvec3& origin, const glm::dvec3& invDir, double tMax)
+{
+	glm::dvec3 t0 = (box.min - origin) * invDir;
+	glm::dvec3 t1 = (box.max - origin) * invDir;
+
+	// A ray in the plane of a side gives NaN, which std::min and std::max drop
+	// when it is passed second
+	double tNear = 0.0;
+	double tFar = tMax;
+	for (int i = 0; i < 3; i++) {
+		tNear = std::max(tNear, std::min(t0[i], t1[i]));
+		tFar = std::min(tFar, std::max(t0[i], t1[i]));
+	}
+
+	return tNear <= tFar;
+}
+
+Bvh::Bvh(const std::vector<Object*>& objects, BvhBuilder builder, double splitBudget)
+{
+	if (activeIsa() >= IsaLevel::AVX2) {
+		intersectKernel = intersectAvx2;
+		occludedKernel = occludedAvx2;
+	}
+
+	if (objects.empty())
+		return;
+
+	if (builder == BvhBuilder::LBVH || builder == BvhBuilder::TREELETS) {
+		buildLinear(objects, builder == BvhBuilder::TREELETS);
+		return;
+	}
+
+	std::vector<BuildObject> build;
+	build.reserve(objects.size());
+
+	for (Object* object : objects) {
+		BoundingBox bounds = object->bounds();
+		build.push_back({ bounds, (bounds.min + bounds.max) * 0.5, object });
+	}
+
+	nodes.reserve(objects.size() * 2);
+	this->objects.reserve(objects.size());
+
+	if (builder == BvhBuilder::SBVH) {
+		BoundingBox bounds;
+		for (const BuildObject& object : build)
+			bounds.extend(object.bounds);
+
+		int budget = (int)(objects.size() * std::max(splitBudget, 0.0));
+		buildSpatial(build, 0, surfaceArea(bounds), budget);
+	}
+	else {
+		this->build(build, 0, (int)build.size(), 0);
+	}
+}
+
+Bvh::Split Bvh::findObjectSplit(const BuildObject* build, int count, const BoundingBox& centers)
+{
+	Split best;
+	glm::dvec3 extent = centers.max - centers.min;
+
+	// Find the cheapest split between the bins along each axis
+	for (int axis = 0; axis < 3; axis++) {
+		if (extent[axis] <= 0.0)
+			continue;
+
+		BoundingBox binBounds[BVH_BINS];
+		int binCounts[BVH_BINS] = {};
+
+		double scale = BVH_BINS / extent[axis];
+		for (int i = 0; i < count; i++) {
+			int bin = std::min((int)((build[i].center[axis] - centers.min[axis]) * scale), BVH_BINS - 1);
+			binBounds[bin].extend(build[i].bounds);
+			binCounts[bin]++;
+		}
+
+		// The cost of every split from the left, then the right
+		BoundingBox leftBox[BVH_BINS];
+		int leftCount[BVH_BINS];
+		BoundingBox box;
+		int total = 0;
+		for (int bin = 0; bin < BVH_BINS - 1; bin++) {
+			box.extend(binBounds[bin]);
+			total += binCounts[bin];
+			leftBox[bin] = box;
+			leftCount[bin] = total;
+		}
+
+		box = BoundingBox();
+		total = 0;
+		for (int bin = BVH_BINS - 1; bin > 0; bin--) {
+			box.extend(binBounds[bin]);
+			total += binCounts[bin];
+
+			double cost = surfaceArea(leftBox[bin - 1]) * leftCount[bin - 1] + surfaceArea(box) * total;
+			if (leftCount[bin - 1] > 0 && total > 0 && cost < best.cost) {
+				best.cost = cost;
+				best.axis = axis;
+				best.bin = bin;
+				best.left = leftBox[bin - 1];
+				best.right = box;
+				best.leftCount = leftCount[bin - 1];
+				best.rightCount = total;
+			}
+		}
+	}
+
+	return best;
+}
+
+Bvh::Split Bvh::findSpatialSplit(const std::vector<BuildObject>& refs, const BoundingBox& bounds)
+{
+	Split best;
+
+	for (int axis = 0; axis < 3; axis++) {
+		double extent = bounds.max[axis] - bounds.min[axis];
+		if (extent <= 0.0)
+			continue;
+
+		// Every reference is cut into the bins it crosses, and counted as entering
+		// the first and leaving the last
+		BoundingBox binBounds[SBVH_BINS];
+		int entries[SBVH_BINS] = {}, exits[SBVH_BINS] = {};
+
+		double width = extent / SBVH_BINS;
+		auto binOf = [&](double x) {
+			return std::clamp((int)((x - bounds.min[axis]) / width), 0, SBVH_BINS - 1);
+		};
+
+		for (const BuildObject& ref : refs) {
+			int first = binOf(ref.bounds.min[axis]);
+			int last = binOf(ref.bounds.max[axis]);
+			entries[first]++;
+			exits[last]++;
+
+			if (first == last) {
+				binBounds[first].extend(ref.bounds);
+				continue;
+			}
+
+			for (int bin = first; bin <= last; bin++) {
+				double lo = bin == first ? ref.bounds.min[axis] : bounds.min[axis] + bin * width;
+				double hi = bin == last ? ref.bounds.max[axis] : bounds.min[axis] + (bin + 1) * width;
+
+				BoundingBox piece = clip(ref, axis, lo, hi);
+				if (!isEmpty(piece))
+					binBounds[bin].extend(piece);
+			}
+		}
+
+		BoundingBox leftBox[SBVH_BINS];
+		int leftCount[SBVH_BINS];
+		BoundingBox box;
+		int total = 0;
+		for (int bin = 0; bin < SBVH_BINS - 1; bin++) {
+			box.extend(binBounds[bin]);
+			total += entries[bin];
+			leftBox[bin] = box;
+			leftCount[bin] = total;
+		}
+
+		box = BoundingBox();
+		total = 0;
+		for (int bin = SBVH_BINS - 1; bin > 0; bin--) {
+			box.extend(binBounds[bin]);
+			total += exits[bin];
+
+			double cost = surfaceArea(leftBox[bin - 1]) * leftCount[bin - 1] + surfaceArea(box) * total;
+			if (leftCount[bin - 1] > 0 && total > 0 && cost < best.cost) {
+				best.cost = cost;
+				best.axis = axis;
+				best.position = bounds.min[axis] + bin * width;
+				best.left = leftBox[bin - 1];
+				best.right = box;
+				best.leftCount = leftCount[bin - 1];
+				best.rightCount = total;
+			}
+		}
+	}
+
+	return best;
+}
+
+BoundingBox Bvh::clip(const BuildObject& ref, int axis, double lo, double hi)
+{
+	BoundingBox box;
+
+	if (ref.object->type == ObjectType::TRIANGLE) {
+		// The part of the triangle between the planes is bounded by its corners
+		// between them and the points where its edges cross them
+		Triangle* triangle = static_cast<Triangle*>(ref.object);
+		glm::dvec3 vertices[3] = { triangle->v1, triangle->v2, triangle->v3 };
+
+		for (int i = 0; i < 3; i++) {
+			const glm::dvec3& a = vertices[i];
+			const glm::dvec3& b = vertices[(i + 1) % 3];
+
+			if (a[axis] >= lo && a[axis] <= hi)
+				box.extend(a);
+
+			for (double plane : { lo, hi }) {
+				if ((a[axis] < plane) != (b[axis] < plane)) {
+					glm::dvec3 crossing = a + (b - a) * ((plane - a[axis]) / (b[axis] - a[axis]));
+					crossing[axis] = plane;
+					box.extend(crossing);
+				}
+			}
+		}
+	}
+	else {
+		box = ref.bounds;
+	}
+
+	// The part never reaches outside the reference it was cut from, or the planes
+	box = overlapOf(box, ref.bounds);
+	box.min[axis] = std::max(box.min[axis], lo);
+	box.max[axis] = std::min(box.max[axis], hi);
+
+	return box;
+}
+
+int Bvh::build(std::vector<BuildObject>& build, int begin, int end, int depth)
+{
+	int index = (int)nodes.size();
+	nodes.emplace_back();
+
+	BoundingBox bounds, centers;
+	for (int i = begin; i < end; i++) {
+		bounds.extend(build[i].bounds);
+		centers.extend(build[i].center);
+	}
+
+	nodes[index].bounds = bounds;
+
+	int count = end - begin;
+	glm::dvec3 extent = centers.max - centers.min;
+
+	Split best;
+	if (count > 1 && depth < BVH_MAX_SAH_DEPTH)
+		best = findObjectSplit(&build[begin], count, centers);
+
+	double bestCost = best.cost;
+	int bestAxis = best.axis, bestBin = best.bin;
+
+	// Relative to testing every object of the node
+	double area = surfaceArea(bounds);
+	bestCost = area > 0.0 ? BVH_TRAVERSAL_COST + bestCost / area : bestCost;
+
+	bool split = bestAxis >= 0 && (count > BVH_MAX_LEAF || bestCost < count);
+
+	if ((!split && count <= BVH_MAX_LEAF) || count == 1) {
+		nodes[index].first = (int)objects.size();
+		nodes[index].count = count;
+
+		for (int i = begin; i < end; i++)
+			objects.push_back(build[i].object);
+
+		return index;
+	}
+
+	int middle;
+	if (split) {
+		double scale = BVH_BINS / extent[bestAxis];
+		auto it = std::partition(build.begin() + begin, build.begin() + end, [&](const BuildObject& o) {
+			return std::min((int)((o.center[bestAxis] - centers.min[bestAxis]) * scale), BVH_BINS - 1) < bestBin;
+		});
+		middle = (int)(it - build.begin());
+	}
+	else {
+		// The centers are too close together to bin, or the tree is getting too deep,
+		// so the objects are split in half along the longest side of the bounds
+		glm::dvec3 size = bounds.max - bounds.min;
+		bestAxis = size.x > size.y ? (size.x > size.z ? 0 : 2) : (size.y > size.z ? 1 : 2);
+		middle = (begin + end) / 2;
+
+		std::nth_element(build.begin() + begin, build.begin() + middle, build.begin() + end, [&](const BuildObject& a, const BuildObject& b) {
+			return a.center[bestAxis] < b.center[bestAxis];
+		});
+	}
+
+	nodes[index].axis = bestAxis;
+
+	int left = this->build(build, begin, middle, depth + 1);
+	int right = this->build(build, middle, end, depth + 1);
+
+	nodes[index].left = left;
+	nodes[index].right = right;
+
+	return index;
+}
+
+int Bvh::buildSpatial(std::vector<BuildObject>& refs, int depth, double rootArea, int& budget)
+{
+	int index = (int)nodes.size();
+	nodes.emplace_back();
+
+	BoundingBox bounds, centers;
+	for (const BuildObject& ref : refs) {
+		bounds.extend(ref.bounds);
+		centers.extend(ref.center);
+	}
+
+	nodes[index].bounds = bounds;
+
+	int count = (int)refs.size();
+	Split best;
+	bool spatial = false;
+
+	if (count > 1 && depth < BVH_MAX_SAH_DEPTH) {
+		best = findObjectSplit(refs.data(), count, centers);
+
+		// Cutting objects only pays off where the sides of the object split overlap
+		// by a noticeable amount, and only while the budget lasts
+		double overlap = best.axis >= 0 ? surfaceArea(overlapOf(best.left, best.right)) : rootArea;
+		if (budget > 0 && overlap > SBVH_MIN_OVERLAP * rootArea) {
+			Split split = findSpatialSplit(refs, bounds);
+
+			if (split.cost < best.cost && split.leftCount + split.rightCount - count <= budget) {
+				best = split;
+				spatial = true;
+			}
+		}
+	}
+
+	// Relative to testing every object of the node
+	double area = surfaceArea(bounds);
+	double bestCost = area > 0.0 ? BVH_TRAVERSAL_COST + best.cost / area : best.cost;
+
+	bool split = best.axis >= 0 && (count > BVH_MAX_LEAF || bestCost < count);
+
+	if ((!split && count <= BVH_MAX_LEAF) || count == 1) {
+		nodes[index].first = (int)objects.size();
+		nodes[index].count = count;
+
+		for (const BuildObject& ref : refs)
+			objects.push_back(ref.object);
+
+		return index;
+	}
+
+	std::vector<BuildObject> left, right;
+
+	if (split && spatial) {
+		// A reference crossing the plane is cut in two, unless moving all of it to
+		// one side costs less than the extra reference
+		double leftArea = surfaceArea(best.left), rightArea = surfaceArea(best.right);
+		double splitCost = leftArea * best.leftCount + rightArea * best.rightCount;
+
+		for (const BuildObject& ref : refs) {
+			if (ref.bounds.max[best.axis] <= best.position) {
+				left.push_back(ref);
+				continue;
+			}
+			if (ref.bounds.min[best.axis] >= best.position) {
+				right.push_back(ref);
+				continue;
+			}
+
+			BoundingBox leftWith = best.left, rightWith = best.right;
+			leftWith.extend(ref.bounds);
+			rightWith.extend(ref.bounds);
+			double leftCost = surfaceArea(leftWith) * best.leftCount + rightArea * (best.rightCount - 1);
+			double rightCost = leftArea * (best.leftCount - 1) + surfaceArea(rightWith) * best.rightCount;
+
+			BoundingBox leftPart, rightPart;
+			if (splitCost <= leftCost && splitCost <= rightCost) {
+				leftPart = clip(ref, best.axis, ref.bounds.min[best.axis], best.position);
+				rightPart = clip(ref, best.axis, best.position, ref.bounds.max[best.axis]);
+			}
+			else if (leftCost <= rightCost) {
+				leftPart = ref.bounds;
+			}
+			else {
+				rightPart = ref.bounds;
+			}
+
+			if (!isEmpty(leftPart))
+				left.push_back({ leftPart, (leftPart.min + leftPart.max) * 0.5, ref.object });
+			if (!isEmpty(rightPart))
+				right.push_back({ rightPart, (rightPart.min + rightPart.max) * 0.5, ref.object });
+		}
+
+		// Moving the cut references around can empty a side, in which case the
+		// objects are split by their centers after all
+		if (left.empty() || right.empty()) {
+			left.clear();
+			right.clear();
+			spatial = false;
+			best = findObjectSplit(refs.data(), count, centers);
+			split = best.axis >= 0;
+		}
+		else {
+			budget -= (int)(left.size() + right.size()) - count;
+		}
+	}
+
+	if (split && !spatial) {
+		glm::dvec3 extent = centers.max - centers.min;
+		double scale = BVH_BINS / extent[best.axis];
+
+		for (const BuildObject& ref : refs) {
+			if (std::min((int)((ref.center[best.axis] - centers.min[best.axis]) * scale), BVH_BINS - 1) < best.bin)
+				left.push_back(ref);
+			else
+				right.push_back(ref);
+		}
+	}
+	else if (!split) {
+		// As for build(), the references are split in half along the longest side
+		glm::dvec3 size = bounds.max - bounds.min;
+		best.axis = size.x > size.y ? (size.x > size.z ? 0 : 2) : (size.y > size.z ? 1 : 2);
+		int middle = count / 2;
+
+		std::nth_element(refs.begin(), refs.begin() + middle, refs.end(), [&](const BuildObject& a, const BuildObject& b) {
+			return a.center[best.axis] < b.center[best.axis];
+		});
+		left.assign(refs.begin(), refs.begin() + middle);
+		right.assign(refs.begin() + middle, refs.end());
+	}
+
+	// The references of this node are not needed while the children are built
+	std::vector<BuildObject>().swap(refs);
+
+	nodes[index].axis = best.axis;
+
+	int leftIndex = buildSpatial(left, depth + 1, rootArea, budget);
+	int rightIndex = buildSpatial(right, depth + 1, rootArea, budget);
+
+	nodes[index].left = leftIndex;
+	nodes[index].right = rightIndex;
+
+	return index;
+}
+
+void Bvh::buildLinear(const std::vector<Object*>& objects, bool treelets)
+{
+	int count = (int)objects.size();
+
+	std::vector<BoundingBox> bounds(count);
+	BoundingBox centers;
+
+	#pragma omp parallel if(count >= LBVH_MIN_PARALLEL)
+	{
+		BoundingBox local;
+
+		#pragma omp for
+		for (int i = 0; i < count; i++) {
+			bounds[i] = objects[i]->bounds();
+			local.extend((bounds[i].min + bounds[i].max) * 0.5);
+		}
+
+		#pragma omp critical
+		centers.extend(local);
+	}
+
+	// Place the centers on a grid over their bounds, with 2^10 or 2^21 cells on each side
+	int bits = count > LBVH_MAX_30_BIT ? 21 : 10;
+	double cells = (double)((1 << bits) - 1);
+	glm::dvec3 extent = centers.max - centers.min;
+	glm::dvec3 scale;
+	for (int axis = 0; axis < 3; axis++)
+		scale[axis] = extent[axis] > 0.0 ? cells / extent[axis] : 0.0;
+
+	std::vector<SortKey> sorted(count);
+
+	#pragma omp parallel for if(count >= LBVH_MIN_PARALLEL)
+	for (int i = 0; i < count; i++) {
+		glm::dvec3 cell = ((bounds[i].min + bounds[i].max) * 0.5 - centers.min) * scale;
+		sorted[i].code = expandBits((uint64_t)cell.x) << 2 | expandBits((uint64_t)cell.y) << 1 | expandBits((uint64_t)cell.z);
+		sorted[i].index = i;
+	}
+
+	radixSort(sorted, bits * 3);
+
+	// The objects are the leaves in the order of the curve, after the count - 1 interior nodes
+	int interior = count - 1;
+	nodes.resize((size_t)interior + count);
+	this->objects.resize(count);
+
+	std::vector<int> parents(nodes.size(), -1);
+
+	#pragma omp parallel for if(count >= LBVH_MIN_PARALLEL)
+	for (int i = 0; i < count; i++) {
+		Node& leaf = nodes[(size_t)interior + i];
+		leaf.bounds = bounds[sorted[i].index];
+		leaf.first = i;
+		leaf.count = 1;
+
+		this->objects[i] = objects[sorted[i].index];
+	}
+
+	// Every interior node covers the run of codes that share a prefix with its first
+	// or last code, and splits it where the next bit of that prefix changes. This
+	// follows Karras, "Maximizing Parallelism in the Construction of BVHs, Octrees,
+	// and k-d Trees", 2012.
+	#pragma omp parallel for if(count >= LBVH_MIN_PARALLEL)
+	for (int i = 0; i < interior; i++) {
+		// Find the direction the node's run goes in, and then its other end
+		int dir = commonPrefix(sorted, i, i + 1) > commonPrefix(sorted, i, i - 1) ? 1 : -1;
+		int minPrefix = commonPrefix(sorted, i, i - dir);
+
+		int maxLength = 2;
+		while (commonPrefix(sorted, i, i + maxLength * dir) > minPrefix)
+			maxLength *= 2;
+
+		int length = 0;
+		for (int step = maxLength / 2; step >= 1; step /= 2) {
+			if (commonPrefix(sorted, i, i + (length + step) * dir) > minPrefix)
+				length += step;
+		}
+
+		int j = i + length * dir;
+
+		// Find the last code that shares more than the whole run's prefix with i
+		int prefix = commonPrefix(sorted, i, j);
+		int split = 0;
+		int step = length;
+		do {
+			step = (step + 1) / 2;
+			if (commonPrefix(sorted, i, i + (split + step) * dir) > prefix)
+				split += step;
+		} while (step > 1);
+
+		int gamma = i + split * dir + std::min(dir, 0);
+
+		int left = std::min(i, j) == gamma ? interior + gamma : gamma;
+		int right = std::max(i, j) == gamma + 1 ? interior + gamma + 1 : gamma + 1;
+
+		nodes[i].left = left;
+		nodes[i].right = right;
+		parents[left] = i;
+		parents[right] = i;
+	}
+
+	// Walk up from every leaf to find the bounds of the interior nodes. The second
+	// thread to reach a node knows that both of its children are done.
+	std::unique_ptr<std::atomic<int>[]> visits(new std::atomic<int>[interior > 0 ? interior : 1]);
+
+	for (int pass = 0; pass <= (treelets ? TREELET_PASSES : 0); pass++) {
+		for (int i = 0; i < interior; i++)
+			visits[i].store(0);
+
+		#pragma omp parallel for schedule(dynamic, 64) if(count >= LBVH_MIN_PARALLEL)
+		for (int i = 0; i < count; i++) {
+			int node = parents[(size_t)interior + i];
+
+			while (node >= 0 && visits[node].fetch_add(1) == 1) {
+				if (pass == 0) {
+					nodes[node].bounds = nodes[nodes[node].left].bounds;
+					nodes[node].bounds.extend(nodes[nodes[node].right].bounds);
+				}
+				else {
+					restructureTreelet(node, parents);
+				}
+
+				node = parents[node];
+			}
+		}
+	}
+
+	// Put the child closer to the low side of the axis the children are furthest
+	// apart along on the left, so rays can visit the nearer child first
+	#pragma omp parallel for if(count >= LBVH_MIN_PARALLEL)
+	for (int i = 0; i < interior; i++) {
+		Node& node = nodes[i];
+		BoundingBox& left = nodes[node.left].bounds;
+		BoundingBox& right = nodes[node.right].bounds;
+
+		glm::dvec3 offset = (right.min + right.max) - (left.min + left.max);
+		glm::dvec3 distance = glm::abs(offset);
+		node.axis = distance.x > distance.y ? (distance.x > distance.z ? 0 : 2) : (distance.y > distance.z ? 1 : 2);
+
+		if (offset[node.axis] < 0.0)
+			std::swap(node.left, node.right);
+	}
+}
+
+void Bvh::restructureTreelet(int root, std::vector<int>& parents)
+{
+	// Grow the treelet from the root by opening up its largest leaf until it has
+	// enough leaves, or only has leaves of the whole tree left
+	int leaves[TREELET_LEAVES];
+	int interiors[TREELET_LEAVES - 1];
+	int leafCount = 2, interiorCount = 1;
+
+	interiors[0] = root;
+	leaves[0] = nodes[root].left;
+	leaves[1] = nodes[root].right;
+
+	while (leafCount < TREELET_LEAVES) {
+		int largest = -1;
+		double largestArea = -1.0;
+
+		for (int i = 0; i < leafCount; i++) {
+			const Node& node = nodes[leaves[i]];
+			if (node.count == 0 && surfaceArea(node.bounds) > largestArea) {
+				largest = i;
+				largestArea = surfaceArea(node.bounds);
+			}
+		}
+
+		if (largest < 0)
+			break;
+
+		int node = leaves[largest];
+		interiors[interiorCount++] = node;
+		leaves[largest] = nodes[node].left;
+		leaves[leafCount++] = nodes[node].right;
+	}
+
+	// Two leaves can only be arranged one way
+	if (leafCount < 3)
+		return;
+
+	// Find the cheapest arrangement of every subset of the leaves. The cost of an
+	// arrangement is the total surface area of its interior nodes, which is what the
+	// chance of a ray having to visit them is proportional to.
+	const int SUBSETS = 1 << TREELET_LEAVES;
+	BoundingBox boxes[SUBSETS];
+	double costs[SUBSETS];
+	int splits[SUBSETS];
+
+	int all = (1 << leafCount) - 1;
+	for (int subset = 1; subset <= all; subset++) {
+		int lowest = subset & -subset;
+		int rest = subset ^ lowest;
+
+		int leaf = 0;
+		while ((1 << leaf) != lowest)
+			leaf++;
+
+		boxes[subset] = rest == 0 ? BoundingBox() : boxes[rest];
+		boxes[subset].extend(nodes[leaves[leaf]].bounds);
+
+		if (rest == 0) {
+			costs[subset] = 0.0;
+			continue;
+		}
+
+		// Each split is only tried once, with the lowest leaf on the left
+		costs[subset] = std::numeric_limits<double>::infinity();
+		for (int left = rest; ; left = (left - 1) & rest) {
+			int part = left | lowest;
+			if (part != subset) {
+				double cost = costs[part] + costs[subset ^ part];
+				if (cost < costs[subset]) {
+					costs[subset] = cost;
+					splits[subset] = part;
+				}
+			}
+
+			if (left == 0)
+				break;
+		}
+
+		costs[subset] += surfaceArea(boxes[subset]);
+	}
+
+	double current = 0.0;
+	for (int i = 0; i < interiorCount; i++)
+		current += surfaceArea(nodes[interiors[i]].bounds);
+
+	if (costs[all] >= current * (1.0 - 1e-9))
+		return;
+
+	// Rebuild the treelet from the cheapest splits, reusing its interior nodes
+	int pendingSubsets[TREELET_LEAVES - 1], pendingNodes[TREELET_LEAVES - 1];
+	int pending = 0, used = 1;
+
+	pendingSubsets[pending] = all;
+	pendingNodes[pending++] = root;
+
+	while (pending > 0) {
+		pending--;
+		int subset = pendingSubsets[pending];
+		int index = pendingNodes[pending];
+
+		int halves[2] = { splits[subset], subset ^ splits[subset] };
+		int children[2];
+
+		for (int i = 0; i < 2; i++) {
+			if ((halves[i] & (halves[i] - 1)) == 0) {
+				int leaf = 0;
+				while ((1 << leaf) != halves[i])
+					leaf++;
+
+				children[i] = leaves[leaf];
+			}
+			else {
+				children[i] = interiors[used++];
+				pendingSubsets[pending] = halves[i];
+				pendingNodes[pending++] = children[i];
+			}
+
+			parents[children[i]] = index;
+		}
+
+		nodes[index].left = children[0];
+		nodes[index].right = children[1];
+		nodes[index].bounds = boxes[subset];
+	}
+}
+
+FORCE_INLINE std::optional<Hit> Bvh::closestHit(glm::dvec3 origin, glm::dvec3 dir, double tMax, uint64_t& tests, uint64_t* steps) const
+{
+	std::optional<Hit> closest;
+
+	if (nodes.empty())
+		return closest;
+
+	glm::dvec3 invDir = 1.0 / dir;
+
+	int stack[BVH_STACK_SIZE];
+	int size = 0;
+	int index = 0;
+
+	while (true) {
+		const Node& node = nodes[index];
+
+		if (steps != nullptr)
+			(*steps)++;
+
+		if (hitsBox(node.bounds, origin, invDir, tMax)) {
+			if (node.count > 0) {
+				tests += node.count;
+
+				for (int i = node.first; i < node.first + node.count; i++) {
+					auto opt = hitObject(*objects[i], origin, dir);
+
+					if (opt.has_value() && opt->t < tMax) {
+						tMax = opt->t;
+						closest = opt;
+					}
+				}
+			}
+			else {
+				// Visit the child on the side the ray comes from first, so that the
+				// far child can be skipped once something closer is found
+				if (dir[node.axis] < 0.0) {
+					stack[size++] = node.left;
+					index = node.right;
+				}
+				else {
+					stack[size++] = node.right;
+					index = node.left;
+				}
+
+				continue;
+			}
+		}
+
+		if (size == 0)
+			break;
+
+		index = stack[--size];
+	}
+
+	return closest;
+}
+
+FORCE_INLINE Object* Bvh::anyOccluder(glm::dvec3 origin, glm::dvec3 dir, double maxT, const Object* skip, uint64_t& tests) const
+{
+	if (nodes.empty())
+		return nullptr;
+
+	glm::dvec3 invDir = 1.0 / dir;
+
+	int stack[BVH_STACK_SIZE];
+	int size = 0;
+	int index = 0;
+
+	while (true) {
+		const Node& node = nodes[index];
+
+		if (hitsBox(node.bounds, origin, invDir, maxT)) {
+			if (node.count > 0) {
+				for (int i = node.first; i < node.first + node.count; i++) {
+					if (objects[i] == skip)
+						continue;
+
+					tests++;
+					auto opt = hitObject(*objects[i], origin, dir);
+
+					if (opt.has_value() && opt->t < maxT)
+						return objects[i];
+				}
+			}
+			else {
+				stack[size++] = node.right;
+				index = node.left;
+				continue;
+			}
+		}
+
+		if (size == 0)
+			break;
+
+		index = stack[--size];
+	}
+
+	return nullptr;
+}
+
+std::optional<Hit> Bvh::intersectBaseline(const Bvh& bvh, glm::dvec3 origin, glm::dvec3 dir, double tMax, uint64_t& tests, uint64_t* steps)
+{
+	return bvh.closestHit(origin, dir, tMax, tests, steps);
+}
+
+ISA_TARGET("avx2")
+std::optional<Hit> Bvh::intersectAvx2(const Bvh& bvh, glm::dvec3 origin, glm::dvec3 dir, double tMax, uint64_t& tests, uint64_t* steps)
+{
+	return bvh.closestHit(origin, dir, tMax, tests, steps);
+}
+
+Object* Bvh::occludedBaseline(const Bvh& bvh, glm::dvec3 origin, glm::dvec3 dir, double maxT, const Object* skip, uint64_t& tests)
+{
+	return bvh.anyOccluder(origin, dir, maxT, skip, tests);
+}
+
+ISA_TARGET("avx2")
+Object* Bvh::occludedAvx2(const Bvh& bvh, glm::dvec3 origin, glm::dvec3 dir, double maxT, const Object* skip, uint64_t& tests)
+{
+	return bvh.anyOccluder(origin, dir, maxT, skip, tests);
+}
+
+double Bvh::overlap() const
+{
+	if (nodes.empty())
+		return 0.0;
+
+	double overlap = 0.0;
+	for (const Node& node : nodes) {
+		if (node.count == 0) {
+			BoundingBox shared = overlapOf(nodes[node.left].bounds, nodes[node.right].bounds);
+			if (!isEmpty(shared))
+				overlap += surfaceArea(shared);
+		}
+	}
+
+	double rootArea = surfaceArea(nodes[0].bounds);
+	return rootArea > 0.0 ? overlap / rootArea : 0.0;
+}
+
+std::optional<BvhBuilder> parseBvhBuilder(const std::string& name)
+{
+	if (name == "sah")			return BvhBuilder::SAH;
+	if (name == "lbvh")			return BvhBuilder::LBVH;
+	if (name == "treelets")		return BvhBuilder::TREELETS;
+	if (name == "sbvh")			return BvhBuilder::SBVH;
+
+	return std::nullopt;
+}
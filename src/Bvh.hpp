@@ -0,0 +1,311 @@
+#ifndef BVH_HPP
+#define BVH_HPP
+
+#include <vector>
+#include <optional>
+#include <string>
+#include <limits>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+#include "Objects.hpp"
+#include "Structures.hpp"
+
+/**
+ * The ways a bounding volume hierarchy can be built
+ */
+enum class BvhBuilder
+{
+	/// Top down on a single thread, splitting each node where the surface area
+	/// heuristic estimates the cheapest traversal. Gives the fastest tracing.
+	SAH,
+
+	/// A linear BVH, built on every thread by sorting the objects along a Morton curve.
+	/// Builds much faster than SAH, but traces slower.
+	LBVH,
+
+	/// A linear BVH whose small subtrees are then rearranged to lower their surface
+	/// area. Between the other two in both build and trace speed.
+	TREELETS,
+
+	/// Like SAH, but an object can also be cut at a plane and put in both children,
+	/// so that long thin triangles no longer make siblings overlap. Builds slower
+	/// than SAH and references some objects more than once.
+	SBVH,
+};
+
+/// By default, spatial splits may add this many references to objects for every object
+const double BVH_DEFAULT_SPLIT_BUDGET = 0.3;
+
+/**
+ * A bounding volume hierarchy over the bounded objects of a frame.
+ *
+ * Every node stores the bounds of the objects below it, so a ray only has to be
+ * tested against the objects in the nodes whose bounds it passes through.
+ */
+class Bvh
+{
+public:
+	/**
+	 * Creates an empty hierarchy that no ray intersects
+	 */
+	Bvh() = default;
+
+	/**
+	 * Builds the hierarchy over the passed objects
+	 *
+	 * @param objects		The objects to build over. Their bounds must be finite
+	 * @param builder		How to build the hierarchy
+	 * @param splitBudget	For SBVH, the most references to objects spatial splits may
+	 *						add, as a fraction of the number of objects
+	 */
+	Bvh(const std::vector<Object*>& objects, BvhBuilder builder = BvhBuilder::SAH, double splitBudget = BVH_DEFAULT_SPLIT_BUDGET);
+
+	/**
+	 * Finds the closest hit of a ray on the objects. Only the hit is found, so the
+	 * caller computes the intersection for the one it keeps.
+	 *
+	 * @param origin	The origin of the ray
+	 * @param dir		The direction of the ray
+	 * @param tMax		Hits at or beyond this distance along the ray are ignored
+	 * @param tests		Incremented for every object the ray is tested against
+	 * @param steps		If not NULL, incremented for every node the ray is tested against
+	 * @return			The closest hit, or std::nullopt if there is none before tMax
+	 */
+	std::optional<Hit> intersect(glm::dvec3 origin, glm::dvec3 dir, double tMax, uint64_t& tests, uint64_t* steps = nullptr) const
+	{
+		return intersectKernel(*this, origin, dir, tMax, tests, steps);
+	}
+
+	/**
+	 * Finds any object that blocks a ray
+	 *
+	 * @param origin	The origin of the ray
+	 * @param dir		The direction of the ray
+	 * @param maxT		Objects at or beyond this distance along the ray do not block it
+	 * @param skip		An object that has already been tested, or NULL
+	 * @param tests		Incremented for every object the ray is tested against
+	 * @return			The object blocking the ray, or NULL if there is none
+	 */
+	Object* occluded(glm::dvec3 origin, glm::dvec3 dir, double maxT, const Object* skip, uint64_t& tests) const
+	{
+		return occludedKernel(*this, origin, dir, maxT, skip, tests);
+	}
+
+	/**
+	 * Checks whether the hierarchy has no objects
+	 */
+	bool empty() const { return nodes.empty(); }
+
+	/**
+	 * Gets the number of nodes in the hierarchy
+	 */
+	size_t nodeCount() const { return nodes.size(); }
+
+	/**
+	 * Gets the number of bytes taken by the nodes and the list of objects
+	 */
+	size_t memoryUsage() const { return nodes.size() * sizeof(Node) + objects.size() * sizeof(Object*); }
+
+	/**
+	 * Gets the number of references to objects in the leaves, which is more than
+	 * the number of objects if spatial splits cut some of them
+	 */
+	size_t referenceCount() const { return objects.size(); }
+
+	/**
+	 * Measures how much the children of the nodes overlap: the summed surface area
+	 * of the overlap of every pair of siblings, relative to the surface area of the
+	 * root. Rays through an overlap have to visit both siblings.
+	 *
+	 * @return	The overlap, or 0 for an empty hierarchy
+	 */
+	double overlap() const;
+
+protected:
+	friend class WideBvh;
+
+	/**
+	 * A node of the tree. Leaves hold a range of the objects.
+	 */
+	struct Node
+	{
+		/// The bounds of the objects below this node
+		BoundingBox	bounds;
+
+		/// The indices of the children, with the left child on the low side of the
+		/// axis. Leaves have no children and store -1.
+		int			left = -1, right = -1;
+
+		/// The axis the children are split along, which decides the child visited first
+		int			axis = 0;
+
+		/// For leaves, the first object of the leaf in the list of objects
+		int			first = 0;
+
+		/// For leaves, the number of objects in the leaf
+		int			count = 0;
+	};
+
+	/**
+	 * An object while the tree is being built
+	 */
+	struct BuildObject
+	{
+		/// The bounds of the object
+		BoundingBox	bounds;
+
+		/// The center of the bounds
+		glm::dvec3	center;
+
+		/// The object
+		Object*		object;
+	};
+
+	/**
+	 * The cheapest way found to split a node in two
+	 */
+	struct Split
+	{
+		/// The summed surface area times number of objects of the two sides, which
+		/// is the surface area heuristic's cost before dividing by the node's area
+		double		cost = std::numeric_limits<double>::infinity();
+
+		/// The axis the node is split along, or -1 if no split was found
+		int			axis = -1;
+
+		/// For object splits, the first bin of centers that goes to the right side
+		int			bin = 0;
+
+		/// For spatial splits, the plane the objects are cut at
+		double		position = 0.0;
+
+		/// The bounds of the two sides
+		BoundingBox	left, right;
+
+		/// The number of objects on each side. For spatial splits, the objects that
+		/// are cut count on both sides.
+		int			leftCount = 0, rightCount = 0;
+	};
+
+	/**
+	 * Finds the cheapest split of objects into two groups by their centers
+	 *
+	 * @param build		The objects
+	 * @param count		The number of objects
+	 * @param centers	The bounds of the objects' centers
+	 * @return			The split, with an axis of -1 if the centers cannot be binned
+	 */
+	static Split findObjectSplit(const BuildObject* build, int count, const BoundingBox& centers);
+
+	/**
+	 * Finds the cheapest split of a node by a plane, where the objects crossing the
+	 * plane are cut in two and go to both sides
+	 *
+	 * @param refs		The references to objects in the node
+	 * @param bounds	The bounds of the node
+	 * @return			The split, with an axis of -1 if none was found
+	 */
+	static Split findSpatialSplit(const std::vector<BuildObject>& refs, const BoundingBox& bounds);
+
+	/**
+	 * Cuts a reference to an object down to the part between two planes. Triangles
+	 * are clipped exactly, other objects only have their bounds cut.
+	 *
+	 * @param ref	The reference
+	 * @param axis	The axis the planes are along
+	 * @param lo	The position of the lower plane
+	 * @param hi	The position of the upper plane
+	 * @return		The bounds of the part, which are empty if nothing is left of it
+	 */
+	static BoundingBox clip(const BuildObject& ref, int axis, double lo, double hi);
+
+	/**
+	 * Builds the subtree over part of the objects
+	 *
+	 * @param build		The objects, reordered while building
+	 * @param begin		The first object that belongs to the subtree
+	 * @param end		One past the last object that belongs to the subtree
+	 * @param depth		The depth of the subtree's root in the tree
+	 * @return			The index of the subtree's root node
+	 */
+	int build(std::vector<BuildObject>& build, int begin, int end, int depth);
+
+	/**
+	 * Builds the subtree over some references to objects, splitting the references
+	 * at planes where that is cheaper than splitting the objects into groups
+	 *
+	 * @param refs		The references, which are used up while building
+	 * @param depth		The depth of the subtree's root in the tree
+	 * @param rootArea	The surface area of the root of the tree
+	 * @param budget	The number of references that may still be added by splitting
+	 * @return			The index of the subtree's root node
+	 */
+	int buildSpatial(std::vector<BuildObject>& refs, int depth, double rootArea, int& budget);
+
+	/**
+	 * Builds a linear BVH over the objects: they are sorted along a Morton curve
+	 * through their centers, and every node of the tree is then found from the
+	 * sorted codes on its own, so all of it can be done in parallel.
+	 *
+	 * @param objects	The objects to build over
+	 * @param treelets	Whether to rearrange the small subtrees of the tree afterwards
+	 */
+	void buildLinear(const std::vector<Object*>& objects, bool treelets);
+
+	/**
+	 * Finds the arrangement of the few nodes below a node that has the lowest total
+	 * surface area, and rearranges them into it
+	 *
+	 * @param root		The node to rearrange the subtree of
+	 * @param parents	The parent of every node, updated for the moved nodes
+	 */
+	void restructureTreelet(int root, std::vector<int>& parents);
+
+	/**
+	 * Finds the closest hit of a ray on the objects, as intersect() does. Inlined
+	 * into a version for each instruction set the traversal is compiled for.
+	 */
+	std::optional<Hit> closestHit(glm::dvec3 origin, glm::dvec3 dir, double tMax, uint64_t& tests, uint64_t* steps) const;
+
+	/**
+	 * Finds any object that blocks a ray, as occluded() does. Inlined into a version
+	 * for each instruction set the traversal is compiled for.
+	 */
+	Object* anyOccluder(glm::dvec3 origin, glm::dvec3 dir, double maxT, const Object* skip, uint64_t& tests) const;
+
+	/**
+	 * The traversals, compiled once for the instruction set the program needs and
+	 * once for AVX2, which all give the same results. Only the instructions the
+	 * compiler picks change, since AVX2 does not bring fused multiply-adds along.
+	 */
+	typedef std::optional<Hit> (*IntersectKernel)(const Bvh& bvh, glm::dvec3 origin, glm::dvec3 dir, double tMax, uint64_t& tests, uint64_t* steps);
+	typedef Object* (*OccludedKernel)(const Bvh& bvh, glm::dvec3 origin, glm::dvec3 dir, double maxT, const Object* skip, uint64_t& tests);
+
+	static std::optional<Hit> intersectBaseline(const Bvh& bvh, glm::dvec3 origin, glm::dvec3 dir, double tMax, uint64_t& tests, uint64_t* steps);
+	static std::optional<Hit> intersectAvx2(const Bvh& bvh, glm::dvec3 origin, glm::dvec3 dir, double tMax, uint64_t& tests, uint64_t* steps);
+	static Object* occludedBaseline(const Bvh& bvh, glm::dvec3 origin, glm::dvec3 dir, double maxT, const Object* skip, uint64_t& tests);
+	static Object* occludedAvx2(const Bvh& bvh, glm::dvec3 origin, glm::dvec3 dir, double maxT, const Object* skip, uint64_t& tests);
+
+	/// The versions of the traversals for the instruction set picked when the
+	/// hierarchy was built
+	IntersectKernel			intersectKernel = intersectBaseline;
+	OccludedKernel			occludedKernel = occludedBaseline;
+
+	/// The nodes of the tree, with the root first
+	std::vector<Node>		nodes;
+
+	/// The objects, ordered so that each leaf's objects are next to each other
+	std::vector<Object*>	objects;
+};
+
+/**
+ * Converts the name of a way to build a bounding volume hierarchy
+ *
+ * @param name	The lowercase name of the builder
+ * @return		The builder, or std::nullopt if the name is unknown
+ */
+std::optional<BvhBuilder> parseBvhBuilder(const std::string& name);
+
+#endif//BVH_HPP
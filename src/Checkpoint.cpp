@@ -0,0 +1,313 @@
+#include "Checkpoint.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <algorithm>
+#include <cstring>
+
+#include <glm/glm.hpp>
+
+#include <SDL2/SDL_image.h>
+
+#include "Sampler.hpp"
+#include "Timeline.hpp"
+
+/// The name of the manifest file written to the output folder
+const char* MANIFEST_NAME = "manifest.txt";
+
+/// The start of the manifest lines that record a completed frame
+const char* FRAME_ENTRY = "frame ";
+
+uint64_t hashStream(std::istream& stream)
+{
+	uint64_t hash = 0xcbf29ce484222325ull;
+
+	char buffer[4096];
+	while (stream.read(buffer, sizeof(buffer)) || stream.gcount() > 0) {
+		for (std::streamsize i = 0; i < stream.gcount(); i++) {
+			hash ^= (unsigned char)buffer[i];
+			hash *= 0x100000001b3ull;
+		}
+	}
+
+	// Rewind the stream so the parser sees the whole file
+	stream.clear();
+	stream.seekg(0);
+
+	return hash;
+}
+
+std::string framePath(const Configuration& config, int frameNumber)
+{
+	std::string path = config.outputName + "frame_" + std::to_string(frameNumber);
+
+	if (config.outputFormat == OutputFormat::JPEG)
+		path += ".jpg";
+	else
+		path += ".png";
+
+	return path;
+}
+
+/**
+ * Builds the contents of the manifest for a render. Anything that changes the
+ * rendered pixels or the numbering of the frames needs to be part of this.
+ *
+ * @param config	The configuration settings for the renderer
+ * @param animation	The animation being rendered
+ * @return			The text of the manifest
+ */
+static std::string manifestContents(const Configuration& config, const Animation& animation)
+{
+	std::ostringstream out;
+
+	out << "scene "		 << std::hex << config.sceneHash << std::dec << "\n"
+		<< "resolution " << animation.width << " " << animation.height << "\n"
+		<< "samples "	 << animation.samples << " " << samplePatternName(animation.pattern) << "\n"
+		<< "maxdepth "	 << animation.maxDepth << "\n"
+		<< "fps "		 << animation.fps << "\n"
+		<< "loop "		 << animation.loop << "\n"
+		<< "seed "		 << config.seed << "\n"
+		<< "lightsamples " << config.lightSamples << "\n"
+		<< "watertight " << config.watertight << "\n"
+		<< "format "	 << (config.outputFormat == OutputFormat::JPEG ? "jpg" : "png") << "\n";
+
+	return out.str();
+}
+
+bool updateManifest(const Configuration& config, const Animation& animation)
+{
+	std::string path = config.outputName + MANIFEST_NAME;
+	std::string contents = manifestContents(config, animation);
+
+	// The settings are followed by a line for every frame that was completed with them
+	std::ifstream in(path, std::ios::binary);
+	if (in) {
+		std::ostringstream existing;
+		std::string line;
+		while (std::getline(in, line)) {
+			if (line.compare(0, std::strlen(FRAME_ENTRY), FRAME_ENTRY) != 0)
+				existing << line << "\n";
+		}
+
+		if (existing.str() == contents)
+			return true;
+	}
+	in.close();
+
+	// The scene or the settings changed. Rewriting the manifest drops the list of
+	// completed frames, which marks all of the frames in the folder as stale. The
+	// new manifest replaces the old one in a single rename, so jobs rendering other
+	// frames into the same folder never see it half written. Each job writes its
+	// own temporary file, named after the first frame it renders.
+	std::string partPath = path + "." + std::to_string(config.frames.start) + ".part";
+	{
+		std::ofstream out(partPath, std::ios::binary | std::ios::trunc);
+		out << contents;
+
+		if (!out) {
+			std::cerr << "Could not write the manifest" << std::endl;
+			return false;
+		}
+	}
+
+	std::error_code error;
+	std::filesystem::rename(partPath, path, error);
+	if (error)
+		std::cerr << "Could not write the manifest: " << error.message() << std::endl;
+
+	return false;
+}
+
+/**
+ * Checks whether the manifest lists a frame as completed
+ *
+ * @param config		The configuration settings for the renderer
+ * @param frameNumber	The number of the frame
+ * @return				True if the frame was completed with the manifest's settings
+ */
+static bool frameRecorded(const Configuration& config, int frameNumber)
+{
+	std::ifstream in(config.outputName + MANIFEST_NAME, std::ios::binary);
+	std::string entry = FRAME_ENTRY + std::to_string(frameNumber);
+
+	std::string line;
+	while (std::getline(in, line)) {
+		if (line == entry)
+			return true;
+	}
+
+	return false;
+}
+
+/**
+ * Records in the manifest that a frame was completed with its settings
+ *
+ * @param config		The configuration settings for the renderer
+ * @param frameNumber	The number of the frame
+ */
+static void recordFrame(const Configuration& config, int frameNumber)
+{
+	// Frames rendered again without resuming are already listed
+	if (frameRecorded(config, frameNumber))
+		return;
+
+	std::ofstream out(config.outputName + MANIFEST_NAME, std::ios::binary | std::ios::app);
+	out << FRAME_ENTRY << frameNumber << "\n";
+}
+
+bool frameComplete(const Configuration& config, const Animation& animation, int frameNumber)
+{
+	namespace fs = std::filesystem;
+
+	std::error_code error;
+	fs::path frame = framePath(config, frameNumber);
+
+	if (!fs::exists(frame, error) || fs::file_size(frame, error) == 0)
+		return false;
+
+	// Frames that are not listed were rendered with other settings, or by a run
+	// that stopped before it finished them
+	if (!frameRecorded(config, frameNumber))
+		return false;
+
+	// Make sure the image can actually be read back and has the right size
+	SDL_Surface* image = IMG_Load(frame.string().c_str());
+	if (image == nullptr)
+		return false;
+
+	bool valid = image->w == animation.width && image->h == animation.height;
+	SDL_FreeSurface(image);
+
+	return valid;
+}
+
+void saveFrame(SDL_Surface* surface, const Configuration& config, int frameNumber)
+{
+	TimelineScope scope("saveFrame", "frame", frameNumber);
+
+	std::string path = framePath(config, frameNumber);
+	std::string partPath = path + ".part";
+
+	int result = -1;
+	if (config.outputFormat == OutputFormat::PNG) {
+		result = IMG_SavePNG(surface, partPath.c_str());
+	}
+	if (config.outputFormat == OutputFormat::JPEG) {
+		result = IMG_SaveJPG(surface, partPath.c_str(), 70);
+	}
+
+	if (result != 0) {
+		std::cerr << "Could not write frame " << frameNumber << ": " << IMG_GetError() << std::endl;
+		return;
+	}
+
+	std::error_code error;
+	std::filesystem::rename(partPath, path, error);
+	if (error) {
+		std::cerr << "Could not write frame " << frameNumber << ": " << error.message() << std::endl;
+		return;
+	}
+
+	recordFrame(config, frameNumber);
+}
+
+void linkFrame(const Configuration& config, int sourceFrame, int frameNumber)
+{
+	TimelineScope scope("linkFrame", "frame", frameNumber);
+
+	namespace fs = std::filesystem;
+
+	fs::path source = framePath(config, sourceFrame);
+	fs::path path = framePath(config, frameNumber);
+	fs::path partPath = path.string() + ".part";
+
+	std::error_code error;
+	fs::remove(partPath, error);
+
+	fs::create_hard_link(source, partPath, error);
+	if (error) {
+		error.clear();
+		fs::copy_file(source, partPath, fs::copy_options::overwrite_existing, error);
+	}
+
+	if (!error)
+		fs::rename(partPath, path, error);
+
+	if (error) {
+		std::cerr << "Could not write frame " << frameNumber << ": " << error.message() << std::endl;
+		return;
+	}
+
+	recordFrame(config, frameNumber);
+}
+
+/**
+ * Maps a value to a color on a ramp running from black through blue, cyan,
+ * green, yellow and red to white
+ *
+ * @param value	The value to map, between 0 and 1
+ * @return		The color, with each channel between 0 and 1
+ */
+static glm::dvec3 falseColor(double value)
+{
+	static const glm::dvec3 ramp[] = {
+		{ 0.0, 0.0, 0.0 }, { 0.0, 0.0, 1.0 }, { 0.0, 1.0, 1.0 }, { 0.0, 1.0, 0.0 },
+		{ 1.0, 1.0, 0.0 }, { 1.0, 0.0, 0.0 }, { 1.0, 1.0, 1.0 },
+	};
+	const int stops = sizeof(ramp) / sizeof(ramp[0]);
+
+	double position = glm::clamp(value, 0.0, 1.0) * (stops - 1);
+	int index = std::min((int)position, stops - 2);
+
+	return glm::mix(ramp[index], ramp[index + 1], position - index);
+}
+
+void saveCostMap(const std::vector<float>& cost, int width, int height, const Configuration& config, int frameNumber)
+{
+	std::string path = config.outputName + "frame_" + std::to_string(frameNumber) + "_cost";
+	size_t pixels = (size_t)width * height;
+
+	if (cost.size() != pixels * 3)
+		return;
+
+	std::ofstream raw(path + ".raw", std::ios::binary);
+	raw.write((const char*)cost.data(), cost.size() * sizeof(float));
+	if (!raw) {
+		std::cerr << "Could not write the cost of frame " << frameNumber << std::endl;
+		return;
+	}
+
+	// Scale to the 99th percentile of the traced pixels, so a few pixels that were
+	// interrupted while being traced do not wash out the rest of the image
+	std::vector<float> cycles;
+	cycles.reserve(pixels);
+	for (size_t i = 0; i < pixels; i++) {
+		if (cost[i * 3] > 0.0f)
+			cycles.push_back(cost[i * 3]);
+	}
+
+	double scale = 1.0;
+	if (!cycles.empty()) {
+		auto high = cycles.begin() + (cycles.size() - 1) * 99 / 100;
+		std::nth_element(cycles.begin(), high, cycles.end());
+		scale = std::max((double)*high, 1.0);
+	}
+
+	SDL_Surface* image = SDL_CreateRGBSurface(0, width, height, 32, 0x000000FF, 0x00000FF00, 0x00FF0000, 0xFF000000);
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++) {
+			glm::dvec3 color = falseColor(cost[((size_t)y * width + x) * 3] / scale);
+
+			*(uint32_t*)((uint8_t*)image->pixels + (size_t)y * image->pitch + (size_t)x * 4) =
+				SDL_MapRGB(image->format, (uint8_t)(color.r * 255.0), (uint8_t)(color.g * 255.0), (uint8_t)(color.b * 255.0));
+		}
+	}
+
+	if (IMG_SavePNG(image, (path + ".png").c_str()) != 0)
+		std::cerr << "Could not write the cost of frame " << frameNumber << ": " << IMG_GetError() << std::endl;
+
+	SDL_FreeSurface(image);
+}
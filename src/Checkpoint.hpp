@@ -0,0 +1,91 @@
+#ifndef CHECKPOINT_HPP
+#define CHECKPOINT_HPP
+
+#include <istream>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include <SDL2/SDL.h>
+
+#include "Renderer.hpp"
+#include "Scene.hpp"
+
+/**
+ * Computes a 64 bit FNV-1a hash over the contents of a stream. The stream is
+ * rewound afterwards so that it can still be parsed.
+ *
+ * @param stream	The stream to hash
+ * @return			The hash of the stream's contents
+ */
+uint64_t hashStream(std::istream& stream);
+
+/**
+ * Gets the path in the output folder that a frame is written to
+ *
+ * @param config		The configuration settings for the renderer
+ * @param frameNumber	The number of the frame
+ * @return				The path of the frame's image
+ */
+std::string framePath(const Configuration& config, int frameNumber);
+
+/**
+ * Makes sure the manifest in the output folder describes the scene and settings
+ * that are about to be rendered. The manifest is only rewritten if it changed,
+ * so frames written by earlier runs of the same render stay valid.
+ *
+ * @param config	The configuration settings for the renderer
+ * @param animation	The animation being rendered
+ * @return			True if the existing manifest already matched
+ */
+bool updateManifest(const Configuration& config, const Animation& animation);
+
+/**
+ * Checks whether a frame in the output folder was completed by an earlier run
+ * of the same render and can still be loaded.
+ *
+ * @param config		The configuration settings for the renderer
+ * @param animation		The animation being rendered
+ * @param frameNumber	The number of the frame to check
+ * @return				True if the frame does not need to be rendered again
+ */
+bool frameComplete(const Configuration& config, const Animation& animation, int frameNumber);
+
+/**
+ * Writes a rendered frame to the output folder. The image is written to a
+ * temporary file first and then renamed, so a render that is interrupted never
+ * leaves a partially written frame behind.
+ *
+ * @param surface		The surface containing the rendered frame
+ * @param config		The configuration settings for the renderer
+ * @param frameNumber	The number of the frame
+ */
+void saveFrame(SDL_Surface* surface, const Configuration& config, int frameNumber);
+
+/**
+ * Writes a frame that is identical to an earlier frame by hard linking to the
+ * earlier frame's image. If the file system does not support hard links, the
+ * image is copied instead.
+ *
+ * @param config		The configuration settings for the renderer
+ * @param sourceFrame	The number of the earlier frame
+ * @param frameNumber	The number of the frame to write
+ */
+void linkFrame(const Configuration& config, int sourceFrame, int frameNumber);
+
+/**
+ * Writes the cost of tracing each pixel of a frame next to the frame's image.
+ * frame_<n>_cost.png shows the cycles spent on each pixel in false color, from
+ * black and blue for cheap pixels up to red and white for the most expensive.
+ * frame_<n>_cost.raw holds the cycles, rays and intersection tests of each
+ * pixel as three 32 bit floats, starting with the top row.
+ *
+ * @param cost			The cost of each pixel, as gathered by renderFrame
+ * @param width			The width of the frame
+ * @param height		The height of the frame
+ * @param config		The configuration settings for the renderer
+ * @param frameNumber	The number of the frame
+ */
+void saveCostMap(const std::vector<float>& cost, int width, int height, const Configuration& config, int frameNumber);
+
+#endif//CHECKPOINT_HPP
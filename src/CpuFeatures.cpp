@@ -0,0 +1,143 @@
+#include "CpuFeatures.hpp"
+
+#include <iostream>
+#include <cstdint>
+
+#ifdef CPU_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#include <immintrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+/// The instruction set kernels run with, until selectIsa() picks one
+static IsaLevel active = detectIsa();
+
+#ifdef CPU_X86
+/**
+ * Runs the cpuid instruction
+ *
+ * @param leaf		The leaf to read
+ * @param subleaf	The subleaf to read
+ * @param regs		Set to eax, ebx, ecx and edx
+ */
+static void cpuid(uint32_t leaf, uint32_t subleaf, uint32_t regs[4])
+{
+#ifdef _MSC_VER
+	int values[4];
+	__cpuidex(values, (int)leaf, (int)subleaf);
+	for (int i = 0; i < 4; i++)
+		regs[i] = (uint32_t)values[i];
+#else
+	if (!__get_cpuid_count(leaf, subleaf, &regs[0], &regs[1], &regs[2], &regs[3]))
+		regs[0] = regs[1] = regs[2] = regs[3] = 0;
+#endif
+}
+
+/**
+ * Reads which register states the operating system saves on a context switch.
+ * Only valid if cpuid reports OSXSAVE.
+ *
+ * @return	The first extended control register
+ */
+static uint64_t readXcr0()
+{
+#ifdef _MSC_VER
+	return _xgetbv(0);
+#else
+	uint32_t lo, hi;
+	__asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+	return (uint64_t)hi << 32 | lo;
+#endif
+}
+#endif
+
+IsaLevel detectIsa()
+{
+#ifdef CPU_X86
+	uint32_t regs[4];
+	cpuid(0, 0, regs);
+	uint32_t maxLeaf = regs[0];
+
+	cpuid(1, 0, regs);
+	bool sse42 = (regs[2] >> 20) & 1;
+	bool osxsave = (regs[2] >> 27) & 1;
+	bool avx = (regs[2] >> 28) & 1;
+
+	if (!sse42)
+		return IsaLevel::SCALAR;
+
+	// The wider registers can only be used if the operating system saves them
+	uint64_t xcr0 = osxsave ? readXcr0() : 0;
+	if (!avx || (xcr0 & 0x6) != 0x6 || maxLeaf < 7)
+		return IsaLevel::SSE42;
+
+	cpuid(7, 0, regs);
+	bool avx2 = (regs[1] >> 5) & 1;
+	bool avx512f = (regs[1] >> 16) & 1;
+	bool avx512vl = (regs[1] >> 31) & 1;
+
+	if (!avx2)
+		return IsaLevel::SSE42;
+
+	if (avx512f && avx512vl && (xcr0 & 0xe0) == 0xe0)
+		return IsaLevel::AVX512;
+
+	return IsaLevel::AVX2;
+#else
+	return IsaLevel::SCALAR;
+#endif
+}
+
+IsaLevel activeIsa()
+{
+	return active;
+}
+
+void selectIsa(std::optional<IsaLevel> requested)
+{
+	IsaLevel supported = detectIsa();
+	active = supported;
+
+	if (requested.has_value()) {
+		if (requested.value() > supported)
+			std::cerr << "This CPU does not support " << isaName(requested.value()) << ", using " << isaName(supported) << " instead" << std::endl;
+		else
+			active = requested.value();
+	}
+
+	std::cout << "Using " << isaName(active) << " kernels";
+	if (active != supported)
+		std::cout << " (the CPU supports " << isaName(supported) << ")";
+	std::cout << std::endl;
+}
+
+std::optional<IsaLevel> parseIsa(const std::string& name)
+{
+	if (name == "scalar")
+		return IsaLevel::SCALAR;
+	if (name == "sse4.2" || name == "sse42")
+		return IsaLevel::SSE42;
+	if (name == "avx2")
+		return IsaLevel::AVX2;
+	if (name == "avx512" || name == "avx-512")
+		return IsaLevel::AVX512;
+
+	return std::nullopt;
+}
+
+const char* isaName(IsaLevel isa)
+{
+	switch (isa) {
+	case IsaLevel::SSE42:
+		return "SSE4.2";
+	case IsaLevel::AVX2:
+		return "AVX2";
+	case IsaLevel::AVX512:
+		return "AVX-512";
+	default:
+		return "scalar";
+	}
+}
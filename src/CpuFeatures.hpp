@@ -0,0 +1,77 @@
+#ifndef CPUFEATURES_HPP
+#define CPUFEATURES_HPP
+
+#include <optional>
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define CPU_X86
+#endif
+
+// Lets a single function use the instructions of a later instruction set than the
+// rest of the program is compiled for. MSVC allows the intrinsics of any instruction
+// set in any function, so it needs nothing.
+#if defined(CPU_X86) && (defined(__GNUC__) || defined(__clang__))
+#define ISA_TARGET(isa) __attribute__((target(isa)))
+#else
+#define ISA_TARGET(isa)
+#endif
+
+/**
+ * The instruction sets that kernels are compiled for, from the oldest to the newest.
+ * Each one includes the ones before it.
+ */
+enum class IsaLevel
+{
+	/// Plain C++, which runs anywhere
+	SCALAR,
+
+	/// SSE up to 4.2
+	SSE42,
+
+	/// AVX and AVX2
+	AVX2,
+
+	/// AVX-512 foundation with the vector length extensions
+	AVX512,
+};
+
+/**
+ * Finds the newest instruction set the CPU and the operating system support
+ *
+ * @return	The instruction set
+ */
+IsaLevel detectIsa();
+
+/**
+ * Gets the instruction set kernels are currently run with
+ *
+ * @return	The instruction set
+ */
+IsaLevel activeIsa();
+
+/**
+ * Picks the instruction set to run kernels with and prints it. Asking for one the
+ * CPU does not support prints a warning and uses the newest one it does.
+ *
+ * @param requested	The instruction set to use, or std::nullopt for the newest supported one
+ */
+void selectIsa(std::optional<IsaLevel> requested);
+
+/**
+ * Parses the name of an instruction set, as given on the command line
+ *
+ * @param name	One of scalar, sse4.2, avx2 or avx512
+ * @return		The instruction set, or std::nullopt if the name is not known
+ */
+std::optional<IsaLevel> parseIsa(const std::string& name);
+
+/**
+ * Gets the name of an instruction set to show to the user
+ *
+ * @param isa	The instruction set
+ * @return		The name
+ */
+const char* isaName(IsaLevel isa);
+
+#endif//CPUFEATURES_HPP
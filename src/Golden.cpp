@@ -0,0 +1,519 @@
+#include "Golden.hpp"
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <map>
+#include <optional>
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <cctype>
+#include <cstring>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include <glm/glm.hpp>
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_image.h>
+
+#include "Benchmark.hpp"
+#include "Renderer.hpp"
+
+/**
+ * The settings for a golden image check
+ */
+struct GoldenOptions
+{
+	/// The folder holding the reference images
+	std::string					folder;
+
+	/// The scenes to render, as scene files or generated scenes of the form <type>:<count>
+	std::vector<std::string>	scenes;
+
+	/// Write new reference images instead of comparing against the existing ones
+	bool						update = false;
+
+	/// The resolution every scene is rendered at
+	int							width = 160, height = 120;
+
+	/// Samples per pixel for every scene, or 0 to use the scene's own
+	int							samples = 0;
+
+	/// The number of threads to render with, or 0 to use one per core
+	int							threads = 0;
+
+	/// How the bounding volume hierarchy of each scene is built, if not by the scene's settings
+	std::optional<BvhBuilder>	bvhBuilder;
+
+	/// Whether the hierarchy is collapsed into one with eight children per node
+	bool						wideBvh = false;
+
+	/// Whether spheres are put in a uniform grid instead of the hierarchy
+	bool						sphereGrid = false;
+
+	/// The instruction set to run the vectorized kernels with, if not the newest supported
+	std::optional<IsaLevel>		isa;
+
+	/// The largest difference allowed in any channel of any pixel, out of 255
+	int							maxError = 2;
+
+	/// The lowest structural similarity allowed between an image and its reference
+	double						minSimilarity = 0.99;
+};
+
+/**
+ * The result of comparing a rendered image against its reference
+ */
+struct ImageComparison
+{
+	/// The largest difference in any channel of any pixel, out of 255
+	int		maxError = 0;
+
+	/// The number of pixels that differ by more than the allowed error
+	size_t	pixelsOver = 0;
+
+	/// The mean structural similarity of the two images, where 1 means identical
+	double	similarity = 1.0;
+};
+
+/**
+ * The scenes that are checked when none are given. The bundled scenes do not
+ * contain any triangles, so a small generated scene covers those. Each light of
+ * the many lights scene is too dim to see on its own, which catches light
+ * culling that is not conservative. The box of mirrors keeps every reflection
+ * near a light that is just out of range for its own MaxDepth, which catches
+ * culling that counts fewer bounces than are traced. The looping particle scene
+ * is checked halfway back to its first keyframe, whose table of materials is
+ * smaller.
+ */
+static const char* GOLDEN_SCENES[] = {
+	"resources/Box.txt",
+	"resources/input.txt",
+	"resources/Mirrors.txt",
+	"exe/TestScene.txt",
+	"exe/Walk.txt",
+	"spheres:100",
+	"triangles:100",
+	"lights:1200",
+	"particle-loop:500@loop",
+};
+
+/// Scene names ending in this are rendered halfway from the last keyframe back to
+/// the first, rather than at the first keyframe
+static const char* LOOP_SUFFIX = "@loop";
+
+/// The folder the references for the default scenes are kept in, in the repository
+static const char* GOLDEN_FOLDER = "resources/golden";
+
+/// The file in the reference folder that the render times are recorded in
+static const char* TIMINGS_NAME = "timings.txt";
+
+/**
+ * Reads the color of a pixel from a 32 bit surface
+ *
+ * @param surface	The surface to read from
+ * @param x			The column of the pixel
+ * @param y			The row of the pixel
+ * @return			The red, green and blue values of the pixel
+ */
+static glm::ivec3 readPixel(SDL_Surface* surface, int x, int y)
+{
+	uint32_t pixel = *(uint32_t*)((uint8_t*)surface->pixels + (size_t)y * surface->pitch + (size_t)x * 4);
+
+	uint8_t r, g, b;
+	SDL_GetRGB(pixel, surface->format, &r, &g, &b);
+
+	return { r, g, b };
+}
+
+/**
+ * Computes the mean structural similarity (SSIM) of the luminance of two images,
+ * over 8x8 windows placed every 4 pixels
+ *
+ * @param luma		The luminance of the rendered image
+ * @param reference	The luminance of the reference image
+ * @param width		The width of both images
+ * @param height	The height of both images
+ * @return			The mean similarity, where 1 means identical
+ */
+static double structuralSimilarity(const std::vector<double>& luma, const std::vector<double>& reference, int width, int height)
+{
+	const double C1 = (0.01 * 255.0) * (0.01 * 255.0);
+	const double C2 = (0.03 * 255.0) * (0.03 * 255.0);
+
+	int window = std::min({ 8, width, height });
+	double total = 0.0;
+	int windows = 0;
+
+	for (int wy = 0; wy + window <= height; wy += 4) {
+		for (int wx = 0; wx + window <= width; wx += 4) {
+			double meanA = 0.0, meanB = 0.0;
+			for (int y = wy; y < wy + window; y++) {
+				for (int x = wx; x < wx + window; x++) {
+					meanA += luma[(size_t)y * width + x];
+					meanB += reference[(size_t)y * width + x];
+				}
+			}
+
+			double n = (double)window * window;
+			meanA /= n;
+			meanB /= n;
+
+			double varA = 0.0, varB = 0.0, covariance = 0.0;
+			for (int y = wy; y < wy + window; y++) {
+				for (int x = wx; x < wx + window; x++) {
+					double a = luma[(size_t)y * width + x] - meanA;
+					double b = reference[(size_t)y * width + x] - meanB;
+					varA += a * a;
+					varB += b * b;
+					covariance += a * b;
+				}
+			}
+			varA /= n - 1.0;
+			varB /= n - 1.0;
+			covariance /= n - 1.0;
+
+			total += ((2.0 * meanA * meanB + C1) * (2.0 * covariance + C2)) /
+					 ((meanA * meanA + meanB * meanB + C1) * (varA + varB + C2));
+			windows++;
+		}
+	}
+
+	return windows > 0 ? total / windows : 1.0;
+}
+
+/**
+ * Compares a rendered image against its reference and fills in an image of the
+ * differences between them, amplified so that small errors are visible
+ *
+ * @param image		The rendered image
+ * @param reference	The reference image, in the same format and size as the rendered image
+ * @param diff		The surface to draw the differences into
+ * @param maxError	The largest difference in a channel that is not counted as wrong
+ * @return			How much the images differ
+ */
+static ImageComparison compareImages(SDL_Surface* image, SDL_Surface* reference, SDL_Surface* diff, int maxError)
+{
+	ImageComparison result;
+
+	std::vector<double> luma((size_t)image->w * image->h);
+	std::vector<double> referenceLuma(luma.size());
+
+	for (int y = 0; y < image->h; y++) {
+		for (int x = 0; x < image->w; x++) {
+			glm::ivec3 a = readPixel(image, x, y);
+			glm::ivec3 b = readPixel(reference, x, y);
+			glm::ivec3 delta = glm::abs(a - b);
+
+			int error = glm::max(delta.r, glm::max(delta.g, delta.b));
+			result.maxError = std::max(result.maxError, error);
+			if (error > maxError)
+				result.pixelsOver++;
+
+			luma[(size_t)y * image->w + x] = 0.299 * a.r + 0.587 * a.g + 0.114 * a.b;
+			referenceLuma[(size_t)y * image->w + x] = 0.299 * b.r + 0.587 * b.g + 0.114 * b.b;
+
+			glm::ivec3 shown = glm::min(delta * 8, glm::ivec3(255));
+			*(uint32_t*)((uint8_t*)diff->pixels + (size_t)y * diff->pitch + (size_t)x * 4) =
+				SDL_MapRGB(diff->format, (uint8_t)shown.r, (uint8_t)shown.g, (uint8_t)shown.b);
+		}
+	}
+
+	result.similarity = structuralSimilarity(luma, referenceLuma, image->w, image->h);
+
+	return result;
+}
+
+/**
+ * Turns a scene name into something that can be used as a file name
+ *
+ * @param name	The path of the scene file, or the generated scene
+ * @return		The name with every character other than letters and digits replaced
+ */
+static std::string referenceName(const std::string& name)
+{
+	std::string result = name;
+
+	for (char& c : result) {
+		if (!std::isalnum((unsigned char)c))
+			c = '_';
+	}
+
+	return result;
+}
+
+/**
+ * Reads the render times recorded when the references were last updated
+ *
+ * @param path	The timings file
+ * @return		The render time in seconds of each scene, by name
+ */
+static std::map<std::string, double> loadTimings(const std::string& path)
+{
+	std::map<std::string, double> timings;
+	std::ifstream in(path);
+
+	double seconds;
+	std::string name;
+	while (in >> seconds && std::getline(in >> std::ws, name))
+		timings[name] = seconds;
+
+	return timings;
+}
+
+/**
+ * Parses the arguments given after --golden
+ *
+ * @param argc	The number of arguments
+ * @param argv	The arguments
+ * @return		The parsed settings, or std::nullopt if an error occurred
+ */
+static std::optional<GoldenOptions> parseGoldenArguments(int argc, char** argv)
+{
+	GoldenOptions options;
+	options.folder = GOLDEN_FOLDER;
+
+	int first = 0;
+	if (argc > 0 && argv[0][0] != '-') {
+		options.folder = argv[0];
+		first = 1;
+	}
+
+	for (int i = first; i < argc; i++) {
+		std::string arg(argv[i]);
+
+		if (arg == "--update") {
+			options.update = true;
+			continue;
+		}
+
+		if (arg == "--wide-bvh") {
+			options.wideBvh = true;
+			continue;
+		}
+
+		if (arg == "--sphere-grid") {
+			options.sphereGrid = true;
+			continue;
+		}
+
+		if (i + 1 >= argc) {
+			std::cerr << "Missing value after " << arg << std::endl;
+			return std::nullopt;
+		}
+		std::string value(argv[++i]);
+
+		try {
+			if (arg == "--scene") {
+				options.scenes.push_back(value);
+			}
+			else if (arg == "--resolution") {
+				size_t x = value.find('x');
+				if (x == std::string::npos)
+					throw std::invalid_argument(value);
+
+				options.width = std::stoi(value.substr(0, x));
+				options.height = std::stoi(value.substr(x + 1));
+			}
+			else if (arg == "--samples") {
+				options.samples = std::stoi(value);
+			}
+			else if (arg == "--threads") {
+				options.threads = std::stoi(value);
+			}
+			else if (arg == "--isa") {
+				std::optional<IsaLevel> isa = parseIsa(value);
+				if (!isa.has_value())
+					throw std::invalid_argument(value);
+
+				options.isa = isa.value();
+			}
+			else if (arg == "--bvh") {
+				std::optional<BvhBuilder> builder = parseBvhBuilder(value);
+				if (!builder.has_value())
+					throw std::invalid_argument(value);
+
+				options.bvhBuilder = builder.value();
+			}
+			else if (arg == "--max-error") {
+				options.maxError = std::stoi(value);
+			}
+			else if (arg == "--min-ssim") {
+				options.minSimilarity = std::stod(value);
+			}
+			else {
+				std::cerr << "Unknown golden image option \"" << arg << "\"" << std::endl;
+				return std::nullopt;
+			}
+		}
+		catch (std::exception&) {
+			std::cerr << "Invalid value \"" << value << "\" after " << arg << std::endl;
+			return std::nullopt;
+		}
+	}
+
+	if (options.width < 1 || options.height < 1 || options.samples < 0 || options.maxError < 0) {
+		std::cerr << "Invalid golden image settings" << std::endl;
+		return std::nullopt;
+	}
+
+	if (options.scenes.empty())
+		options.scenes.assign(std::begin(GOLDEN_SCENES), std::end(GOLDEN_SCENES));
+
+	return options;
+}
+
+int runGolden(int argc, char** argv)
+{
+	std::optional<GoldenOptions> optionsOpt = parseGoldenArguments(argc, argv);
+	if (!optionsOpt.has_value())
+		return -1;
+	GoldenOptions options = optionsOpt.value();
+
+#ifdef _OPENMP
+	if (options.threads > 0)
+		omp_set_num_threads(options.threads);
+#endif
+
+	selectIsa(options.isa);
+
+	if (IMG_Init(IMG_INIT_PNG) == 0) {
+		std::cerr << "Could not initialize SDL2_image: SDL_Error: " << IMG_GetError() << std::endl;
+		return -1;
+	}
+
+	std::string folder = options.folder;
+	if (folder.back() != '/' && folder.back() != '\\')
+		folder += '/';
+
+	std::error_code error;
+	std::filesystem::create_directories(folder, error);
+
+	std::map<std::string, double> timings = loadTimings(folder + TIMINGS_NAME);
+	int failures = 0;
+
+	for (const std::string& name : options.scenes) {
+		std::string scene = name;
+		bool looped = scene.size() > std::strlen(LOOP_SUFFIX) &&
+					  scene.compare(scene.size() - std::strlen(LOOP_SUFFIX), std::string::npos, LOOP_SUFFIX) == 0;
+		if (looped)
+			scene.erase(scene.size() - std::strlen(LOOP_SUFFIX));
+
+		std::optional<Animation> animationOpt = loadScene(scene);
+		if (!animationOpt.has_value())
+			return -1;
+		Animation& animation = animationOpt.value();
+
+		Frame frame = animation.keyFrames[0];
+		if (looped)
+			frame = interpolateFrames(animation.keyFrames.back(), animation.keyFrames[0], 0.5);
+
+		if (options.samples > 0)
+			animation.samples = options.samples;
+
+		SDL_Surface* surface = createFramebuffer(options.width, options.height);
+		if (surface == nullptr) {
+			std::cerr << "Could not create a surface: " << SDL_GetError() << std::endl;
+			return -1;
+		}
+
+		// The default seed keeps the render deterministic, so an unchanged
+		// renderer reproduces the reference exactly
+		Configuration config;
+		config.bvhBuilder = options.bvhBuilder;
+		config.wideBvh = options.wideBvh;
+		config.sphereGrid = options.sphereGrid;
+		applySceneSettings(config, animation);
+
+		auto start = std::chrono::steady_clock::now();
+		renderFrame(nullptr, surface, frame, 0, animation.maxDepth, animation.samples, animation.pattern, config);
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		std::string base = folder + referenceName(name);
+		std::string referencePath = base + ".png";
+
+		std::cout << std::left << std::setw(24) << name << std::right
+				  << std::fixed << std::setprecision(3) << std::setw(8) << seconds << "s";
+
+		auto previous = timings.find(name);
+		if (previous != timings.end() && previous->second > 0.0) {
+			std::cout << " (" << std::showpos << std::setprecision(1) << (seconds / previous->second - 1.0) * 100.0
+					  << std::noshowpos << "% vs reference)";
+		}
+		std::cout << std::defaultfloat << "  ";
+
+		if (options.update) {
+			if (IMG_SavePNG(surface, referencePath.c_str()) != 0) {
+				std::cerr << "Could not write \"" << referencePath << "\": " << IMG_GetError() << std::endl;
+				freeFramebuffer(surface);
+				return -1;
+			}
+
+			timings[name] = seconds;
+			std::cout << "updated" << std::endl;
+			freeFramebuffer(surface);
+			continue;
+		}
+
+		SDL_Surface* loaded = IMG_Load(referencePath.c_str());
+		if (loaded == nullptr) {
+			std::cout << "FAILED: no reference image, run with --update to create one" << std::endl;
+			failures++;
+			freeFramebuffer(surface);
+			continue;
+		}
+
+		SDL_Surface* reference = SDL_ConvertSurfaceFormat(loaded, surface->format->format, 0);
+		SDL_FreeSurface(loaded);
+
+		if (reference->w != surface->w || reference->h != surface->h) {
+			std::cout << "FAILED: reference is " << reference->w << "x" << reference->h << std::endl;
+			failures++;
+			SDL_FreeSurface(reference);
+			freeFramebuffer(surface);
+			continue;
+		}
+
+		SDL_Surface* diff = SDL_CreateRGBSurface(0, surface->w, surface->h, 32, 0x000000FF, 0x00000FF00, 0x00FF0000, 0xFF000000);
+		ImageComparison result = compareImages(surface, reference, diff, options.maxError);
+
+		bool passed = result.maxError <= options.maxError && result.similarity >= options.minSimilarity;
+		std::cout << (passed ? "ok" : "FAILED") << ": max error " << result.maxError
+				  << ", " << result.pixelsOver << " pixels over, SSIM " << std::setprecision(5) << result.similarity
+				  << std::defaultfloat << std::endl;
+
+		// Keep the rendered image and the differences around so the failure can be inspected
+		if (!passed) {
+			failures++;
+			IMG_SavePNG(surface, (base + ".actual.png").c_str());
+			IMG_SavePNG(diff, (base + ".diff.png").c_str());
+			std::cout << "    Wrote " << base << ".actual.png and " << base << ".diff.png" << std::endl;
+		}
+		else {
+			std::filesystem::remove(base + ".actual.png", error);
+			std::filesystem::remove(base + ".diff.png", error);
+		}
+
+		SDL_FreeSurface(diff);
+		SDL_FreeSurface(reference);
+		freeFramebuffer(surface);
+	}
+
+	if (options.update) {
+		std::ofstream out(folder + TIMINGS_NAME);
+		for (auto& timing : timings)
+			out << timing.second << " " << timing.first << "\n";
+	}
+
+	if (failures > 0) {
+		std::cerr << failures << " of " << options.scenes.size() << " scenes did not match their reference" << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,18 @@
+#ifndef GOLDEN_HPP
+#define GOLDEN_HPP
+
+/**
+ * Renders a set of scenes at a small resolution and compares them against
+ * reference images stored in a folder. Images that do not match closely
+ * enough fail the check, and a difference image is written next to the
+ * reference so the change can be inspected. The render time of every scene
+ * is recorded alongside the references, so a change in speed shows up in the
+ * same run.
+ *
+ * @param argc	The number of arguments after --golden
+ * @param argv	The arguments after --golden
+ * @return		0 if every scene matched its reference, 1 if any did not, or -1 on an error
+ */
+int runGolden(int argc, char** argv);
+
+#endif//GOLDEN_HPP
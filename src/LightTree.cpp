@@ -0,0 +1,107 @@
+#include "LightTree.hpp"
+
+#include <algorithm>
+#include <numeric>
+
+/**
+ * Computes the brightness of a color as it is perceived
+ *
+ * @param color	The color
+ * @return		The luminance of the color
+ */
+static double luminance(glm::dvec3 color)
+{
+	return 0.2126 * color.r + 0.7152 * color.g + 0.0722 * color.b;
+}
+
+LightTree::LightTree(const std::vector<std::shared_ptr<Light>>& lights)
+{
+	for (const std::shared_ptr<Light>& light : lights) {
+		positions.push_back(light->position);
+		powers.push_back(std::max(luminance(light->diffuse) + luminance(light->specular), 0.0));
+	}
+
+	std::vector<int> order(lights.size());
+	std::iota(order.begin(), order.end(), 0);
+
+	nodes.reserve(lights.size() * 2);
+	build(order, 0, (int)order.size());
+}
+
+int LightTree::build(std::vector<int>& order, int begin, int end)
+{
+	int index = (int)nodes.size();
+	nodes.emplace_back();
+
+	BoundingBox bounds;
+	double power = 0.0;
+	for (int i = begin; i < end; i++) {
+		bounds.extend(positions[order[i]]);
+		power += powers[order[i]];
+	}
+
+	nodes[index].bounds = bounds;
+	nodes[index].power = power;
+
+	if (end - begin == 1) {
+		nodes[index].light = order[begin];
+		return index;
+	}
+
+	// Split the lights in half along the longest side of their bounds
+	glm::dvec3 size = bounds.max - bounds.min;
+	int axis = size.x > size.y ? (size.x > size.z ? 0 : 2) : (size.y > size.z ? 1 : 2);
+	int middle = (begin + end) / 2;
+
+	std::nth_element(order.begin() + begin, order.begin() + middle, order.begin() + end, [&](int a, int b) {
+		return positions[a][axis] < positions[b][axis];
+	});
+
+	build(order, begin, middle);
+	int right = build(order, middle, end);
+
+	nodes[index].right = right;
+
+	return index;
+}
+
+double LightTree::importance(const Node& node, glm::dvec3 point) const
+{
+	glm::dvec3 center = (node.bounds.min + node.bounds.max) * 0.5;
+	glm::dvec3 extent = node.bounds.max - node.bounds.min;
+
+	// Points inside or close to the bounds could be right next to any of the lights,
+	// so the distance is never taken to be less than half the size of the bounds
+	double distance2 = glm::dot(point - center, point - center);
+	double radius2 = glm::dot(extent, extent) * 0.25;
+
+	return node.power / std::max({ distance2, radius2, 1e-6 });
+}
+
+int LightTree::sample(glm::dvec3 point, SampleRandom& random, double& pdf) const
+{
+	pdf = 1.0;
+	int index = 0;
+
+	while (nodes[index].right >= 0) {
+		int left = index + 1;
+		int right = nodes[index].right;
+
+		double leftImportance = importance(nodes[left], point);
+		double rightImportance = importance(nodes[right], point);
+		double total = leftImportance + rightImportance;
+
+		double leftProbability = total > 0.0 ? leftImportance / total : 0.5;
+
+		if (random.nextDouble() < leftProbability) {
+			pdf *= leftProbability;
+			index = left;
+		}
+		else {
+			pdf *= 1.0 - leftProbability;
+			index = right;
+		}
+	}
+
+	return nodes[index].light;
+}
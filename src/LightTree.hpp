@@ -0,0 +1,91 @@
+#ifndef LIGHTTREE_HPP
+#define LIGHTTREE_HPP
+
+#include <vector>
+#include <memory>
+
+#include <glm/glm.hpp>
+
+#include "Objects.hpp"
+#include "Random.hpp"
+#include "Structures.hpp"
+
+/**
+ * A bounding volume hierarchy over the lights of a frame, used to pick lights
+ * in proportion to how much they are likely to contribute to a point.
+ *
+ * Every node stores the bounds and the total power of the lights below it. A
+ * light is picked by walking down from the root, choosing between the two
+ * children in proportion to their power divided by their squared distance to
+ * the shaded point. Since every light with any power can be picked, dividing
+ * its contribution by the probability of picking it gives an unbiased estimate
+ * of the lighting from all the lights.
+ */
+class LightTree
+{
+public:
+	/**
+	 * Builds the tree over the passed lights
+	 *
+	 * @param lights	The lights of the frame. Must not be empty
+	 */
+	LightTree(const std::vector<std::shared_ptr<Light>>& lights);
+
+	/**
+	 * Picks a light to shade a point with
+	 *
+	 * @param point		The point being shaded
+	 * @param random	The random numbers of the sample being traced
+	 * @param pdf		Set to the probability that the returned light was picked
+	 * @return			The index of the light in the frame's list of lights
+	 */
+	int sample(glm::dvec3 point, SampleRandom& random, double& pdf) const;
+
+protected:
+	/**
+	 * A node of the tree. Leaves hold a single light.
+	 */
+	struct Node
+	{
+		/// The bounds of the lights below this node
+		BoundingBox	bounds;
+
+		/// The total power of the lights below this node
+		double		power = 0.0;
+
+		/// The index of the second child. The first child directly follows the node.
+		/// Leaves have no children and store -1.
+		int			right = -1;
+
+		/// For leaves, the index of the light in the frame's list of lights
+		int			light = -1;
+	};
+
+	/**
+	 * Builds the subtree over part of the list of lights
+	 *
+	 * @param order		The indices of the lights, reordered while building
+	 * @param begin		The first index in the order that belongs to the subtree
+	 * @param end		One past the last index in the order that belongs to the subtree
+	 * @return			The index of the subtree's root node
+	 */
+	int build(std::vector<int>& order, int begin, int end);
+
+	/**
+	 * Estimates how much the lights below a node contribute to a point
+	 *
+	 * @param node	The node
+	 * @param point	The point being shaded
+	 * @return		The importance of the node, which is 0 only if it has no power
+	 */
+	double importance(const Node& node, glm::dvec3 point) const;
+
+	/// The nodes of the tree, with the root first
+	std::vector<Node>			nodes;
+
+	/// The position and power of each light, by its index in the frame
+	std::vector<glm::dvec3>		positions;
+	std::vector<double>			powers;
+};
+
+#endif//LIGHTTREE_HPP
@@ -1,185 +1,445 @@
-#include <iostream>
-#include <fstream>
-#include <vector>
-#include <string>
-#include <optional>
-#include <thread>
-#include <algorithm>
-#include <filesystem>
-
-#include <SDL2/SDL.h>
-#include <SDL2/SDL_image.h>
-
-#include "Parser.hpp"
-#include "Renderer.hpp"
-
-static std::string& toLower(std::string& string)
-{
-    std::transform(
-        string.begin(),
-        string.end(),
-        string.begin(),
-        [](unsigned char c) { return std::tolower(c); }
-    );
-
-    return string;
-}
-
-/**
- * Prints usage info to stdout
- * 
- * @param programName The exe name that was used to call the program
- */
-void printUsage(char* programName)
-{
-    std::cout << "Usage: " << programName << " <input file> [<options>]\n"   <<
-                 "Options:\n"                                                               <<
-                 "    -o <folder>   Output the rendered images in the specified folder.\n" <<
-                 "    -p            Display the image while it is being rendered\n"   <<
-                 "    -f <format>   The format to use for the output images:\n"                     <<
-                 "              png, jpg\n" <<
-                 std::endl;
-}
-
-/**
- * Parses the arguments for the program and stores them in a configuration struct.
- * 
- * @param argc The number of arguments passed to the program
- * @param argv The array of argument strings passed to the program
- * @return An optional containing the parsed configuration, or std::nullopt if
- *         an error occurred
- */
-std::optional<Configuration> parseArguments(int argc, char** argv)
-{
-    Configuration config;
-
-    for (int i = 0; i < argc; i++) {
-        std::string arg(argv[i]);
-
-        if (arg == "-d") {
-            config.display = DisplayMode::PIXEL;
-        }
-        else if (arg == "-o") {
-            config.outputName = argv[++i];
-
-            if (config.outputFormat == OutputFormat::NONE) {
-                config.outputFormat = OutputFormat::PNG;
-            }
-
-            char last = config.outputName[config.outputName.size() - 1];
-            if (last != '/' && last != '\\') {
-                config.outputName += '/';
-            }
-        }
-        else if (arg == "-f") {
-            std::string format(argv[++i]);
-
-            format = toLower(format);
-
-            if (format == "png") {
-                config.outputFormat = OutputFormat::PNG;
-            }
-            else if (format == "jpg" || format == "jpeg") {
-                config.outputFormat = OutputFormat::JPEG;
-            }
-        }
-    }
-
-    return config;
-}
-
-/**
- * Entrypoint for the program.
- * 
- * @param argc The number of arguments passed to this program
- * @param argv The array of argument strings passed to this program
- * @return The status of the program at exit.
- * 
- * @note This function is explicitly declared as using the _cdecl calling
- *       convention since the rest of the program is defined to use faster
- *       calling conventions. This function needs to be _cdecl so that
- *       windows can properly call it.
- */
-int _cdecl main (int argc, char** argv)
-{   
-    // We need to know the file name to render. If no file is specified, show the
-    // user the usage info
-    if (argc < 2) {
-        printUsage(argv[0]);
-        return 0;
-    }
-    
-    // Open our scene file
-    std::ifstream inputFile(argv[1]);
-    if (!inputFile) {
-        std::cerr << "Could not open input file \"" << argv[1] << 
-                     "\". Cannot continue" << std::endl;
-
-        return -1;
-    }
-
-    // Parse the rest of the configuartion options
-    std::optional<Configuration> configOpt = parseArguments(argc - 2, &argv[2]);
-    if (!configOpt.has_value()) {
-        return -1;
-    }
-    Configuration config = configOpt.value();
-
-    // Initialize the libraries we need to use 
-    if (SDL_Init(SDL_INIT_VIDEO)) {
-        std::cerr << "Could not initialize SDL2! SDL_Error: " << SDL_GetError() << std::endl;
-        return -1;
-    }
-
-    if (IMG_Init(IMG_INIT_JPG | IMG_INIT_PNG) == 0) {
-        std::cerr << "Could not initialize SDL2_image: SDL_Error: " << IMG_GetError() << std::endl;
-        return -1;
-    }
-
-    if (config.outputFormat != OutputFormat::NONE) {
-        std::filesystem::create_directory("./" + config.outputName);
-    }
-
-    SDL_Window* window = nullptr;
-    SDL_Surface* surface = nullptr;
-
-    Animation anim;
-    Parser parser(inputFile);
-    parser.doParse(anim);
-
-    std::cout << SDL_GetError() << std::endl;
-
-    // If the user specified that they want to see the rendering, open a window with SDL
-    if (config.display != DisplayMode::NONE) {
-        window = SDL_CreateWindow("Raytracer", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, anim.width, anim.height, 0);
-        surface = SDL_GetWindowSurface(window);
-    }
-    else {
-        surface = SDL_CreateRGBSurface(0, anim.width, anim.height, 32, 0x000000FF, 0x00000FF00, 0x00FF0000, 0xFF000000);
-    }
-    std::cout << SDL_GetError() << std::endl;
-
-    // Render all the frames in our scene
-    renderFrames(window, surface, anim, config);
-    
-    // Once we are are done rendering, continue to show the last frame. Oversight: The window may not be
-    // open, but SDL doesn't do anything if that is the case. Should have been accounted for though.
-    bool running = true;
-    SDL_Event event;
-    while (running) {
-        while (SDL_PollEvent(&event)) {
-            if (event.type == SDL_QUIT)
-                running = false;
-        }
-
-        SDL_BlitSurface(surface, nullptr, SDL_GetWindowSurface(window), nullptr); 
-        SDL_UpdateWindowSurface(window);
-
-        SDL_Delay(100);
-    }
-
-
-    SDL_Quit();
-
-    return 0;
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <optional>
+#include <thread>
+#include <algorithm>
+#include <filesystem>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_image.h>
+
+#include "Parser.hpp"
+#include "Renderer.hpp"
+#include "Checkpoint.hpp"
+#include "Benchmark.hpp"
+#include "Golden.hpp"
+#include "Timeline.hpp"
+
+static std::string& toLower(std::string& string)
+{
+    std::transform(
+        string.begin(),
+        string.end(),
+        string.begin(),
+        [](unsigned char c) { return std::tolower(c); }
+    );
+
+    return string;
+}
+
+/**
+ * Prints usage info to stdout
+ * 
+ * @param programName The exe name that was used to call the program
+ */
+void printUsage(char* programName)
+{
+    std::cout << "Usage: " << programName << " <input file> [<options>]\n"   <<
+                 "       " << programName << " --benchmark [<benchmark options>]\n" <<
+                 "       " << programName << " --golden [<reference folder>] [<golden image options>]\n" <<
+                 "Options:\n"                                                               <<
+                 "    -o <folder>   Output the rendered images in the specified folder.\n" <<
+                 "    -p            Display the image while it is being rendered\n"   <<
+                 "    -f <format>   The format to use for the output images:\n"                     <<
+                 "              png, jpg\n" <<
+                 "    --frames <start>:<end>[:<step>]\n" <<
+                 "                  Only render the frames from start up to, but not including, end.\n" <<
+                 "                  Either number can be left out to use the first or last frame.\n" <<
+                 "    --resume      Skip frames that an earlier run of the same scene already wrote\n" <<
+                 "                  to the output folder\n" <<
+                 "    --no-incremental\n" <<
+                 "                  Trace every pixel of every frame, even if only part of the\n" <<
+                 "                  scene changed since the previous frame\n" <<
+                 "    --no-shadow-cache\n" <<
+                 "                  Do not test the object that blocked the last shadow ray to a light\n" <<
+                 "                  first\n" <<
+                 "    --no-specialize\n" <<
+                 "                  Trace the pixels with a single loop instead of one compiled for\n" <<
+                 "                  the frame's number of samples\n" <<
+                 "    --wavefront   Trace each tile one bounce at a time over sorted queues of rays\n" <<
+                 "    --watertight  Intersect triangles with a test that leaves no cracks between\n" <<
+                 "                  triangles sharing an edge\n" <<
+                 "    --bvh <sah|lbvh|treelets|sbvh>\n" <<
+                 "                  How the bounding volume hierarchy is built for every frame,\n" <<
+                 "                  overriding the scene's RenderSettings\n" <<
+                 "    --wide-bvh    Collapse the hierarchy into one with eight children per node\n" <<
+                 "    --sphere-grid Put the spheres in a uniform grid instead of the hierarchy\n" <<
+                 "    --bvh-report  Print the overlap of the hierarchy's nodes and the nodes visited\n" <<
+                 "                  by primary rays for every frame, compared to an SAH hierarchy\n" <<
+                 "    --seed <n>    The seed for random sampling. Renders with the same seed are\n" <<
+                 "                  identical regardless of the number of threads\n" <<
+                 "    --threads <n> The number of threads to render with\n" <<
+                 "    --timeline <file>\n" <<
+                 "                  Write a timeline of the parsing, rendering and output of every\n" <<
+                 "                  frame and row as a Chrome trace (chrome://tracing, ui.perfetto.dev)\n" <<
+                 "    --light-samples <n>\n" <<
+                 "                  Shade each intersection with n lights picked by how much they are\n" <<
+                 "                  likely to contribute, instead of with every light. Frames with at\n" <<
+                 "                  most n lights are still shaded with every light\n" <<
+                 "    --isa <scalar|sse4.2|avx2|avx512>\n" <<
+                 "                  The instruction set to run the vectorized kernels with, instead\n" <<
+                 "                  of the newest one the CPU supports\n" <<
+                 "    --heatmap     Write the cost of tracing each pixel next to every frame, as a\n" <<
+                 "                  false color image and a raw buffer of floats\n" <<
+                 "Benchmark options:\n" <<
+                 "    --scene <scene>   A scene file, or spheres:<n>, triangles:<n>, particles:<n> or\n" <<
+                 "                      lights:<n> to generate one. Can be given more than once.\n" <<
+                 "                      Defaults to the bundled scenes\n" <<
+                 "    --runs <n>        The number of timed renders of each scene (default 5)\n" <<
+                 "    --resolution <w>x<h>, --samples <n>\n" <<
+                 "                      Override the resolution and samples of every scene\n" <<
+                 "    --threads <n>     The number of threads to render with\n" <<
+                 "    --isa <set>       The instruction set to run the vectorized kernels with\n" <<
+                 "    --light-samples <n>\n" <<
+                 "                      Pick n lights at each intersection, as when rendering\n" <<
+                 "    --baseline <file> Compare the median times against a saved baseline\n" <<
+                 "    --tolerance <pct> How much slower than the baseline is allowed (default 10)\n" <<
+                 "    --save-baseline <file>\n" <<
+                 "                      Save the results to use as a baseline later\n" <<
+                 "Golden image options:\n" <<
+                 "    --update          Write new reference images instead of comparing\n" <<
+                 "    --scene <scene>   A scene to check, as for the benchmark. Defaults to the bundled scenes\n" <<
+                 "    --resolution <w>x<h>, --samples <n>\n" <<
+                 "                      The resolution (default 160x120) and samples to render at\n" <<
+                 "    --threads <n>     The number of threads to render with\n" <<
+                 "    --isa <set>       The instruction set to run the vectorized kernels with\n" <<
+                 "    --max-error <n>   The largest difference allowed in a pixel, out of 255 (default 2)\n" <<
+                 "    --min-ssim <n>    The lowest structural similarity allowed (default 0.99)\n" <<
+                 std::endl;
+}
+
+/**
+ * Parses a frame selection of the form start:end[:step]
+ * 
+ * @param string The string to parse
+ * @return The parsed frame range, or std::nullopt if the string is not a valid selection
+ */
+std::optional<FrameRange> parseFrameRange(const std::string& string)
+{
+    FrameRange range;
+
+    size_t first = string.find(':');
+    if (first == std::string::npos) {
+        return std::nullopt;
+    }
+
+    size_t second = string.find(':', first + 1);
+    std::string start = string.substr(0, first);
+    std::string end = string.substr(first + 1, second == std::string::npos ? std::string::npos : second - first - 1);
+    std::string step = second == std::string::npos ? "" : string.substr(second + 1);
+
+    try {
+        if (!start.empty()) range.start = std::stoi(start);
+        if (!end.empty())   range.end = std::stoi(end);
+        if (!step.empty())  range.step = std::stoi(step);
+    }
+    catch (std::exception&) {
+        return std::nullopt;
+    }
+
+    if (range.start < 0 || range.step < 1 || (range.end >= 0 && range.end < range.start)) {
+        return std::nullopt;
+    }
+
+    return range;
+}
+
+/**
+ * Parses the arguments for the program and stores them in a configuration struct.
+ * 
+ * @param argc The number of arguments passed to the program
+ * @param argv The array of argument strings passed to the program
+ * @return An optional containing the parsed configuration, or std::nullopt if
+ *         an error occurred
+ */
+std::optional<Configuration> parseArguments(int argc, char** argv)
+{
+    Configuration config;
+
+    for (int i = 0; i < argc; i++) {
+        std::string arg(argv[i]);
+
+        if (arg == "-d") {
+            config.display = DisplayMode::PIXEL;
+        }
+        else if (arg == "-o") {
+            config.outputName = argv[++i];
+
+            if (config.outputFormat == OutputFormat::NONE) {
+                config.outputFormat = OutputFormat::PNG;
+            }
+
+            char last = config.outputName[config.outputName.size() - 1];
+            if (last != '/' && last != '\\') {
+                config.outputName += '/';
+            }
+        }
+        else if (arg == "-f") {
+            std::string format(argv[++i]);
+
+            format = toLower(format);
+
+            if (format == "png") {
+                config.outputFormat = OutputFormat::PNG;
+            }
+            else if (format == "jpg" || format == "jpeg") {
+                config.outputFormat = OutputFormat::JPEG;
+            }
+        }
+        else if (arg == "--frames") {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing frame selection after --frames" << std::endl;
+                return std::nullopt;
+            }
+
+            std::optional<FrameRange> range = parseFrameRange(argv[++i]);
+            if (!range.has_value()) {
+                std::cerr << "Invalid frame selection \"" << argv[i] << "\". Expected <start>:<end>[:<step>]" << std::endl;
+                return std::nullopt;
+            }
+            config.frames = range.value();
+        }
+        else if (arg == "--resume") {
+            config.resume = true;
+        }
+        else if (arg == "--no-incremental") {
+            config.incremental = false;
+        }
+        else if (arg == "--no-shadow-cache") {
+            config.shadowCache = false;
+        }
+        else if (arg == "--no-specialize") {
+            config.specialize = false;
+        }
+        else if (arg == "--wavefront") {
+            config.wavefront = true;
+        }
+        else if (arg == "--watertight") {
+            config.watertight = true;
+        }
+        else if (arg == "--wide-bvh") {
+            config.wideBvh = true;
+        }
+        else if (arg == "--sphere-grid") {
+            config.sphereGrid = true;
+        }
+        else if (arg == "--bvh-report") {
+            config.bvhReport = true;
+        }
+        else if (arg == "--bvh") {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing builder after --bvh" << std::endl;
+                return std::nullopt;
+            }
+
+            std::string name(argv[++i]);
+            std::optional<BvhBuilder> builder = parseBvhBuilder(toLower(name));
+            if (!builder.has_value()) {
+                std::cerr << "Unknown BVH builder \"" << argv[i] << "\". Expected sah, lbvh, treelets or sbvh" << std::endl;
+                return std::nullopt;
+            }
+            config.bvhBuilder = builder.value();
+        }
+        else if (arg == "--isa") {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing instruction set after --isa" << std::endl;
+                return std::nullopt;
+            }
+
+            std::string name(argv[++i]);
+            std::optional<IsaLevel> isa = parseIsa(toLower(name));
+            if (!isa.has_value()) {
+                std::cerr << "Unknown instruction set \"" << argv[i] << "\". Expected scalar, sse4.2, avx2 or avx512" << std::endl;
+                return std::nullopt;
+            }
+            config.isa = isa.value();
+        }
+        else if (arg == "--heatmap") {
+            config.heatmap = true;
+        }
+        else if (arg == "--timeline") {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing file name after --timeline" << std::endl;
+                return std::nullopt;
+            }
+
+            config.timelinePath = argv[++i];
+        }
+        else if (arg == "--seed" || arg == "--threads" || arg == "--light-samples") {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing number after " << arg << std::endl;
+                return std::nullopt;
+            }
+
+            try {
+                if (arg == "--seed")
+                    config.seed = (uint32_t)std::stoul(argv[++i]);
+                else if (arg == "--threads")
+                    config.threads = std::stoi(argv[++i]);
+                else
+                    config.lightSamples = std::max(std::stoi(argv[++i]), 0);
+            }
+            catch (std::exception&) {
+                std::cerr << "Invalid number \"" << argv[i] << "\" after " << arg << std::endl;
+                return std::nullopt;
+            }
+        }
+    }
+
+    // The cost maps are written next to the frames, so they need an output folder
+    if (config.heatmap && config.outputFormat == OutputFormat::NONE) {
+        std::cerr << "--heatmap needs an output folder to be given with -o, ignoring it" << std::endl;
+        config.heatmap = false;
+    }
+
+    return config;
+}
+
+/**
+ * Entrypoint for the program.
+ * 
+ * @param argc The number of arguments passed to this program
+ * @param argv The array of argument strings passed to this program
+ * @return The status of the program at exit.
+ * 
+ * @note This function is explicitly declared as using the _cdecl calling
+ *       convention since the rest of the program is defined to use faster
+ *       calling conventions. This function needs to be _cdecl so that
+ *       windows can properly call it.
+ */
+int _cdecl main (int argc, char** argv)
+{   
+    // We need to know the file name to render. If no file is specified, show the
+    // user the usage info
+    if (argc < 2) {
+        printUsage(argv[0]);
+        return 0;
+    }
+
+    // The benchmark renders its own set of scenes headless
+    if (std::string(argv[1]) == "--benchmark") {
+        return runBenchmark(argc - 2, &argv[2]);
+    }
+
+    // Check the renderer's output against stored reference images
+    if (std::string(argv[1]) == "--golden") {
+        return runGolden(argc - 2, &argv[2]);
+    }
+    
+    // Open our scene file
+    std::ifstream inputFile(argv[1]);
+    if (!inputFile) {
+        std::cerr << "Could not open input file \"" << argv[1] << 
+                     "\". Cannot continue" << std::endl;
+
+        return -1;
+    }
+
+    // Parse the rest of the configuartion options
+    std::optional<Configuration> configOpt = parseArguments(argc - 2, &argv[2]);
+    if (!configOpt.has_value()) {
+        return -1;
+    }
+    Configuration config = configOpt.value();
+
+    // Hash the scene so that resumed renders can tell if the scene changed
+    config.sceneHash = hashStream(inputFile);
+
+    // Start the timeline before parsing so that the parse shows up on it
+    if (!config.timelinePath.empty()) {
+        enableTimeline();
+    }
+
+    Triangle::watertight = config.watertight;
+    selectIsa(config.isa);
+
+#ifdef _OPENMP
+    if (config.threads > 0) {
+        omp_set_num_threads(config.threads);
+    }
+#endif
+
+    // Only a window needs the video subsystem. Headless renders write straight
+    // into a framebuffer and use SDL_image's encoders, so they start quickly and
+    // run on machines without a display.
+    bool headless = config.display == DisplayMode::NONE;
+
+    if (!headless && SDL_Init(SDL_INIT_VIDEO)) {
+        std::cerr << "Could not initialize SDL2! SDL_Error: " << SDL_GetError() << std::endl;
+        return -1;
+    }
+
+    if (config.outputFormat != OutputFormat::NONE) {
+        int imageFormat = config.outputFormat == OutputFormat::JPEG ? IMG_INIT_JPG : IMG_INIT_PNG;
+        if ((IMG_Init(imageFormat) & imageFormat) == 0) {
+            std::cerr << "Could not initialize SDL2_image: SDL_Error: " << IMG_GetError() << std::endl;
+            return -1;
+        }
+
+        std::filesystem::create_directory("./" + config.outputName);
+    }
+
+    SDL_Window* window = nullptr;
+    SDL_Surface* surface = nullptr;
+
+    Animation anim;
+    Parser parser(inputFile);
+    parser.doParse(anim);
+
+    // If the user specified that they want to see the rendering, open a window with SDL
+    if (!headless) {
+        window = SDL_CreateWindow("Raytracer", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, anim.width, anim.height, 0);
+        surface = window ? SDL_GetWindowSurface(window) : nullptr;
+    }
+    else {
+        surface = createFramebuffer(anim.width, anim.height);
+    }
+
+    if (surface == nullptr) {
+        std::cerr << "Could not create a surface to render to: " << SDL_GetError() << std::endl;
+        return -1;
+    }
+
+    // Render all the frames in our scene
+    renderFrames(window, surface, anim, config);
+
+    if (!config.timelinePath.empty()) {
+        if (writeTimeline(config.timelinePath))
+            std::cout << "Wrote timeline to \"" << config.timelinePath << "\"" << std::endl;
+        else
+            std::cerr << "Could not write timeline \"" << config.timelinePath << "\"" << std::endl;
+    }
+    
+    // Once we are are done rendering, continue to show the last frame until the
+    // window is closed. Headless renders are done once the last frame is written.
+    bool running = window != nullptr;
+    SDL_Event event;
+    while (running) {
+        while (SDL_PollEvent(&event)) {
+            if (event.type == SDL_QUIT)
+                running = false;
+        }
+
+        SDL_UpdateWindowSurface(window);
+
+        SDL_Delay(100);
+    }
+
+    if (headless) {
+        freeFramebuffer(surface);
+    }
+    else {
+        SDL_DestroyWindow(window);
+    }
+
+    IMG_Quit();
+    SDL_Quit();
+
+    return 0;
 }
\ No newline at end of file
@@ -0,0 +1,90 @@
+#include "MappedFile.hpp"
+
+#include <iostream>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+std::shared_ptr<MappedFile> MappedFile::open(const std::string& path)
+{
+	std::shared_ptr<MappedFile> mapped(new MappedFile());
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		std::cerr << "Could not open \"" << path << "\"" << std::endl;
+		return nullptr;
+	}
+	mapped->file = file;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size)) {
+		std::cerr << "Could not get the size of \"" << path << "\"" << std::endl;
+		return nullptr;
+	}
+	mapped->length = (size_t)size.QuadPart;
+
+	// Empty files cannot be mapped, but are still valid
+	if (mapped->length == 0)
+		return mapped;
+
+	mapped->mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapped->mapping != nullptr)
+		mapped->bytes = (const uint8_t*)MapViewOfFile(mapped->mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+	int descriptor = ::open(path.c_str(), O_RDONLY);
+	if (descriptor < 0) {
+		std::cerr << "Could not open \"" << path << "\"" << std::endl;
+		return nullptr;
+	}
+
+	struct stat status;
+	if (fstat(descriptor, &status) != 0) {
+		std::cerr << "Could not get the size of \"" << path << "\"" << std::endl;
+		close(descriptor);
+		return nullptr;
+	}
+	mapped->length = (size_t)status.st_size;
+
+	if (mapped->length == 0) {
+		close(descriptor);
+		return mapped;
+	}
+
+	// The mapping stays valid after the file is closed
+	void* bytes = mmap(nullptr, mapped->length, PROT_READ, MAP_PRIVATE, descriptor, 0);
+	close(descriptor);
+
+	if (bytes != MAP_FAILED)
+		mapped->bytes = (const uint8_t*)bytes;
+#endif
+
+	if (mapped->bytes == nullptr) {
+		std::cerr << "Could not map \"" << path << "\" into memory" << std::endl;
+		return nullptr;
+	}
+
+	return mapped;
+}
+
+MappedFile::~MappedFile()
+{
+#ifdef _WIN32
+	if (bytes != nullptr)
+		UnmapViewOfFile(bytes);
+	if (mapping != nullptr)
+		CloseHandle(mapping);
+	if (file != nullptr)
+		CloseHandle(file);
+#else
+	if (bytes != nullptr)
+		munmap((void*)bytes, length);
+#endif
+}
@@ -0,0 +1,58 @@
+#ifndef MAPPEDFILE_HPP
+#define MAPPEDFILE_HPP
+
+#include <string>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * A file mapped read only into memory. The operating system pages the contents in
+ * as they are read, so a large file is not copied before it is used.
+ */
+class MappedFile
+{
+public:
+	/**
+	 * Maps a file into memory
+	 *
+	 * @param path	The path of the file
+	 * @return		The mapped file, or NULL if it could not be opened or mapped
+	 */
+	static std::shared_ptr<MappedFile> open(const std::string& path);
+
+	/**
+	 * Unmaps the file
+	 */
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	/**
+	 * Gets the contents of the file
+	 */
+	const uint8_t* data() const { return bytes; }
+
+	/**
+	 * Gets the size of the file in bytes
+	 */
+	size_t size() const { return length; }
+
+protected:
+	MappedFile() = default;
+
+	/// The contents of the file
+	const uint8_t*	bytes = nullptr;
+
+	/// The size of the file in bytes
+	size_t			length = 0;
+
+#ifdef _WIN32
+	/// The handles of the file and of its mapping
+	void*			file = nullptr;
+	void*			mapping = nullptr;
+#endif
+};
+
+#endif//MAPPEDFILE_HPP
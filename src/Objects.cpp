@@ -1,403 +1,713 @@
-#include "Objects.hpp"
-
-#include <glm/glm.hpp>
-
-#include "Parser.hpp"
-#include "Structures.hpp"
-
-/// The epsilon distance for comparing if two floating point numbers are close
-/// enough to be equal
-const double EPSILON = 1e-8;
-
-/**
- * Helper template function for linearly interpolating between values
- * 
- * \param a		The starting value
- * \param b		The ending value
- * \param alpha A time value (typically between 0 and 1) for interpolation
- * \return		The interpolated value
- */
-template<typename T>
-T lerp(T a, T b, double alpha)
-{
-	return (1 - alpha) * a + alpha * b;
-}
-
-void Object::parseProperty(std::string& name, Tokenizer& tokenizer)
-{
-	// Since a generic object doesn't have any properties, discard the line
-	tokenizer.discardLine();
-}
-
-void Object::interpolate(Object& a, Object& b, double alpha)
-{
-	// Interpolate the material properties for this object
-	material.diffuse = lerp(a.material.diffuse, b.material.diffuse, alpha);
-	material.specular = lerp(a.material.specular, b.material.specular, alpha);
-	material.shininess = lerp(a.material.shininess, b.material.shininess, alpha);
-}
-
-std::optional<Intersection> Sphere::intersect(glm::dvec3 orig, glm::dvec3 dir)
-{
-	// The formula used for calculating the interesection with a sphere was given
-	// in the class slides. 
-
-	// Calculate the ray from the sphere's center to the origin of the ray
-	glm::dvec3 omc = orig - position;
-	
-	double b = 2 * glm::dot(dir, omc);
-	double c = glm::dot(omc, omc) - radius * radius;
-
-	// dx(ox - cx) + dy(oy - cy)
-
-	double disc = b * b - 4 * c;
-
-	// If our discriminant is less than, or close to zero, we do not have an intersection
-	if (disc <= EPSILON)
-		return std::optional<Intersection>();
-
-	double rt = glm::sqrt(disc);
-	double t1 = (-b + rt) / 2.0;
-	double t2 = (-b - rt) / 2.0;
-
-	if (t1 > t2)
-		std::swap(t1, t2);
-
-	glm::dvec3 point;
-	double t = t1;
-
-	if (t1 < -EPSILON && t2 < EPSILON)
-		return std::optional<Intersection>();
-	else if (t1 < 0.0) {
-		point = orig + t2 * dir;
-		t = t2;
-	}
-	else {
-		point = orig + t1 * dir;
-		t = t1;
-	}
-
-	return std::optional<Intersection>({
-		&material,
-		point,
-		glm::normalize(point - position),
-		t
-	});
-}
-
-void Sphere::parseProperty(std::string& name, Tokenizer& tokenizer)
-{
-	if (name == "position") {
-		// Read in 3 doubles for the position
-		position = {
-			tokenizer.nextDouble(),
-			tokenizer.nextDouble(),
-			tokenizer.nextDouble(),
-		};
-	}
-	else if (name == "diffuse") {
-		// Read in 3 doubles for the diffuse color
-		material.diffuse = {
-			tokenizer.nextDouble(),
-			tokenizer.nextDouble(),
-			tokenizer.nextDouble(),
-		};
-
-	}
-	else if (name == "specular") {
-		// Read in 3 doubles for the specular color
-		material.specular = {
-			tokenizer.nextDouble(),
-			tokenizer.nextDouble(),
-			tokenizer.nextDouble(),
-		};
-	}
-	else if (name == "shininess") {
-		material.shininess = tokenizer.nextDouble();
-	}
-	else if (name == "radius") {
-		radius = tokenizer.nextDouble();
-	}
-	else {
-		// If our property is unkown, discard the line and pretend like there is no issue
-		tokenizer.discardLine();
-		std::cout << "Unknown property \"" << name << "\"" << std::endl;
-	}
-}
-
-void Sphere::interpolate(Object& a, Object& b, double alpha)
-{
-	// First, cast each object to a sphere object. Each object should be a sphere
-	Sphere& ca = static_cast<Sphere&>(a);
-	Sphere& cb = static_cast<Sphere&>(b);
-
-	// Interpolate the object properties
-	Object::interpolate(a, b, alpha);
-	
-	// Interpolate the sphere properties
-	position = lerp(ca.position, cb.position, alpha);
-	radius = lerp(ca.radius, cb.radius, alpha);
-}
-
-std::optional<Intersection> Plane::intersect(glm::dvec3 origin, glm::dvec3 direction)
-{
-	// The formula used for calculating the interesection with a plane was given
-	// in the class slides. 
-	double ddn = glm::dot(direction, norm);
-
-	if (ddn > -EPSILON && ddn < EPSILON)
-		return std::optional<Intersection>();
-
-	double t = glm::dot(point - origin, norm) / ddn;
-
-	if (t < EPSILON)
-		return std::optional<Intersection>();
-
-	glm::dvec3 p = origin + direction * t;
-
-	return std::optional<Intersection>({
-		&material,
-		p,
-		norm,
-		t
-	});
-}
-
-void Camera::parseProperty(std::string& name, Tokenizer& tokenizer)
-{
-	if (name == "position") {
-		position = {
-			tokenizer.nextDouble(),
-			tokenizer.nextDouble(),
-			tokenizer.nextDouble(),
-		};
-	}
-	else if (name == "lookat") {
-		lookat = {
-			tokenizer.nextDouble(),
-			tokenizer.nextDouble(),
-			tokenizer.nextDouble(),
-		};
-	}
-	else if (name == "up") {
-		up = {
-			tokenizer.nextDouble(),
-			tokenizer.nextDouble(),
-			tokenizer.nextDouble(),
-		};
-	}
-	else if (name == "fov") {
-		fov = tokenizer.nextDouble();
-	}
-	else {
-		tokenizer.discardLine();
-		std::cout << "Unknown property \"" << name << "\"" << std::endl;
-	}
-}
-
-void Camera::interpolate(Camera& a, Camera& b, double alpha)
-{
-	// Interpolate all the properties for the camera. We simply interpolate the 3
-	// camera vectors, and recompute the lookat matrix each frame
-	position = lerp(a.position, b.position, alpha);
-	lookat = lerp(a.lookat, b.lookat, alpha);
-	up = lerp(a.up, b.up, alpha);
-	fov = lerp(a.fov, b.fov, alpha);
-}
-
-void Plane::parseProperty(std::string& name, Tokenizer& tokenizer)
-{
-	if (name == "point") {
-		point = {
-			tokenizer.nextDouble(),
-			tokenizer.nextDouble(),
-			tokenizer.nextDouble(),
-		};
-	}
-	else if (name == "normal") {
-		norm = glm::normalize(glm::dvec3{
-			tokenizer.nextDouble(),
-			tokenizer.nextDouble(),
-			tokenizer.nextDouble(),
-		});
-	}
-	else if (name == "diffuse") {
-		material.diffuse = {
-			tokenizer.nextDouble(),
-			tokenizer.nextDouble(),
-			tokenizer.nextDouble(),
-		};
-
-	}
-	else if (name == "specular") {
-		material.specular = {
-			tokenizer.nextDouble(),
-			tokenizer.nextDouble(),
-			tokenizer.nextDouble(),
-		};
-	}
-	else if (name == "shininess") {
-		material.shininess = tokenizer.nextDouble();
-	}
-	else {
-		tokenizer.discardLine();
-		std::cout << "Unknown property \"" << name << "\"" << std::endl;
-	}
-}
-
-std::optional<Intersection> Triangle::intersect(glm::dvec3 origin, glm::dvec3 direction)
-{
-	// The formula used for calculating the interesection with a triangle was given
-	// in the class slides. 
-
-	glm::dvec3 p = v2 - v1;
-	glm::dvec3 q = v3 - v1;
-	glm::dvec3 tmp1 = glm::cross(direction, q);
-	double dot1 = glm::dot(tmp1, p);
-
-	if (dot1 > -EPSILON && dot1 < EPSILON)
-		return std::optional<Intersection>();
-
-	double f = 1.0 / dot1;
-	glm::dvec3 s = origin - v1;
-	double u = f * glm::dot(s, tmp1);
-	
-	if (u < 0.0f || u > 1.0f)
-		return std::optional<Intersection>();
-
-	glm::dvec3 tmp2 = glm::cross(s, p);
-	double v = f * glm::dot(direction, tmp2);
-	if(v < 0.0f || u + v > 1.0f)
-		return std::optional<Intersection>();
-
-	double t = f * dot(q, tmp2);
-
-	//We have an intersection
-	glm::dvec3 point = (1 - u - v) * v1 + u * v2 + v * v3;
-	
-	// Calculate the time value along the ray that the intersection occurs.
-	double rayTime = glm::dot(point - origin, direction);
-
-	return std::optional<Intersection>({
-		&material,
-		point,
-		norm,
-		rayTime
-	});
-}
-
-void Triangle::parseProperty(std::string& name, Tokenizer& tokenizer)
-{
-	if (name == "v1") {
-		v1 = {
-			tokenizer.nextDouble(),
-			tokenizer.nextDouble(),
-			tokenizer.nextDouble(),
-		};
-		norm = glm::normalize(glm::cross(v2 - v1, v3 - v1));
-	}
-	else if (name == "v2") {
-		v2 = {
-			tokenizer.nextDouble(),
-			tokenizer.nextDouble(),
-			tokenizer.nextDouble(),
-		};
-		norm = glm::normalize(glm::cross(v2 - v1, v3 - v1));
-	}
-	else if (name == "v3") {
-		v3 = {
-			tokenizer.nextDouble(),
-			tokenizer.nextDouble(),
-			tokenizer.nextDouble(),
-		};
-		norm = glm::normalize(glm::cross(v2 - v1, v3 - v1));
-	}
-	else if (name == "diffuse") {
-		material.diffuse = {
-			tokenizer.nextDouble(),
-			tokenizer.nextDouble(),
-			tokenizer.nextDouble(),
-		};
-
-	}
-	else if (name == "specular") {
-		material.specular = {
-			tokenizer.nextDouble(),
-			tokenizer.nextDouble(),
-			tokenizer.nextDouble(),
-		};
-	}
-	else if (name == "shininess") {
-		material.shininess = tokenizer.nextDouble();
-	}
-	else {
-		tokenizer.discardLine();
-		std::cout << "Unknown property \"" << name << "\"" << std::endl;
-	}
-}
-
-void Triangle::interpolate(Triangle& a, Triangle& b, double alpha)
-{
-	// Interpolate the properties common to all objects
-	Object::interpolate(a, b, alpha);
-
-	// Interpolate the position of the vertices
-	v1 = lerp(a.v1, b.v1, alpha);
-	v2 = lerp(a.v2, b.v2, alpha);
-	v3 = lerp(a.v3, b.v3, alpha);
-
-	// Since our vertices moved, we need to recompute the normal. This seemed better
-	// than interpolating the normals
-	norm = glm::normalize(glm::cross(v2 - v1, v3 - v1));
-}
-
-void Plane::interpolate(Object& a, Object& b, double alpha) {
-
-	// Interpolate properties common to all objects
-	Object::interpolate(a, b, alpha);
-
-	// Cast the objects to planes
-	Plane& ca = static_cast<Plane&>(a);
-	Plane& cb = static_cast<Plane&>(b);
-
-	// Interpolate the point and normal of the planes
-	point = lerp(ca.point, cb.point, alpha);
-	norm = glm::normalize(lerp(ca.norm, cb.norm, alpha));
-}
-
-void Light::parseProperty(std::string& name, Tokenizer& tokenizer)
-{
-	if (name == "position") {
-		position = {
-			tokenizer.nextDouble(),
-			tokenizer.nextDouble(),
-			tokenizer.nextDouble(),
-		};
-	}
-	else if (name == "diffuse") {
-		diffuse = {
-			tokenizer.nextDouble(),
-			tokenizer.nextDouble(),
-			tokenizer.nextDouble(),
-		};
-	}
-	else if (name == "specular") {
-		specular = {
-			tokenizer.nextDouble(),
-			tokenizer.nextDouble(),
-			tokenizer.nextDouble(),
-		};
-	}
-	else {
-		tokenizer.discardLine();
-		std::cout << "Unknown property \"" << name << "\"" << std::endl;
-	}
-}
-
-void Light::interpolate(Light& a, Light& b, double alpha)
-{
-	// Interpolate the values for the light. 
-	position = lerp(a.position , b.position , alpha);
-	diffuse = lerp(a.diffuse , b.diffuse , alpha);
-	specular = lerp(a.specular, b.specular, alpha);
-}
+#include "Objects.hpp"
+
+#include <limits>
+#include <algorithm>
+#include <iostream>
+#include <cstring>
+#include <glm/glm.hpp>
+
+#include "MappedFile.hpp"
+#include "Parser.hpp"
+#include "SphereGrid.hpp"
+#include "Structures.hpp"
+
+/**
+ * Helper template function for linearly interpolating between values
+ * 
+ * \param a		The starting value
+ * \param b		The ending value
+ * \param alpha A time value (typically between 0 and 1) for interpolation
+ * \return		The interpolated value
+ */
+template<typename T>
+T lerp(T a, T b, double alpha)
+{
+	// Values that do not change between keyframes are returned exactly, so that 
+	// static objects stay bit-for-bit identical across interpolated frames
+	if (a == b)
+		return a;
+
+	return (1 - alpha) * a + alpha * b;
+}
+
+void Object::parseProperty(std::string& name, Tokenizer& tokenizer, MaterialTable& table)
+{
+	// Since a generic object doesn't have any properties, discard the line
+	tokenizer.discardLine();
+}
+
+void Object::interpolate(Object& a, Object& b, double alpha)
+{
+	// Materials are interpolated once for the whole frame, which then points the
+	// object at the blended entry of its table
+	material = a.material;
+}
+
+bool Object::equals(Object& other)
+{
+	return type == other.type && material == other.material;
+}
+
+std::optional<Intersection> Object::intersect(glm::dvec3 origin, glm::dvec3 direction)
+{
+	std::optional<Hit> found = hit(origin, direction);
+
+	if (!found.has_value())
+		return std::optional<Intersection>();
+
+	return attributes(origin, direction, found.value());
+}
+
+Intersection Object::attributes(glm::dvec3 origin, glm::dvec3 direction, const Hit& hit)
+{
+	return { material, origin + hit.t * direction, glm::dvec3(0.0), hit.t };
+}
+
+Intersection Sphere::attributes(glm::dvec3 orig, glm::dvec3 dir, const Hit& hit)
+{
+	glm::dvec3 point = orig + hit.t * dir;
+
+	return {
+		material,
+		point,
+		glm::normalize(point - position),
+		hit.t
+	};
+}
+
+void Sphere::parseProperty(std::string& name, Tokenizer& tokenizer, MaterialTable& table)
+{
+	if (name == "position") {
+		// Read in 3 doubles for the position
+		position = {
+			tokenizer.nextDouble(),
+			tokenizer.nextDouble(),
+			tokenizer.nextDouble(),
+		};
+	}
+	else if (name == "radius") {
+		radius = tokenizer.nextDouble();
+	}
+	else {
+		// If our property is unkown, discard the line and pretend like there is no issue
+		tokenizer.discardLine();
+		std::cout << "Unknown property \"" << name << "\"" << std::endl;
+	}
+}
+
+void Sphere::interpolate(Object& a, Object& b, double alpha)
+{
+	// First, cast each object to a sphere object. Each object should be a sphere
+	Sphere& ca = static_cast<Sphere&>(a);
+	Sphere& cb = static_cast<Sphere&>(b);
+
+	// Interpolate the object properties
+	Object::interpolate(a, b, alpha);
+	
+	// Interpolate the sphere properties
+	position = lerp(ca.position, cb.position, alpha);
+	radius = lerp(ca.radius, cb.radius, alpha);
+}
+
+BoundingBox Sphere::bounds()
+{
+	return { position - radius, position + radius };
+}
+
+bool Sphere::equals(Object& other)
+{
+	if (!Object::equals(other))
+		return false;
+
+	Sphere& sphere = static_cast<Sphere&>(other);
+	return position == sphere.position && radius == sphere.radius;
+}
+
+Intersection Plane::attributes(glm::dvec3 origin, glm::dvec3 direction, const Hit& hit)
+{
+	return {
+		material,
+		origin + direction * hit.t,
+		norm,
+		hit.t
+	};
+}
+
+/**
+ * The grid the particles of a set are traced through, and the particles too
+ * large to go in it
+ */
+struct ParticleGrid
+{
+	/// The grid over the particles
+	SphereGrid			grid;
+
+	/// The indices of the particles left out of the grid
+	std::vector<int>	large;
+};
+
+/**
+ * The start of a particle file
+ */
+struct ParticleFileHeader
+{
+	/// The characters "PRTS"
+	char		magic[4];
+
+	/// The version of the format, which is 1
+	uint32_t	version;
+
+	/// The number of particles in the file
+	uint64_t	count;
+};
+
+std::optional<Hit> Particles::hit(glm::dvec3 origin, glm::dvec3 direction)
+{
+	if (grid == nullptr)
+		return std::optional<Hit>();
+
+	uint64_t tests = 0;
+	double t = std::numeric_limits<double>::infinity();
+	int closest = grid->grid.closest(origin, direction, t, t, tests);
+
+	for (int index : grid->large) {
+		glm::dvec3 center(positions[3 * index], positions[3 * index + 1], positions[3 * index + 2]);
+		double distance = Sphere::distance(origin, direction, center, radii[index]);
+
+		if (distance < t) {
+			t = distance;
+			closest = index;
+		}
+	}
+
+	if (closest < 0)
+		return std::optional<Hit>();
+
+	return Hit{ this, t, closest, 0.0, 0.0 };
+}
+
+Intersection Particles::attributes(glm::dvec3 origin, glm::dvec3 direction, const Hit& hit)
+{
+	int index = hit.primitive;
+	glm::dvec3 center(positions[3 * index], positions[3 * index + 1], positions[3 * index + 2]);
+	glm::dvec3 point = origin + hit.t * direction;
+
+	return {
+		materialOf(index),
+		point,
+		glm::normalize(point - center),
+		hit.t
+	};
+}
+
+void Particles::parseProperty(std::string& name, Tokenizer& tokenizer, MaterialTable& table)
+{
+	if (name == "file") {
+		std::string path = tokenizer.nextToken();
+
+		// Paths with spaces are quoted
+		if (path.size() >= 2 && path.front() == '\"' && path.back() == '\"')
+			path = path.substr(1, path.size() - 2);
+
+		load(path);
+	}
+	else if (name == "material") {
+		// An index into the list of materials, then the diffuse color, specular
+		// color and shininess of that material
+		int index = tokenizer.nextInt();
+		Material entry;
+		entry.diffuse = { tokenizer.nextDouble(), tokenizer.nextDouble(), tokenizer.nextDouble() };
+		entry.specular = { tokenizer.nextDouble(), tokenizer.nextDouble(), tokenizer.nextDouble() };
+		entry.shininess = tokenizer.nextDouble();
+
+		if (index < 0) {
+			std::cerr << "Invalid material index " << index << std::endl;
+			return;
+		}
+
+		if ((size_t)index >= materials.size())
+			materials.resize(index + 1, material);
+		materials[index] = table.add(entry);
+	}
+	else {
+		tokenizer.discardLine();
+		std::cout << "Unknown property \"" << name << "\"" << std::endl;
+	}
+}
+
+void Particles::interpolate(Object& a, Object& b, double alpha)
+{
+	Particles& pa = static_cast<Particles&>(a);
+	Particles& pb = static_cast<Particles&>(b);
+
+	Object::interpolate(a, b, alpha);
+
+	// The list refers to the start frame's table of materials, and is blended or
+	// mapped into the new frame's table along with the object's own material
+	materials = pa.materials;
+
+	// Particles that do not move share their storage and grid with the keyframe,
+	// which also keeps them equal to it for incremental rendering
+	bool still = pa.positions == pb.positions && pa.radii == pb.radii;
+
+	if (!still && pa.count != pb.count)
+		std::cerr << "Cannot interpolate between " << pa.count << " and " << pb.count << " particles" << std::endl;
+
+	if (still || pa.count != pb.count) {
+		count = pa.count;
+		positions = pa.positions;
+		radii = pa.radii;
+		materialIds = pa.materialIds;
+		file = pa.file;
+		arrays = pa.arrays;
+		grid = pa.grid;
+		box = pa.box;
+		return;
+	}
+
+	// Materials cannot be blended per particle, so they are taken from the start
+	auto interpolated = std::make_shared<ParticleArrays>();
+	interpolated->positions.resize(3 * pa.count);
+	interpolated->radii.resize(pa.count);
+	interpolated->materials.assign(pa.materialIds, pa.materialIds + pa.count);
+
+	int64_t n = (int64_t)pa.count;
+
+	#pragma omp parallel for
+	for (int64_t i = 0; i < n; i++) {
+		for (int axis = 0; axis < 3; axis++)
+			interpolated->positions[3 * i + axis] = (float)lerp((double)pa.positions[3 * i + axis], (double)pb.positions[3 * i + axis], alpha);
+		interpolated->radii[i] = (float)lerp((double)pa.radii[i], (double)pb.radii[i], alpha);
+	}
+
+	file = nullptr;
+	assign(interpolated);
+}
+
+BoundingBox Particles::bounds()
+{
+	return box;
+}
+
+bool Particles::equals(Object& other)
+{
+	if (!Object::equals(other))
+		return false;
+
+	Particles& particles = static_cast<Particles&>(other);
+	return count == particles.count && positions == particles.positions && radii == particles.radii &&
+		   materialIds == particles.materialIds && materials == particles.materials;
+}
+
+bool Particles::load(const std::string& path)
+{
+	std::shared_ptr<MappedFile> mapped = MappedFile::open(path);
+	if (mapped == nullptr)
+		return false;
+
+	ParticleFileHeader header;
+	if (mapped->size() < sizeof(header)) {
+		std::cerr << "\"" << path << "\" is too small to be a particle file" << std::endl;
+		return false;
+	}
+
+	std::memcpy(&header, mapped->data(), sizeof(header));
+	if (std::memcmp(header.magic, "PRTS", 4) != 0 || header.version != 1) {
+		std::cerr << "\"" << path << "\" is not a particle file" << std::endl;
+		return false;
+	}
+
+	// Each particle takes three floats for its center, one for its radius and one
+	// integer for its material
+	const size_t particleSize = 5 * sizeof(float);
+	if (header.count > (mapped->size() - sizeof(header)) / particleSize ||
+		sizeof(header) + header.count * particleSize != mapped->size()) {
+		std::cerr << "\"" << path << "\" should hold " << header.count << " particles, but is "
+				  << mapped->size() << " bytes" << std::endl;
+		return false;
+	}
+
+	const uint8_t* data = mapped->data() + sizeof(header);
+	count = (size_t)header.count;
+	positions = (const float*)data;
+	radii = positions + 3 * count;
+	materialIds = (const uint32_t*)(radii + count);
+
+	file = mapped;
+	arrays = nullptr;
+	precompute();
+
+	std::cout << "Mapped " << count << " particles from \"" << path << "\"" << std::endl;
+	return true;
+}
+
+void Particles::assign(std::shared_ptr<const ParticleArrays> particles)
+{
+	count = particles->radii.size();
+	positions = particles->positions.data();
+	radii = particles->radii.data();
+	materialIds = particles->materials.data();
+
+	arrays = particles;
+	precompute();
+}
+
+uint32_t Particles::materialOf(size_t index)
+{
+	uint32_t id = materialIds[index];
+	return id < materials.size() ? materials[id] : material;
+}
+
+void Particles::precompute()
+{
+	std::vector<glm::dvec4> spheres(count);
+	BoundingBox bounds;
+
+	int64_t n = (int64_t)count;
+
+	#pragma omp parallel
+	{
+		BoundingBox local;
+
+		#pragma omp for
+		for (int64_t i = 0; i < n; i++) {
+			spheres[i] = glm::dvec4(positions[3 * i], positions[3 * i + 1], positions[3 * i + 2], radii[i]);
+			local.extend(glm::dvec3(spheres[i]) - spheres[i].w);
+			local.extend(glm::dvec3(spheres[i]) + spheres[i].w);
+		}
+
+		#pragma omp critical
+		bounds.extend(local);
+	}
+
+	box = bounds;
+
+	auto built = std::make_shared<ParticleGrid>();
+	built->grid = SphereGrid(std::move(spheres), built->large);
+	grid = built;
+}
+
+void Camera::parseProperty(std::string& name, Tokenizer& tokenizer)
+{
+	if (name == "position") {
+		position = {
+			tokenizer.nextDouble(),
+			tokenizer.nextDouble(),
+			tokenizer.nextDouble(),
+		};
+	}
+	else if (name == "lookat") {
+		lookat = {
+			tokenizer.nextDouble(),
+			tokenizer.nextDouble(),
+			tokenizer.nextDouble(),
+		};
+	}
+	else if (name == "up") {
+		up = {
+			tokenizer.nextDouble(),
+			tokenizer.nextDouble(),
+			tokenizer.nextDouble(),
+		};
+	}
+	else if (name == "fov") {
+		fov = tokenizer.nextDouble();
+	}
+	else {
+		tokenizer.discardLine();
+		std::cout << "Unknown property \"" << name << "\"" << std::endl;
+	}
+}
+
+void Camera::interpolate(Camera& a, Camera& b, double alpha)
+{
+	// Interpolate all the properties for the camera. We simply interpolate the 3
+	// camera vectors, and recompute the lookat matrix each frame
+	position = lerp(a.position, b.position, alpha);
+	lookat = lerp(a.lookat, b.lookat, alpha);
+	up = lerp(a.up, b.up, alpha);
+	fov = lerp(a.fov, b.fov, alpha);
+}
+
+bool Camera::equals(Camera& other)
+{
+	return position == other.position && lookat == other.lookat && up == other.up && fov == other.fov;
+}
+
+void Plane::parseProperty(std::string& name, Tokenizer& tokenizer, MaterialTable& table)
+{
+	if (name == "point") {
+		point = {
+			tokenizer.nextDouble(),
+			tokenizer.nextDouble(),
+			tokenizer.nextDouble(),
+		};
+	}
+	else if (name == "normal") {
+		norm = glm::normalize(glm::dvec3{
+			tokenizer.nextDouble(),
+			tokenizer.nextDouble(),
+			tokenizer.nextDouble(),
+		});
+	}
+	else {
+		tokenizer.discardLine();
+		std::cout << "Unknown property \"" << name << "\"" << std::endl;
+	}
+}
+
+bool Triangle::watertight = false;
+
+Intersection Triangle::attributes(glm::dvec3 origin, glm::dvec3 direction, const Hit& hit)
+{
+	return {
+		material,
+		origin + hit.t * direction,
+		norm,
+		hit.t
+	};
+}
+
+std::optional<Hit> Triangle::hitWatertight(glm::dvec3 origin, glm::dvec3 direction)
+{
+	// Make the largest component of the direction the z axis. Swapping the other
+	// two axes when it is negative keeps the winding of the triangle the same.
+	glm::dvec3 size = glm::abs(direction);
+	int kz = size.x > size.y ? (size.x > size.z ? 0 : 2) : (size.y > size.z ? 1 : 2);
+	int kx = (kz + 1) % 3;
+	int ky = (kx + 1) % 3;
+
+	if (direction[kz] < 0.0)
+		std::swap(kx, ky);
+
+	// The shear that maps the ray onto the z axis
+	double sx = direction[kx] / direction[kz];
+	double sy = direction[ky] / direction[kz];
+	double sz = 1.0 / direction[kz];
+
+	glm::dvec3 a = v1 - origin;
+	glm::dvec3 b = v2 - origin;
+	glm::dvec3 c = v3 - origin;
+
+	double ax = a[kx] - sx * a[kz], ay = a[ky] - sy * a[kz];
+	double bx = b[kx] - sx * b[kz], by = b[ky] - sy * b[kz];
+	double cx = c[kx] - sx * c[kz], cy = c[ky] - sy * c[kz];
+
+	// The edge functions. The ray hits if they all have the same sign, and a value
+	// of exactly zero on a shared edge counts as a hit for both triangles.
+	double u = cx * by - cy * bx;
+	double v = ax * cy - ay * cx;
+	double w = bx * ay - by * ax;
+
+	if ((u < 0.0 || v < 0.0 || w < 0.0) && (u > 0.0 || v > 0.0 || w > 0.0))
+		return std::optional<Hit>();
+
+	double det = u + v + w;
+	if (det == 0.0)
+		return std::optional<Hit>();
+
+	double t = (u * sz * a[kz] + v * sz * b[kz] + w * sz * c[kz]) / det;
+	if (t <= EPSILON)
+		return std::optional<Hit>();
+
+	// The edge functions of the second and third vertices, scaled by their sum,
+	// are the barycentrics that weight those vertices
+	return Hit{ this, t, 0, v / det, w / det };
+}
+
+void Triangle::precompute()
+{
+	e1 = v2 - v1;
+	e2 = v3 - v1;
+	norm = glm::normalize(glm::cross(e1, e2));
+}
+
+void Triangle::parseProperty(std::string& name, Tokenizer& tokenizer, MaterialTable& table)
+{
+	if (name == "v1") {
+		v1 = {
+			tokenizer.nextDouble(),
+			tokenizer.nextDouble(),
+			tokenizer.nextDouble(),
+		};
+		precompute();
+	}
+	else if (name == "v2") {
+		v2 = {
+			tokenizer.nextDouble(),
+			tokenizer.nextDouble(),
+			tokenizer.nextDouble(),
+		};
+		precompute();
+	}
+	else if (name == "v3") {
+		v3 = {
+			tokenizer.nextDouble(),
+			tokenizer.nextDouble(),
+			tokenizer.nextDouble(),
+		};
+		precompute();
+	}
+	else {
+		tokenizer.discardLine();
+		std::cout << "Unknown property \"" << name << "\"" << std::endl;
+	}
+}
+
+void Triangle::interpolate(Object& a, Object& b, double alpha)
+{
+	// Each object should be a triangle
+	Triangle& ca = static_cast<Triangle&>(a);
+	Triangle& cb = static_cast<Triangle&>(b);
+
+	// Interpolate the properties common to all objects
+	Object::interpolate(a, b, alpha);
+
+	// Interpolate the position of the vertices
+	v1 = lerp(ca.v1, cb.v1, alpha);
+	v2 = lerp(ca.v2, cb.v2, alpha);
+	v3 = lerp(ca.v3, cb.v3, alpha);
+
+	// Since our vertices moved, we need to recompute the normal and edges. This
+	// seemed better than interpolating the normals
+	precompute();
+}
+
+BoundingBox Triangle::bounds()
+{
+	return { glm::min(v1, glm::min(v2, v3)), glm::max(v1, glm::max(v2, v3)) };
+}
+
+bool Triangle::equals(Object& other)
+{
+	if (!Object::equals(other))
+		return false;
+
+	Triangle& triangle = static_cast<Triangle&>(other);
+	return v1 == triangle.v1 && v2 == triangle.v2 && v3 == triangle.v3;
+}
+
+void Plane::interpolate(Object& a, Object& b, double alpha) {
+
+	// Interpolate properties common to all objects
+	Object::interpolate(a, b, alpha);
+
+	// Cast the objects to planes
+	Plane& ca = static_cast<Plane&>(a);
+	Plane& cb = static_cast<Plane&>(b);
+
+	// Interpolate the point and normal of the planes
+	point = lerp(ca.point, cb.point, alpha);
+	norm = glm::normalize(lerp(ca.norm, cb.norm, alpha));
+}
+
+bool Plane::equals(Object& other)
+{
+	if (!Object::equals(other))
+		return false;
+
+	Plane& plane = static_cast<Plane&>(other);
+	return point == plane.point && norm == plane.norm;
+}
+
+void Light::parseProperty(std::string& name, Tokenizer& tokenizer)
+{
+	if (name == "position") {
+		position = {
+			tokenizer.nextDouble(),
+			tokenizer.nextDouble(),
+			tokenizer.nextDouble(),
+		};
+	}
+	else if (name == "diffuse") {
+		diffuse = {
+			tokenizer.nextDouble(),
+			tokenizer.nextDouble(),
+			tokenizer.nextDouble(),
+		};
+	}
+	else if (name == "specular") {
+		specular = {
+			tokenizer.nextDouble(),
+			tokenizer.nextDouble(),
+			tokenizer.nextDouble(),
+		};
+	}
+	else if (name == "attenuation") {
+		attenuation = {
+			tokenizer.nextDouble(),
+			tokenizer.nextDouble(),
+			tokenizer.nextDouble(),
+		};
+	}
+	else if (name == "radius") {
+		radius = tokenizer.nextDouble();
+	}
+	else {
+		tokenizer.discardLine();
+		std::cout << "Unknown property \"" << name << "\"" << std::endl;
+	}
+}
+
+double Light::falloff(double distance) const
+{
+	double factor = 1.0 / (attenuation.x + attenuation.y * distance + attenuation.z * distance * distance);
+
+	// Fade the light out smoothly towards the radius, so there is no visible edge
+	// where it is cut off
+	if (radius > 0.0) {
+		double ratio = distance / radius;
+		double window = glm::clamp(1.0 - ratio * ratio * ratio * ratio, 0.0, 1.0);
+		factor *= window * window;
+	}
+
+	return factor;
+}
+
+double Light::range(double threshold) const
+{
+	// A white surface reflects both the diffuse and the specular color in full
+	double brightest = std::max({ diffuse.r, diffuse.g, diffuse.b }) + std::max({ specular.r, specular.g, specular.b });
+	double limit = radius > 0.0 ? radius : std::numeric_limits<double>::infinity();
+
+	if (brightest <= 0.0)
+		return 0.0;
+
+	double l = attenuation.y;
+	double q = attenuation.z;
+
+	// Without attenuation that grows with the distance, the light is as bright
+	// everywhere up to its radius
+	if (l < 0.0 || q < 0.0 || (l == 0.0 && q == 0.0))
+		return limit;
+
+	// Solve c + l * d + q * d^2 = brightest / threshold for the distance d at which
+	// the attenuation alone dims the light below the threshold
+	double c = attenuation.x - brightest / threshold;
+
+	if (c >= 0.0)
+		return 0.0;
+
+	if (q > 0.0)
+		limit = glm::min(limit, (-l + glm::sqrt(l * l - 4.0 * q * c)) / (2.0 * q));
+	else if (l > 0.0)
+		limit = glm::min(limit, -c / l);
+
+	return limit;
+}
+
+void Light::interpolate(Light& a, Light& b, double alpha)
+{
+	// Interpolate the values for the light. 
+	position = lerp(a.position , b.position , alpha);
+	diffuse = lerp(a.diffuse , b.diffuse , alpha);
+	specular = lerp(a.specular, b.specular, alpha);
+	attenuation = lerp(a.attenuation, b.attenuation, alpha);
+	radius = lerp(a.radius, b.radius, alpha);
+}
+
+bool Light::equals(Light& other)
+{
+	return position == other.position && diffuse == other.diffuse && specular == other.specular
+		&& attenuation == other.attenuation && radius == other.radius;
+}
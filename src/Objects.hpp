@@ -1,253 +1,811 @@
-#ifndef OBJECTS_HPP
-#define OBJECTS_HPP
-
-#include <optional>
-#include <string>
-#include <glm/glm.hpp>
-
-#include "Structures.hpp"
-
-// Forward declaration for the tokenizer
-class Tokenizer;
-
-/**
- * Abstract class representing an object in the scene
- */
-class Object
-{
-public:	
-	/**
-	 * Check where, if any, intersection between the object and a ray occurs
-	 * 
-	 * \param origin		The origin of the ray
-	 * \param direction		The direction of the ray
-	 * \return				The intersection info, or std::nullopt if no intersection exists
-	 */
-	virtual std::optional<Intersection> intersect(glm::dvec3 origin, glm::dvec3 direction) {
-		return std::optional<Intersection>();
-	}
-	
-	/**
-	 * Parses a property for the given object. This allows each object to have its own
-	 * set of properties in the scene file
-	 * 
-	 * \param name		The name of the property
-	 * \param tokenizer	The tokenizer for the scene file
-	 */
-	virtual void parseProperty(std::string& name, Tokenizer& tokenizer);
-
-	/// The string identifier given to this object. Used for the interpolation code
-	std::string	name;
-
-	/**
-	 * Sets this object's properties as the linear interpolation between the two passed objects.
-	 * This allows for keyframing within the scene
-	 * 
-	 * \param a		The starting object state
-	 * \param b		The ending object state
-	 * \param alpha	The time value, between 0 and 1, for the interpolation
-	 */
-	virtual void interpolate(Object& a, Object& b, double alpha);
-
-	// The material used for rendering this object
-	Material	material;
-};
-
-/**
- * A sphere that can appear in the scene
- */
-class Sphere : public Object
-{
-public:
-
-	/**
-	 * Check where, if any, intersection between the sphere and a ray occurs
-	 *
-	 * \param origin		The origin of the ray
-	 * \param direction		The direction of the ray
-	 * \return				The intersection info, or std::nullopt if no intersection exists
-	 */
-	std::optional<Intersection> intersect(glm::dvec3 origin, glm::dvec3 direction);
-
-	/**
-	 * Parses a property for the sphere. This allows each object to have its own
-	 * properties in the scene file
-	 *
-	 * \param name		The name of the property
-	 * \param tokenizer	The tokenizer for the scene file
-	 */
-	void parseProperty(std::string& name, Tokenizer& tokenizer);
-	
-	/**
-	 * Sets this object's properties as the linear interpolation between the two passed objects.
-	 * This allows for keyframing within the scene
-	 *
-	 * \param a		The starting object state
-	 * \param b		The ending object state
-	 * \param alpha	The time value, between 0 and 1, for the interpolation
-	 */
-	void interpolate(Object& a, Object& b, double alpha);
-
-	/// The position of the center of the sphere in space
-	glm::dvec3	position{0.0, 0.0, 0.0};
-
-	/// The radius of the sphere
-	double		radius{1.0};
-};
-
-/**
- * A plane that can appear in the scene
- */
-class Plane : public Object
-{
-public:
-	/**
-	 * Check where, if any, intersection between the plane and a ray occurs
-	 *
-	 * \param origin		The origin of the ray
-	 * \param direction		The direction of the ray
-	 * \return				The intersection info, or std::nullopt if no intersection exists
-	 */
-	std::optional<Intersection> intersect(glm::dvec3 origin, glm::dvec3 direction);
-
-	/**
-	 * Parses a property for the plane. This allows each object to have its own
-	 * set of properties in the scene file
-	 *
-	 * \param name		The name of the property
-	 * \param tokenizer	The tokenizer for the scene file
-	 */
-	void parseProperty(std::string& name, Tokenizer& tokenizer);
-
-	/**
-	 * Sets this object's properties as the linear interpolation between the two passed objects.
-	 * This allows for keyframing within the scene
-	 *
-	 * \param a		The starting object state
-	 * \param b		The ending object state
-	 * \param alpha	The time value, between 0 and 1, for the interpolation
-	 */
-	void interpolate(Object& a, Object& b, double alpha);
-
-	/// A point on the plane
-	glm::dvec3	point{0.0, 0.0, 0.0};
-
-	/// The normal vector to the plane
-	glm::dvec3	norm{0.0, 1.0, 0.0};
-};
-
-/**
- * A triangle that can appear in the scene
- */
-class Triangle : public Object
-{
-public:
-	/**
-	 * Check where, if any, intersection between the triangle and a ray occurs
-	 *
-	 * \param origin		The origin of the ray
-	 * \param direction		The direction of the ray
-	 * \return				The intersection info, or std::nullopt if no intersection exists
-	 */
-	std::optional<Intersection> intersect(glm::dvec3 origin, glm::dvec3 direction);
-
-	/**
-	 * Parses a property for the triangle. This allows each object to have its own
-	 * set of properties in the scene file
-	 *
-	 * \param name		The name of the property
-	 * \param tokenizer	The tokenizer for the scene file
-	 */
-	void parseProperty(std::string& name, Tokenizer& tokenizer);
-
-	/**
-	 * Sets this object's properties as the linear interpolation between the two passed objects.
-	 * This allows for keyframing within the scene
-	 *
-	 * \param a		The starting object state
-	 * \param b		The ending object state
-	 * \param alpha	The time value, between 0 and 1, for the interpolation
-	 */
-	void interpolate(Triangle& a, Triangle& b, double alpha);
-
-	/// The three vertices for the triangle
-	glm::dvec3	v1{ -1, -1, 0 }, v2{1, -1, 0}, v3{0, 1, 0};
-	
-	/// The precomputed normal for the triangle
-	glm::dvec3	norm{0, 0, -1};
-};
-
-/**
- * Represents the camera in the scene
- */
-class Camera
-{
-public:
-	/// The current position of the camera
-	glm::dvec3	position{0.0, 0.0, 0.0};	
-	
-	/// The point that the camera is looking at
-	glm::dvec3	lookat{0.0, 1.0, 0.0};
-	
-	/// The up vector used to calculate the lookat matrix
-	glm::dvec3	up{0.0, 1.0, 0.0};
-
-	/// The vertical field of view for the camera
-	double		fov{90.0};
-
-	/**
-	 * Sets this object's properties as the linear interpolation between the two passed objects.
-	 * This allows for keyframing within the scene
-	 *
-	 * \param a		The starting object state
-	 * \param b		The ending object state
-	 * \param alpha	The time value, between 0 and 1, for the interpolation
-	 */
-	void interpolate(Camera& a, Camera& b, double alpha);
-
-	/**
-	 * Parses a property for the camera. This allows each object to have its own
-	 * set of properties in the scene file
-	 *
-	 * \param name		The name of the property
-	 * \param tokenizer	The tokenizer for the scene file
-	 */
-	void parseProperty(std::string& name, Tokenizer& tokenizer);
-};
-
-/**
- * Represents a light within the scene
- */
-class Light
-{
-public:
-	/// The position of the light
-	glm::dvec3	position;
-
-	/// The light's diffuse color
-	glm::dvec3	diffuse;
-
-	/// The light's specular color
-	glm::dvec3	specular;
-
-	/**
-	 * Sets this object's properties as the linear interpolation between the two passed objects.
-	 * This allows for keyframing within the scene.
-	 *
-	 * \param a		The starting object state
-	 * \param b		The ending object state
-	 * \param alpha	The time value, between 0 and 1, for the interpolation
-	 */
-	void interpolate(Light& a, Light& b, double alpha);
-
-	/**
-	 * Parses a property for the light. This allows each object to have its own
-	 * set of properties in the scene file.
-	 *
-	 * \param name		The name of the property
-	 * \param tokenizer	The tokenizer for the scene file
-	 */
-	void parseProperty(std::string& name, Tokenizer& tokenizer);
-};
-
-#endif//OBJECTS_HPP
+#ifndef OBJECTS_HPP
+#define OBJECTS_HPP
+
+#include <optional>
+#include <limits>
+#include <utility>
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <glm/glm.hpp>
+
+#include "Structures.hpp"
+
+/// The epsilon distance for comparing if two floating point numbers are close
+/// enough to be equal
+const double EPSILON = 1e-8;
+
+// Forward declaration for the tokenizer
+class Tokenizer;
+
+// Forward declarations for the storage of particles
+class MappedFile;
+struct ParticleGrid;
+
+/**
+ * The kinds of object that can appear in the scene. The set is closed, so code
+ * that needs to know the kind of an object switches on it with visitObject()
+ * instead of making a virtual call.
+ */
+enum class ObjectType
+{
+	SPHERE,
+	PLANE,
+	TRIANGLE,
+	PARTICLES,
+};
+
+/**
+ * Abstract class representing an object in the scene
+ */
+class Object
+{
+public:	
+	/**
+	 * Creates an object of the given kind. Only called by the constructors of
+	 * the kinds of object.
+	 * 
+	 * \param type		The kind of the object
+	 */
+	explicit Object(ObjectType type) : type(type) {}
+
+	Object(const Object& other) = default;
+
+	virtual ~Object() = default;
+
+	/**
+	 * Copies the properties common to all objects from another object, which may
+	 * be of a different kind. The kind of this object is kept.
+	 * 
+	 * \param other		The object to copy from
+	 * \return			This object
+	 */
+	Object& operator=(const Object& other) {
+		name = other.name;
+		material = other.material;
+		return *this;
+	}
+
+	/// The kind of the object, which is the class it was created as
+	const ObjectType	type;
+
+	/**
+	 * Check where, if any, intersection between the object and a ray occurs.
+	 * This is hit() followed by attributes().
+	 * 
+	 * \param origin		The origin of the ray
+	 * \param direction		The direction of the ray
+	 * \return				The intersection info, or std::nullopt if no intersection exists
+	 */
+	std::optional<Intersection> intersect(glm::dvec3 origin, glm::dvec3 direction);
+
+	/**
+	 * Check where, if any, the object is hit by a ray. Only the distance and what
+	 * is needed to find the rest of the intersection later are computed, since
+	 * most hits found while tracing a ray turn out not to be the closest.
+	 * 
+	 * \param origin		The origin of the ray
+	 * \param direction		The direction of the ray
+	 * \return				The hit, or std::nullopt if the ray misses
+	 */
+	virtual std::optional<Hit> hit(glm::dvec3 origin, glm::dvec3 direction) {
+		return std::optional<Hit>();
+	}
+
+	/**
+	 * Computes the point, normal and material of a hit found by hit(). Only called
+	 * for the closest hit of each ray.
+	 * 
+	 * \param origin		The origin of the ray
+	 * \param direction		The direction of the ray
+	 * \param hit			The hit
+	 * \return				The intersection info
+	 */
+	virtual Intersection attributes(glm::dvec3 origin, glm::dvec3 direction, const Hit& hit);
+	
+	/**
+	 * Parses a property for the given object. This allows each object to have its own
+	 * set of properties in the scene file. The diffuse, specular and shininess of
+	 * the object's material are read by the parser before this is called.
+	 * 
+	 * \param name		The name of the property
+	 * \param tokenizer	The tokenizer for the scene file
+	 * \param table		The frame's table of materials, for objects that add their own
+	 */
+	virtual void parseProperty(std::string& name, Tokenizer& tokenizer, MaterialTable& table);
+
+	/// The string identifier given to this object. Used for the interpolation code
+	std::string	name;
+
+	/**
+	 * Sets this object's properties as the linear interpolation between the two passed objects.
+	 * This allows for keyframing within the scene
+	 * 
+	 * \param a		The starting object state
+	 * \param b		The ending object state
+	 * \param alpha	The time value, between 0 and 1, for the interpolation
+	 */
+	virtual void interpolate(Object& a, Object& b, double alpha);
+
+	/**
+	 * Computes a box that contains the whole object. Objects that extend to
+	 * infinity return an infinite box.
+	 * 
+	 * \return				The bounding box of the object
+	 */
+	virtual BoundingBox bounds() {
+		return BoundingBox::infinite();
+	}
+
+	/**
+	 * Checks if the passed object is the same type as this object and has
+	 * exactly the same properties
+	 * 
+	 * \param other		The object to compare to
+	 * \return				True if both objects would render the same
+	 */
+	virtual bool equals(Object& other);
+
+	// The index of the material used for rendering this object in the frame's table
+	uint32_t	material = 0;
+};
+
+/**
+ * A sphere that can appear in the scene
+ */
+class Sphere final : public Object
+{
+public:
+	/**
+	 * Creates a sphere, whose properties are set by the scene file
+	 */
+	Sphere() : Object(ObjectType::SPHERE) {}
+
+	/**
+	 * Check where, if any, the sphere is hit by a ray
+	 *
+	 * \param origin		The origin of the ray
+	 * \param direction		The direction of the ray
+	 * \return				The hit, or std::nullopt if the ray misses
+	 */
+	std::optional<Hit> hit(glm::dvec3 origin, glm::dvec3 direction);
+
+	/**
+	 * Computes the point, normal and material of a hit found by hit()
+	 *
+	 * \param origin		The origin of the ray
+	 * \param direction		The direction of the ray
+	 * \param hit			The hit
+	 * \return				The intersection info
+	 */
+	Intersection attributes(glm::dvec3 origin, glm::dvec3 direction, const Hit& hit);
+
+	/**
+	 * Finds the distance along a ray to a sphere, with the same test as hit()
+	 *
+	 * \param origin		The origin of the ray
+	 * \param direction		The direction of the ray
+	 * \param position		The center of the sphere
+	 * \param radius		The radius of the sphere
+	 * \return				The distance, or infinity if the ray misses the sphere
+	 */
+	static double distance(glm::dvec3 origin, glm::dvec3 direction, glm::dvec3 position, double radius);
+
+	/**
+	 * Parses a property for the sphere. This allows each object to have its own
+	 * properties in the scene file
+	 *
+	 * \param name		The name of the property
+	 * \param tokenizer	The tokenizer for the scene file
+	 * \param table		The frame's table of materials, for objects that add their own
+	 */
+	void parseProperty(std::string& name, Tokenizer& tokenizer, MaterialTable& table);
+	
+	/**
+	 * Sets this object's properties as the linear interpolation between the two passed objects.
+	 * This allows for keyframing within the scene
+	 *
+	 * \param a		The starting object state
+	 * \param b		The ending object state
+	 * \param alpha	The time value, between 0 and 1, for the interpolation
+	 */
+	void interpolate(Object& a, Object& b, double alpha);
+
+	/**
+	 * Computes a box that contains the whole sphere
+	 *
+	 * \return				The bounding box of the sphere
+	 */
+	BoundingBox bounds();
+
+	/**
+	 * Checks if the passed object is a sphere with exactly the same properties
+	 *
+	 * \param other		The object to compare to
+	 * \return				True if both objects would render the same
+	 */
+	bool equals(Object& other);
+
+	/// The position of the center of the sphere in space
+	glm::dvec3	position{0.0, 0.0, 0.0};
+
+	/// The radius of the sphere
+	double		radius{1.0};
+};
+
+/**
+ * A plane that can appear in the scene
+ */
+class Plane final : public Object
+{
+public:
+	/**
+	 * Creates a plane, whose properties are set by the scene file
+	 */
+	Plane() : Object(ObjectType::PLANE) {}
+
+	/**
+	 * Check where, if any, the plane is hit by a ray
+	 *
+	 * \param origin		The origin of the ray
+	 * \param direction		The direction of the ray
+	 * \return				The hit, or std::nullopt if the ray misses
+	 */
+	std::optional<Hit> hit(glm::dvec3 origin, glm::dvec3 direction);
+
+	/**
+	 * Computes the point, normal and material of a hit found by hit()
+	 *
+	 * \param origin		The origin of the ray
+	 * \param direction		The direction of the ray
+	 * \param hit			The hit
+	 * \return				The intersection info
+	 */
+	Intersection attributes(glm::dvec3 origin, glm::dvec3 direction, const Hit& hit);
+
+	/**
+	 * Parses a property for the plane. This allows each object to have its own
+	 * set of properties in the scene file
+	 *
+	 * \param name		The name of the property
+	 * \param tokenizer	The tokenizer for the scene file
+	 * \param table		The frame's table of materials, for objects that add their own
+	 */
+	void parseProperty(std::string& name, Tokenizer& tokenizer, MaterialTable& table);
+
+	/**
+	 * Sets this object's properties as the linear interpolation between the two passed objects.
+	 * This allows for keyframing within the scene
+	 *
+	 * \param a		The starting object state
+	 * \param b		The ending object state
+	 * \param alpha	The time value, between 0 and 1, for the interpolation
+	 */
+	void interpolate(Object& a, Object& b, double alpha);
+
+	/**
+	 * Checks if the passed object is a plane with exactly the same properties
+	 *
+	 * \param other		The object to compare to
+	 * \return				True if both objects would render the same
+	 */
+	bool equals(Object& other);
+
+	/// A point on the plane
+	glm::dvec3	point{0.0, 0.0, 0.0};
+
+	/// The normal vector to the plane
+	glm::dvec3	norm{0.0, 1.0, 0.0};
+};
+
+/**
+ * A triangle that can appear in the scene
+ */
+class Triangle final : public Object
+{
+public:
+	/**
+	 * Creates a triangle, whose properties are set by the scene file
+	 */
+	Triangle() : Object(ObjectType::TRIANGLE) {}
+
+	/**
+	 * Check where, if any, the triangle is hit by a ray
+	 *
+	 * \param origin		The origin of the ray
+	 * \param direction		The direction of the ray
+	 * \return				The hit, or std::nullopt if the ray misses
+	 */
+	std::optional<Hit> hit(glm::dvec3 origin, glm::dvec3 direction);
+
+	/**
+	 * Computes the point, normal and material of a hit found by hit()
+	 *
+	 * \param origin		The origin of the ray
+	 * \param direction		The direction of the ray
+	 * \param hit			The hit
+	 * \return				The intersection info
+	 */
+	Intersection attributes(glm::dvec3 origin, glm::dvec3 direction, const Hit& hit);
+
+	/**
+	 * Check where, if any, the triangle is hit by a ray, using the watertight
+	 * test of Woop, Benthin and Wald. The triangle is
+	 * transformed into a space where the ray runs along the z axis, and the hit
+	 * is decided by the signs of the 2D edge functions there. Triangles sharing
+	 * an edge compute the same value for it, so a ray can never slip through the
+	 * crack between them.
+	 *
+	 * \param origin		The origin of the ray
+	 * \param direction		The direction of the ray
+	 * \return				The hit, or std::nullopt if the ray misses
+	 */
+	std::optional<Hit> hitWatertight(glm::dvec3 origin, glm::dvec3 direction);
+
+	/**
+	 * Recomputes the edges and normal of the triangle. Must be called whenever
+	 * a vertex changes.
+	 */
+	void precompute();
+
+	/**
+	 * Parses a property for the triangle. This allows each object to have its own
+	 * set of properties in the scene file
+	 *
+	 * \param name		The name of the property
+	 * \param tokenizer	The tokenizer for the scene file
+	 * \param table		The frame's table of materials, for objects that add their own
+	 */
+	void parseProperty(std::string& name, Tokenizer& tokenizer, MaterialTable& table);
+
+	/**
+	 * Sets this object's properties as the linear interpolation between the two passed objects.
+	 * This allows for keyframing within the scene
+	 *
+	 * \param a		The starting object state
+	 * \param b		The ending object state
+	 * \param alpha	The time value, between 0 and 1, for the interpolation
+	 */
+	void interpolate(Object& a, Object& b, double alpha);
+
+	/**
+	 * Computes a box that contains the whole triangle
+	 *
+	 * \return				The bounding box of the triangle
+	 */
+	BoundingBox bounds();
+
+	/**
+	 * Checks if the passed object is a triangle with exactly the same properties
+	 *
+	 * \param other		The object to compare to
+	 * \return				True if both objects would render the same
+	 */
+	bool equals(Object& other);
+
+	/// The three vertices for the triangle
+	glm::dvec3	v1{ -1, -1, 0 }, v2{1, -1, 0}, v3{0, 1, 0};
+	
+	/// The precomputed normal for the triangle
+	glm::dvec3	norm{0, 0, -1};
+
+	/// The precomputed edges from the first vertex to the second and third
+	glm::dvec3	e1{2, 0, 0}, e2{1, 2, 0};
+
+	/// Whether every triangle is intersected with hitWatertight(). This is
+	/// only changed before rendering starts.
+	static bool	watertight;
+};
+
+/**
+ * The positions, radii and material indices of a set of particles held in memory,
+ * for particles that were interpolated or generated instead of loaded from a file
+ */
+struct ParticleArrays
+{
+	/// The center of each particle, as three coordinates
+	std::vector<float>		positions;
+
+	/// The radius of each particle
+	std::vector<float>		radii;
+
+	/// The index of each particle's material in the set's list of materials
+	std::vector<uint32_t>	materials;
+};
+
+/**
+ * A large set of spheres, such as the particles of a simulation, loaded from a
+ * binary file.
+ *
+ * The file is mapped into memory rather than read, and the particles are used
+ * straight from it, so there is no object for each particle. Each keyframe names
+ * its own file, and the particles of two keyframes are interpolated one by one.
+ * The particles are traced through a grid of their own, which is rebuilt whenever
+ * they change.
+ *
+ * The file starts with the 4 characters "PRTS", a 32 bit version (1) and the 64 bit
+ * number of particles, followed by the center of every particle as three 32 bit
+ * floats, the radius of every particle as a 32 bit float and the index of every
+ * particle's material as a 32 bit unsigned integer. Everything is little endian.
+ */
+class Particles final : public Object
+{
+public:
+	/**
+	 * Creates an empty set of particles, whose properties are set by the scene file
+	 */
+	Particles() : Object(ObjectType::PARTICLES) {}
+
+	/**
+	 * Check where, if any, the particles is hit by a ray
+	 *
+	 * \param origin		The origin of the ray
+	 * \param direction		The direction of the ray
+	 * \return				The hit, or std::nullopt if the ray misses
+	 */
+	std::optional<Hit> hit(glm::dvec3 origin, glm::dvec3 direction);
+
+	/**
+	 * Computes the point, normal and material of a hit found by hit()
+	 *
+	 * \param origin		The origin of the ray
+	 * \param direction		The direction of the ray
+	 * \param hit			The hit
+	 * \return				The intersection info
+	 */
+	Intersection attributes(glm::dvec3 origin, glm::dvec3 direction, const Hit& hit);
+
+	/**
+	 * Parses a property for the particles. This allows each object to have its own
+	 * set of properties in the scene file
+	 *
+	 * \param name		The name of the property
+	 * \param tokenizer	The tokenizer for the scene file
+	 * \param table		The frame's table of materials, for objects that add their own
+	 */
+	void parseProperty(std::string& name, Tokenizer& tokenizer, MaterialTable& table);
+
+	/**
+	 * Sets this object's properties as the linear interpolation between the two passed objects.
+	 * Both must have the same number of particles, which are interpolated one by one.
+	 *
+	 * \param a		The starting object state
+	 * \param b		The ending object state
+	 * \param alpha	The time value, between 0 and 1, for the interpolation
+	 */
+	void interpolate(Object& a, Object& b, double alpha);
+
+	/**
+	 * Computes a box that contains every particle
+	 *
+	 * \return				The bounding box of the particles
+	 */
+	BoundingBox bounds();
+
+	/**
+	 * Checks if the passed object is a set of the same particles with the same materials
+	 *
+	 * \param other		The object to compare to
+	 * \return				True if both objects would render the same
+	 */
+	bool equals(Object& other);
+
+	/**
+	 * Maps a particle file into memory and uses its particles
+	 *
+	 * \param path		The path of the file
+	 * \return			True if the file was loaded, false if it could not be opened or is invalid
+	 */
+	bool load(const std::string& path);
+
+	/**
+	 * Uses particles held in memory
+	 *
+	 * \param arrays	The particles
+	 */
+	void assign(std::shared_ptr<const ParticleArrays> arrays);
+
+	/**
+	 * Gets the material of a particle. Indices past the end of the list of materials
+	 * use the object's own material.
+	 *
+	 * \param index		The index of the particle
+	 * \return			The index of the material in the frame's table
+	 */
+	uint32_t materialOf(size_t index);
+
+	/// The number of particles
+	size_t				count = 0;
+
+	/// The center of each particle, as three coordinates
+	const float*		positions = nullptr;
+
+	/// The radius of each particle
+	const float*		radii = nullptr;
+
+	/// The index of each particle's material
+	const uint32_t*		materialIds = nullptr;
+
+	/// The index in the frame's table of each material the particles refer to
+	std::vector<uint32_t>	materials;
+
+protected:
+	/**
+	 * Builds the grid the particles are traced through and their bounds. Must be
+	 * called whenever the particles change.
+	 */
+	void precompute();
+
+	/// The mapped file the particles are read from, if they came from one
+	std::shared_ptr<const MappedFile>		file;
+
+	/// The particles held in memory, if they did not come from a file
+	std::shared_ptr<const ParticleArrays>	arrays;
+
+	/// The grid over the particles, shared by the copies of the object
+	std::shared_ptr<const ParticleGrid>		grid;
+
+	/// The bounds of the particles
+	BoundingBox								box;
+};
+
+FORCE_INLINE std::optional<Hit> Sphere::hit(glm::dvec3 orig, glm::dvec3 dir)
+{
+	double t = distance(orig, dir, position, radius);
+
+	if (t == std::numeric_limits<double>::infinity())
+		return std::optional<Hit>();
+
+	return Hit{ this, t, 0, 0.0, 0.0 };
+}
+
+FORCE_INLINE double Sphere::distance(glm::dvec3 orig, glm::dvec3 dir, glm::dvec3 position, double radius)
+{
+	// The formula used for calculating the interesection with a sphere was given
+	// in the class slides. 
+
+	// Calculate the ray from the sphere's center to the origin of the ray
+	glm::dvec3 omc = orig - position;
+	
+	double b = 2 * glm::dot(dir, omc);
+	double c = glm::dot(omc, omc) - radius * radius;
+
+	// dx(ox - cx) + dy(oy - cy)
+
+	double disc = b * b - 4 * c;
+
+	// If our discriminant is less than, or close to zero, we do not have an intersection
+	if (disc <= EPSILON)
+		return std::numeric_limits<double>::infinity();
+
+	double rt = glm::sqrt(disc);
+	double t1 = (-b + rt) / 2.0;
+	double t2 = (-b - rt) / 2.0;
+
+	if (t1 > t2)
+		std::swap(t1, t2);
+
+	if (t1 < -EPSILON && t2 < EPSILON)
+		return std::numeric_limits<double>::infinity();
+	else if (t1 < 0.0)
+		return t2;
+	else
+		return t1;
+}
+
+FORCE_INLINE std::optional<Hit> Plane::hit(glm::dvec3 origin, glm::dvec3 direction)
+{
+	// The formula used for calculating the interesection with a plane was given
+	// in the class slides. 
+	double ddn = glm::dot(direction, norm);
+
+	if (ddn > -EPSILON && ddn < EPSILON)
+		return std::optional<Hit>();
+
+	double t = glm::dot(point - origin, norm) / ddn;
+
+	if (t < EPSILON)
+		return std::optional<Hit>();
+
+	return Hit{ this, t, 0, 0.0, 0.0 };
+}
+
+FORCE_INLINE std::optional<Hit> Triangle::hit(glm::dvec3 origin, glm::dvec3 direction)
+{
+	if (watertight)
+		return hitWatertight(origin, direction);
+
+	// The formula used for calculating the interesection with a triangle was given
+	// in the class slides. The edges are precomputed, and the distance along the
+	// ray comes straight out of the same determinants as the barycentrics.
+
+	glm::dvec3 tmp1 = glm::cross(direction, e2);
+	double dot1 = glm::dot(tmp1, e1);
+
+	if (dot1 > -EPSILON && dot1 < EPSILON)
+		return std::optional<Hit>();
+
+	double f = 1.0 / dot1;
+	glm::dvec3 s = origin - v1;
+	double u = f * glm::dot(s, tmp1);
+	
+	if (u < 0.0 || u > 1.0)
+		return std::optional<Hit>();
+
+	glm::dvec3 tmp2 = glm::cross(s, e1);
+	double v = f * glm::dot(direction, tmp2);
+	if (v < 0.0 || u + v > 1.0)
+		return std::optional<Hit>();
+
+	// Hits behind the origin, including the surface the ray starts on, do not count
+	double t = f * glm::dot(e2, tmp2);
+	if (t <= EPSILON)
+		return std::optional<Hit>();
+
+	return Hit{ this, t, 0, u, v };
+}
+
+/**
+ * Calls a function with an object as the class it was created as. The function
+ * is instantiated once for each kind of object, so the calls it makes on the
+ * object are direct and can be inlined, rather than going through the vtable.
+ *
+ * \param object	The object
+ * \param visit		The function, which must accept every kind of object
+ * \return			What the function returns
+ */
+template <typename Visit>
+inline decltype(auto) visitObject(Object& object, Visit&& visit)
+{
+	switch (object.type) {
+	case ObjectType::SPHERE:
+		return visit(static_cast<Sphere&>(object));
+	case ObjectType::PLANE:
+		return visit(static_cast<Plane&>(object));
+	case ObjectType::TRIANGLE:
+		return visit(static_cast<Triangle&>(object));
+	default:
+		return visit(static_cast<Particles&>(object));
+	}
+}
+
+/**
+ * Check where, if any, an object is hit by a ray, calling the hit test of its
+ * class directly. Used by the loops that test rays against many objects.
+ *
+ * \param object	The object
+ * \param origin	The origin of the ray
+ * \param direction	The direction of the ray
+ * \return			The hit, or std::nullopt if the ray misses
+ */
+FORCE_INLINE std::optional<Hit> hitObject(Object& object, glm::dvec3 origin, glm::dvec3 direction)
+{
+	// Switched on here rather than through visitObject(), so that the hit tests are
+	// inlined straight into the loop instead of into a lambda it calls
+	switch (object.type) {
+	case ObjectType::SPHERE:
+		return static_cast<Sphere&>(object).hit(origin, direction);
+	case ObjectType::PLANE:
+		return static_cast<Plane&>(object).hit(origin, direction);
+	case ObjectType::TRIANGLE:
+		return static_cast<Triangle&>(object).hit(origin, direction);
+	default:
+		return static_cast<Particles&>(object).hit(origin, direction);
+	}
+}
+
+/**
+ * Represents the camera in the scene
+ */
+class Camera
+{
+public:
+	/// The current position of the camera
+	glm::dvec3	position{0.0, 0.0, 0.0};	
+	
+	/// The point that the camera is looking at
+	glm::dvec3	lookat{0.0, 1.0, 0.0};
+	
+	/// The up vector used to calculate the lookat matrix
+	glm::dvec3	up{0.0, 1.0, 0.0};
+
+	/// The vertical field of view for the camera
+	double		fov{90.0};
+
+	/**
+	 * Sets this object's properties as the linear interpolation between the two passed objects.
+	 * This allows for keyframing within the scene
+	 *
+	 * \param a		The starting object state
+	 * \param b		The ending object state
+	 * \param alpha	The time value, between 0 and 1, for the interpolation
+	 */
+	void interpolate(Camera& a, Camera& b, double alpha);
+
+	/**
+	 * Checks if the passed camera has exactly the same properties as this one
+	 *
+	 * \param other	The camera to compare to
+	 * \return			True if both cameras would render the same view
+	 */
+	bool equals(Camera& other);
+
+	/**
+	 * Parses a property for the camera. This allows each object to have its own
+	 * set of properties in the scene file
+	 *
+	 * \param name		The name of the property
+	 * \param tokenizer	The tokenizer for the scene file
+	 */
+	void parseProperty(std::string& name, Tokenizer& tokenizer);
+};
+
+/**
+ * Represents a light within the scene
+ */
+class Light
+{
+public:
+	/// The position of the light
+	glm::dvec3	position;
+
+	/// The light's diffuse color
+	glm::dvec3	diffuse;
+
+	/// The light's specular color
+	glm::dvec3	specular;
+
+	/// The constant, linear and quadratic attenuation of the light. The light is
+	/// divided by c + l * d + q * d^2 at a distance d. The default does not attenuate.
+	glm::dvec3	attenuation{1.0, 0.0, 0.0};
+
+	/// The distance at which the light fades out completely, or 0 for no limit
+	double		radius = 0.0;
+
+	/**
+	 * Gets how much of the light reaches a point
+	 *
+	 * \param distance	The distance from the light to the point
+	 * \return			The fraction of the light's color that reaches the point
+	 */
+	double falloff(double distance) const;
+
+	/**
+	 * Gets the distance beyond which the light is too dim to matter, so that
+	 * shading can skip it without tracing a shadow ray
+	 *
+	 * \param threshold	The brightness, relative to a white surface, below which the light is ignored
+	 * \return			The distance, or infinity if the light reaches every point
+	 */
+	double range(double threshold) const;
+
+	/**
+	 * Sets this object's properties as the linear interpolation between the two passed objects.
+	 * This allows for keyframing within the scene.
+	 *
+	 * \param a		The starting object state
+	 * \param b		The ending object state
+	 * \param alpha	The time value, between 0 and 1, for the interpolation
+	 */
+	void interpolate(Light& a, Light& b, double alpha);
+
+	/**
+	 * Checks if the passed light has exactly the same properties as this one
+	 *
+	 * \param other	The light to compare to
+	 * \return			True if both lights illuminate the scene the same
+	 */
+	bool equals(Light& other);
+
+	/**
+	 * Parses a property for the light. This allows each object to have its own
+	 * set of properties in the scene file.
+	 *
+	 * \param name		The name of the property
+	 * \param tokenizer	The tokenizer for the scene file
+	 */
+	void parseProperty(std::string& name, Tokenizer& tokenizer);
+};
+
+#endif//OBJECTS_HPP
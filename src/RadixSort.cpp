@@ -0,0 +1,64 @@
+#include "RadixSort.hpp"
+
+#include <cstddef>
+#include <utility>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/// Fewer keys than this are sorted on a single thread
+const int RADIX_SORT_MIN_PARALLEL = 1024;
+
+void radixSort(std::vector<SortKey>& keys, int bits)
+{
+	int count = (int)keys.size();
+	std::vector<SortKey> sorted(keys.size());
+	std::vector<size_t> histograms;
+	int threads = 1;
+
+	for (int shift = 0; shift < bits; shift += 8) {
+		#pragma omp parallel if(count >= RADIX_SORT_MIN_PARALLEL)
+		{
+			int thread = 0;
+#ifdef _OPENMP
+			thread = omp_get_thread_num();
+#endif
+
+			#pragma omp single
+			{
+#ifdef _OPENMP
+				threads = omp_get_num_threads();
+#endif
+				histograms.assign((size_t)threads * 256, 0);
+			}
+
+			int begin = (int)((int64_t)count * thread / threads);
+			int end = (int)((int64_t)count * (thread + 1) / threads);
+			size_t* histogram = &histograms[(size_t)thread * 256];
+
+			for (int i = begin; i < end; i++)
+				histogram[(keys[i].code >> shift) & 255]++;
+
+			#pragma omp barrier
+
+			// Each thread's keys with a digit go after those of the threads before it
+			#pragma omp single
+			{
+				size_t offset = 0;
+				for (int digit = 0; digit < 256; digit++) {
+					for (int t = 0; t < threads; t++) {
+						size_t digits = histograms[(size_t)t * 256 + digit];
+						histograms[(size_t)t * 256 + digit] = offset;
+						offset += digits;
+					}
+				}
+			}
+
+			for (int i = begin; i < end; i++)
+				sorted[histogram[(keys[i].code >> shift) & 255]++] = keys[i];
+		}
+
+		std::swap(keys, sorted);
+	}
+}
@@ -0,0 +1,29 @@
+#ifndef RADIXSORT_HPP
+#define RADIXSORT_HPP
+
+#include <vector>
+#include <cstdint>
+
+/**
+ * An index into a list, with the key to sort it by
+ */
+struct SortKey
+{
+	/// The key, such as a Morton code or a grid cell
+	uint64_t	code;
+
+	/// The index of the item in its list
+	int			index;
+};
+
+/**
+ * Sorts keys on every thread, keeping equal keys in order. Every pass over 8 bits of
+ * the keys splits them between the threads, which count the digits in their part,
+ * and then move their part to where the counts say.
+ *
+ * @param keys	The keys to sort
+ * @param bits	The number of low bits of the keys that can be set
+ */
+void radixSort(std::vector<SortKey>& keys, int bits);
+
+#endif//RADIXSORT_HPP
@@ -0,0 +1,108 @@
+#ifndef RANDOM_HPP
+#define RANDOM_HPP
+
+#include <cstdint>
+
+/**
+ * Counter based random number generator using the Philox4x32-10 function.
+ *
+ * Instead of a state that gets advanced, every number is computed directly from a
+ * key and a counter. Each sample of each pixel gets its own stream, keyed by the
+ * seed, frame, pixel and sample index, so the numbers a sample sees never depend
+ * on which thread traced it or in what order the pixels were traced. This keeps
+ * renders bit-identical regardless of the number of threads.
+ */
+class SampleRandom
+{
+public:
+	/**
+	 * Creates an empty stream. This is only useful as a placeholder until it is
+	 * assigned a keyed stream.
+	 */
+	SampleRandom() = default;
+
+	/**
+	 * Creates the stream of random numbers for a single sample
+	 *
+	 * @param seed		The seed for the whole render
+	 * @param frame		The frame number being rendered
+	 * @param pixel		The index of the pixel within the frame
+	 * @param sample	The index of the sample within the pixel
+	 */
+	SampleRandom(uint32_t seed, uint32_t frame, uint32_t pixel, uint32_t sample) :
+		key{ seed, frame },
+		counter{ pixel, sample, 0, 0 }
+	{
+	}
+
+	/**
+	 * Returns the next random 32 bit integer in the stream
+	 *
+	 * @return A uniformly distributed integer
+	 */
+	uint32_t nextUint()
+	{
+		if (index == 4) {
+			generate();
+		}
+
+		return block[index++];
+	}
+
+	/**
+	 * Returns the next random number in the range [0, 1)
+	 *
+	 * @return A uniformly distributed double
+	 */
+	double nextDouble()
+	{
+		return nextUint() * (1.0 / 4294967296.0);
+	}
+
+protected:
+	/**
+	 * Computes the next block of four random numbers from the key and counter
+	 */
+	void generate()
+	{
+		uint32_t x[4] = { counter[0], counter[1], counter[2], counter[3] };
+		uint32_t k[2] = { key[0], key[1] };
+
+		for (int round = 0; round < 10; round++) {
+			uint64_t p0 = (uint64_t)0xD2511F53u * x[0];
+			uint64_t p1 = (uint64_t)0xCD9E8D57u * x[2];
+
+			uint32_t y[4] = {
+				(uint32_t)(p1 >> 32) ^ x[1] ^ k[0],
+				(uint32_t)p1,
+				(uint32_t)(p0 >> 32) ^ x[3] ^ k[1],
+				(uint32_t)p0,
+			};
+
+			x[0] = y[0]; x[1] = y[1]; x[2] = y[2]; x[3] = y[3];
+
+			k[0] += 0x9E3779B9u;
+			k[1] += 0xBB67AE85u;
+		}
+
+		block[0] = x[0]; block[1] = x[1]; block[2] = x[2]; block[3] = x[3];
+		index = 0;
+
+		// Move on to the next block of the stream
+		counter[2]++;
+	}
+
+	/// The key of the stream
+	uint32_t	key[2]		= { 0, 0 };
+
+	/// The counter of the next block to generate
+	uint32_t	counter[4]	= { 0, 0, 0, 0 };
+
+	/// The last block of random numbers generated
+	uint32_t	block[4]	= { 0, 0, 0, 0 };
+
+	/// The index of the next number to use from the block
+	int			index		= 4;
+};
+
+#endif//RANDOM_HPP
@@ -1,424 +1,1831 @@
-#include "Renderer.hpp"
-
-#include <iostream>
-
-#include <glm/glm.hpp>
-#include <SDL2/SDL.h>
-#include <SDL2/SDL_image.h>
-
-/**
- * Helper template function for linearly interpolating between values
- *
- * @param a		The starting value
- * @param b		The ending value
- * @param alpha A time value (typically between 0 and 1) for interpolation
- * @return		The interpolated value
- */
-template<typename T>
-T lerp(T a, T b, double alpha)
-{
-	return (1 - alpha) * a + alpha * b;
-}
-
-/**
- * Updates the window to display the current render
- * 
- * @param window The window to render to
- */
-void updateWindow(SDL_Window* window)
-{
-	// If there is no window, just carry on
-	if (window == nullptr) return;
-	
-	// Keep track of the accumulated time and time of previous render
-	static uint32_t lastTime = SDL_GetTicks();
-	static uint32_t accTime = 0;
-
-
-	uint32_t curTime = SDL_GetTicks();
-	accTime += curTime - lastTime;
-	lastTime = curTime;
-
-	// Update the window every 50 milleseconds at max
-	if (accTime > 50) {
-		SDL_Event event;
-		while (SDL_PollEvent(&event)) {
-			if (event.type == SDL_QUIT)
-				exit(0);
-		}
-
-		SDL_UpdateWindowSurface(window);
-
-		accTime = 0;
-	}
-}
-
-/**
- * Computes the closest intersection with the passed ray and the passed frame
- * 
- * @param origin	The origin of the ray
- * @param dir		The direction of the ray
- * @param frame		The frame currently being rendered
- * @return			The closest intersection, or std::nullopt if there is no intersection
- */
-std::optional<Intersection> closestIntersection(glm::dvec3 origin, glm::dvec3 dir, Frame& frame)
-{
-	bool intersection = false;	// Whether or not we've seen an intersection
-	glm::dvec3 res;
-	Intersection closest;		// The current closest intersection
-	
-	// Check against all the objects in the frame
-	for (std::shared_ptr<Object> o: frame.objects) {
-		auto intOpt = o->intersect(origin, dir);
-
-		if (intOpt.has_value()) {
-			Intersection i = intOpt.value();
-			
-			// If we have not had an intersection yet, set the intersection flag.
-			// If this intersection is closer, update the closest intersecition
-			if (!intersection) {
-				intersection = true;
-				closest = i;
-			}
-			else if (closest.t > i.t) {
-				closest = i;
-			}
-		}
-	}
-
-	// return the intersection, if there is one. 
-	if (intersection) {
-		return std::optional<Intersection>(closest);
-	}
-	else {
-		return std::optional<Intersection>();
-	}
-}
-
-/**
- * Calculate the first intersection (not closest) with the objects in the scene. 
- * This is used for lighting calculations.
- * 
- * @param origin	The origin of the ray.
- * @param dir		The direction of the ray
- * @param frame		The frame we are rendering
- * @return			The intersection calculated
- */
-std::optional<Intersection> intersection(glm::dvec3 origin, glm::dvec3 dir, Frame& frame)
-{
-	for (std::shared_ptr<Object> o : frame.objects) {
-		auto opt = o->intersect(origin, dir);
-
-		if (opt.has_value()) {
-			return opt;
-		}
-	}
-
-	return std::optional<Intersection>();
-}
-
-/**
- * Calculates phong lighting for the intersection and scene
- *
- * @param eye		The viewing location for the illumination calculation
- * @param inter		The intersection info
- * @param frame		The frame we are rendering
- * @return			The RGB value of the lighting
- * 
- * @note This is no longer used, but was left here just in case I wanted to add an 
- *       option to use it
- */
-glm::dvec3 phong(glm::dvec3 eye, Intersection inter, Frame& frame)
-{
-	glm::dvec3 view = glm::normalize(eye - inter.pos);
-
-	glm::dvec3 finalColor(0.0);
-
-	// Go through all the lights in the scene and calculate all the all lighting,
-	// and average them together
-	for (std::shared_ptr<Light> l : frame.lights) {
-		glm::dvec3 lDir = glm::normalize(l->position - inter.pos);
-
-		auto opt = intersection(inter.pos, lDir, frame);
-		if (opt.has_value())
-			continue;
-
-		double 		sDiff = glm::max(glm::dot(inter.norm, lDir), 0.0);
-		glm::dvec3	diff = sDiff * inter.material->diffuse * l->diffuse;
-
-		glm::dvec3 ref = glm::reflect(-lDir, inter.norm);
-
-		double sSpec = glm::pow(glm::max(glm::dot(view, ref), 0.0), inter.material->shininess);
-		glm::dvec3 spec = sSpec * inter.material->specular * l->specular;
-
-		finalColor += diff + spec;
-	}
-
-	return finalColor;
-}
-
-/**
- * Calculates blinn-phong lighting for the intersection and scene
- * 
- * @param eye		The viewing location for the illumination calculation
- * @param inter		The intersection info
- * @param frame		The frame we are rendering
- * @return			The RGB value of the lighting
- */
-glm::dvec3 blinn(glm::dvec3 eye, Intersection inter, Frame& frame)
-{
-	glm::dvec3 view = glm::normalize(eye - inter.pos);
-
-	glm::dvec3 finalColor(0.0);
-
-	for (std::shared_ptr<Light> l : frame.lights) {
-		glm::dvec3 lDir = glm::normalize(l->position - inter.pos);
-
-		auto opt = intersection(inter.pos, lDir, frame);
-		if (opt.has_value())
-			continue;
-
-		double 		sDiff = glm::max(glm::dot(inter.norm, lDir), 0.0);
-		glm::dvec3	diff = sDiff * inter.material->diffuse * l->diffuse;
-
-		glm::dvec3 halfway = glm::normalize(view + lDir);
-		double sSpec = glm::pow(glm::max(glm::dot(halfway, inter.norm), 0.0), 4.0 * inter.material->shininess);
-		glm::dvec3 spec = sSpec * inter.material->specular * l->specular;
-
-		finalColor += diff + spec;
-	}
-
-	return finalColor;
-}
-
-/**
- * Traces a ray through the specified frame of a scene
- * 
- * @param orig		The origin of the ray
- * @param dir		The direction of the ray
- * @param frame		The frame to render
- * @param maxDepth	The maximum number of reflectoins
- * @return			The traced color
- * 
- * @note While cleaning up the code a bit to upload to github, I found a few potential problems:
- * - Lighting for reflections is always calculated using the camera position. It should probaby
- *   be based off the ray we are tracing, not the camera's position
- * - If the maximum depth is reached, we return black, not the background color
- * - The calculation of the reflection color with the objects color probably needs another look.
- *   Maybe the diffuse and specular components should be seperate? I'm not sure about this one.
- * 
- * I am currently too busy with helping my Dad in the garage, applying to places, and a minecraft
- * project to fix these at the moment. 
- */
-glm::dvec3 trace(glm::dvec3 orig, glm::dvec3 dir, Frame& frame, int maxDepth)
-{	
-	// If we reached our max-depth, return 0
-	if (maxDepth == 0)
-		return { 0.0, 0.0, 0.0 };
-
-	// Get the closest intersection, if any
-	auto interOpt = closestIntersection(orig, dir, frame);
-
-	// Return the background if there is no intersection
-	if (!interOpt.has_value())
-		return frame.background;
-	
-	Intersection inter = interOpt.value();
-
-	glm::dvec3 ref = glm::reflect(dir, inter.norm);
-
-	// Trace the reflection and get it's color
-	glm::dvec3 refColor = trace(inter.pos, ref, frame, maxDepth - 1);
-		
-	return refColor * inter.material->specular + blinn(frame.camera.position, interOpt.value(), frame);
-}
-
-void renderFrame(SDL_Window* window, SDL_Surface* surface, Frame& frame, int maxDepth, int samples, Configuration config)
-{
-	//Precalculate values that will be used for each pixel in the scene
-	Camera& camera = frame.camera;
-	
-	glm::dvec3	l	= glm::normalize(camera.lookat - camera.position);
-	glm::dvec3	v	= glm::normalize(glm::cross(l, camera.up));
-	glm::dvec3	u	= glm::cross(v, l);
-	glm::dvec3	eye = camera.position;
-
-	double a = (double)surface->w / (double)surface->h;
-	double d = 1.0 / glm::tan(camera.fov / 2.0);
-
-	glm::dvec3 ll = eye + d * l - a * v - u;
-
-	glm::dvec3 cx = 2.0* a * v / (double)surface->w;
-	glm::dvec3 cy = 2.0 * u / (double)surface->h;
-
-	// Use OpenMP to render many pixels at once. Parallelizing multiple rows 
-	// rather than individual pixels proved to be quicker when displaying to a window
-	#pragma omp parallel for
-	for (int py = 0; py < surface->h; py++) {
-		for (int px = 0; px < surface->w; px++) {
-			glm::dvec3 color(0.0);
-			
-			// Calculate subpixels (if enabled) 
-			for (int sy = 0; sy < samples; sy++) {
-				for (int sx = 0; sx < samples; sx++) {
-					double x = (double)px + (double)sx / (double)samples;
-					double y = (double)py + (double)sy / (double)samples;
-
-					//calculate the ray for this pixel
-					glm::dvec3 p = ll + cx * x + cy * y;
-					glm::dvec3 dir = glm::normalize(p - eye);
-
-					color += trace(eye, glm::normalize(dir), frame, 64);
-				}
-			}
-
-			// Average the colors of our subpixels
-			color /= (double)(samples * samples);
-			
-			uint8_t r = glm::floor(color.r >= 1.0 ? 255 : color.r * 256.0);
-			uint8_t g = glm::floor(color.g >= 1.0 ? 255 : color.g * 256.0);
-			uint8_t b = glm::floor(color.b >= 1.0 ? 255 : color.b * 256.0);
-
-			((uint32_t*)surface->pixels)[(surface->h - py - 1) * surface->w + px] = (uint32_t)SDL_MapRGB(surface->format, r, g, b);
-			
-			// Update the window if we have one
-			if(window)
-				updateWindow(window);
-		}
-	}
-}
-
-/**
- * Interpolates the two passed frames based on the time value
- * 
- * @param f1	The start frame
- * @param f2	The end frame
- * @param alpha	The time value
- * @return		The interpolated frame
- */
-Frame interpolateFrames(Frame& f1, Frame& f2, double alpha)
-{
-	// The new frame we calculated
-	Frame newFrame{};
-	
-	//interpolate objects
-	int i = 0;
-	for ( ; i < f1.objects.size(); i++) {
-		std::shared_ptr<Object> newObject;
-
-		// Interpolate the object based on it's type
-		if (typeid(*f1.objects[i]) == typeid(Sphere)) {
-			newObject = std::make_shared<Sphere>();
-			newObject->interpolate(*f1.objects[i], *f2.objects[i], alpha);
-			newFrame.objects.push_back(newObject);
-		}
-		else if (typeid(*f1.objects[i]) == typeid(Plane)) {
-			newObject = std::make_shared<Plane>();
-			newObject->interpolate(*f1.objects[i], *f2.objects[i], alpha);
-			newFrame.objects.push_back(newObject);
-		}
-	}
-
-	// Interpolate the lights in the scene
-	for (i = 0; i < f1.lights.size(); i++) {
-		std::shared_ptr<Light> newLight = std::make_shared<Light>();
-		newLight->interpolate(*f1.lights[i], *f2.lights[i], alpha);
-		newFrame.lights.push_back(newLight);
-	}
-
-	// Interpolate the background and camera 
-	newFrame.background = lerp(f1.background, f2.background, alpha);
-	newFrame.camera.interpolate(f1.camera, f2.camera, alpha);
-
-	return newFrame;
-}
-
-void renderFrames(SDL_Window* window, SDL_Surface* surface, Animation animation, Configuration config) 
-{
-	// NOTE: The logic of this function could probably be simplified to have a single loop and less
-	//       branching based on special conditions
-
-	int frameNumber = 0;
-
-	if (animation.keyFrames.size() < 0) {
-		// Can't render if there are no keyframes
-		std::cerr << "Error: No Keyframes Found" << std::endl;
-		return;
-	}
-	else if (animation.keyFrames.size() == 1) {
-		// If we only have one frame, render it without looping and without interpolation
-		renderFrame(window, surface, animation.keyFrames[0], animation.maxDepth, animation.samples, config);
-		if (config.outputFormat != OutputFormat::NONE) {
-			std::string path = config.outputName + "frame_0";
-
-			if (config.outputFormat == OutputFormat::PNG) {
-				path += ".png";
-
-				IMG_SavePNG(surface, path.c_str());
-			}
-			if (config.outputFormat == OutputFormat::JPEG) {
-				path += ".jpg";
-				IMG_SaveJPG(surface, path.c_str(), 70);
-			}
-		}
-		return;
-	}
-
-	// for each pair of frames
-	int numKeyFrames = animation.keyFrames.size();
-
-	for (int i = 0; i < numKeyFrames - (animation.loop ? 0 : 1); i++) {
-		// Get the first and last frames in the animation
-		Frame& startFrame = animation.keyFrames[i];
-		Frame& endFrame = animation.keyFrames[(i + 1) % numKeyFrames];
-
-		// Calculate our timestep between keyframes
-		int fps = animation.fps;
-		double deltaTime = startFrame.timeOffset;
-		int frameCount = deltaTime * fps;
-		double timeStep = deltaTime / (double)frameCount;
-		
-		double alpha = 0.0;
-
-		for (int j = 0; j < frameCount; j++, alpha += timeStep) {
-			std::cout << "Rendering frame " << frameNumber << ": " << std::flush;
-			
-			uint32_t renderStartTime = SDL_GetTicks();
-
-			// If we have the start or end frame, render the frame as-is without interpolation. Otherwise,
-			// interpolate the nearest two frames
-			if (j == 0) {
-				renderFrame(window, surface, startFrame, animation.maxDepth, animation.samples, config);
-			}
-			else if (j == frameCount - 1) {
-				renderFrame(window, surface, endFrame, animation.maxDepth, animation.samples, config);
-			}
-			else {
-				Frame interpFrame = interpolateFrames(startFrame, endFrame, alpha);
-				renderFrame(window, surface, interpFrame, animation.maxDepth, animation.samples, config);
-			}
-
-			uint32_t renderEndTime = SDL_GetTicks();
-			double seconds = (double)(renderEndTime - renderStartTime) / 1000.0;
-
-			std::cout << "  Took " << seconds << "s to render" << std::endl;
-
-			// Output the frame we just rendered
-			if (config.outputFormat != OutputFormat::NONE) {
-				std::string path = config.outputName + "frame_" + std::to_string(frameNumber);
-
-				if (config.outputFormat == OutputFormat::PNG) {
-					path += ".png";
-
-					IMG_SavePNG(surface, path.c_str());
-				}
-				if (config.outputFormat == OutputFormat::JPEG) {
-					path += ".jpg";
-					IMG_SaveJPG(surface, path.c_str(), 70);
-				}
-			}
-
-			frameNumber++;
-		}
-	}
-}
+#include "Renderer.hpp"
+
+#include <iostream>
+#include <vector>
+#include <optional>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <type_traits>
+#include <unordered_map>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include <glm/glm.hpp>
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_image.h>
+
+#include "Checkpoint.hpp"
+#include "LightTree.hpp"
+#include "Random.hpp"
+#include "Sampler.hpp"
+#include "SceneGeometry.hpp"
+#include "Timeline.hpp"
+
+/**
+ * Helper template function for linearly interpolating between values
+ *
+ * @param a		The starting value
+ * @param b		The ending value
+ * @param alpha A time value (typically between 0 and 1) for interpolation
+ * @return		The interpolated value
+ */
+template<typename T>
+T lerp(T a, T b, double alpha)
+{
+	// Keep values that do not change between keyframes exact
+	if (a == b)
+		return a;
+
+	return (1 - alpha) * a + alpha * b;
+}
+
+/**
+ * The object that last blocked a shadow ray to each light. Neighbouring pixels
+ * are usually shadowed by the same object, so testing it first often finds the
+ * occluder without testing every object. Each thread has its own cache.
+ */
+struct ShadowCache
+{
+	/// For each light, the object that blocked the last shadow ray to it, or NULL
+	std::vector<Object*>	occluders;
+
+	/// The number of shadow rays traced with this cache
+	uint64_t				rays = 0;
+
+	/// The number of shadow rays that were blocked by the cached object
+	uint64_t				hits = 0;
+};
+
+/// Lights are skipped where all of them together would add less than this to a
+/// pixel, which is half a step of an 8 bit color
+const double LIGHT_CUTOFF = 1.0 / 512.0;
+
+/// The width and height of the tiles that lights are culled for, in pixels. The
+/// wavefront mode traces the image in the same tiles.
+const int LIGHT_TILE_SIZE = 16;
+
+/// The number of bounces traced for every sample, counting the primary ray
+const int TRACE_DEPTH = 64;
+
+/// The wavefront mode follows the remaining paths of a tile one at a time once
+/// fewer rays than this are left
+const int WAVEFRONT_MIN_RAYS = 256;
+
+/**
+ * The lights that can reach each part of the image. Lights with a radius or
+ * attenuation only reach points within their range, so most intersections only
+ * need to be shaded with a few of them.
+ */
+struct LightCulling
+{
+	/// For each light, the distance beyond which it is skipped
+	std::vector<double>				ranges;
+
+	/// The number of tiles across the image
+	int								tilesX = 0;
+
+	/// For each tile, the lights that can reach a point seen directly through it,
+	/// row by row. Empty if every light reaches every point.
+	std::vector<std::vector<int>>	tiles;
+};
+
+/**
+ * State that is carried along while tracing all the rays for a single pixel
+ */
+struct TraceContext
+{
+	/// Whether the bounds of the reflection and shadow rays should be recorded
+	bool		recordBounds = false;
+
+	/// Bounds of every reflection and shadow ray traced for the pixel so far. Rays
+	/// that leave the scene make the bounds infinite.
+	BoundingBox	rayBounds;
+
+	/// The random numbers for the sample being traced. Anything stochastic has to
+	/// draw from this, so that the result does not depend on the thread count.
+	SampleRandom	random;
+
+	/// The number of rays traced for the pixel, counting primary, reflection and shadow rays
+	uint64_t	rays = 0;
+
+	/// The number of ray-object intersection tests done for the pixel
+	uint64_t	primitiveTests = 0;
+
+	/// The objects of the frame that rays are traced against
+	const SceneGeometry*	geometry = nullptr;
+
+	/// The tree to pick the lights to shade with from, or NULL to shade with every light
+	const LightTree*	lightTree = nullptr;
+
+	/// The number of lights picked from the tree at each intersection
+	int			lightSamples = 0;
+
+	/// The occluders last found by the thread tracing the pixel, or NULL to not cache them
+	ShadowCache*	shadowCache = nullptr;
+
+	/// The distance beyond which each light is skipped
+	const std::vector<double>*	lightRanges = nullptr;
+
+	/// The lights that can reach the points seen directly through the pixel's tile,
+	/// or NULL if every light can
+	const std::vector<int>*		tileLights = nullptr;
+};
+
+/**
+ * Reads a counter that advances with time, for measuring the cost of short pieces
+ * of work. This is the time stamp counter where there is one.
+ *
+ * @return The current value of the counter
+ */
+static inline uint64_t readCycleCounter()
+{
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+/**
+ * Information kept about the last frame that was rendered into the surface, so 
+ * that the following frames can reuse its pixels
+ */
+struct FrameHistory
+{
+	/// Whether a frame has been rendered into the surface yet
+	bool						valid = false;
+
+	/// The last frame that was rendered into the surface
+	Frame						frame;
+
+	/// The frame number of the last frame rendered
+	int							frameNumber = -1;
+
+	/// For each pixel, the bounds of the reflection and shadow rays traced for it
+	std::vector<BoundingBox>	rayBounds;
+
+	/// For each pixel, whether it needs to be traced for the current frame. When this
+	/// is empty, every pixel is traced
+	std::vector<uint8_t>		dirty;
+};
+
+/**
+ * The vectors needed to compute the primary ray through any point on the screen
+ */
+struct View
+{
+	/// The position of the eye
+	glm::dvec3	eye;
+
+	/// The direction the camera looks in
+	glm::dvec3	l;
+
+	/// The camera's right and up vectors
+	glm::dvec3	v, u;
+
+	/// The lower left corner of the screen
+	glm::dvec3	ll;
+
+	/// The step across the screen for one pixel in the x and y directions
+	glm::dvec3	cx, cy;
+
+	/// The aspect ratio of the screen
+	double		a;
+
+	/// The distance from the eye to the screen
+	double		d;
+};
+
+/**
+ * Precalculates the view vectors for a camera
+ *
+ * @param camera	The camera to calculate the view of
+ * @param width		The width of the image in pixels
+ * @param height	The height of the image in pixels
+ * @return			The view for the camera
+ */
+View computeView(Camera& camera, int width, int height)
+{
+	View view;
+
+	view.l		= glm::normalize(camera.lookat - camera.position);
+	view.v		= glm::normalize(glm::cross(view.l, camera.up));
+	view.u		= glm::cross(view.v, view.l);
+	view.eye	= camera.position;
+
+	view.a = (double)width / (double)height;
+	view.d = 1.0 / glm::tan(camera.fov / 2.0);
+
+	view.ll = view.eye + view.d * view.l - view.a * view.v - view.u;
+
+	view.cx = 2.0 * view.a * view.v / (double)width;
+	view.cy = 2.0 * view.u / (double)height;
+
+	return view;
+}
+
+/**
+ * Finds the range of every light, and which lights can reach the points seen
+ * through each tile of the image. A light can only reach points seen through a
+ * tile if the sphere of its range overlaps the pyramid spanned by the eye and the
+ * corners of the tile.
+ *
+ * @param frame		The frame we are rendering
+ * @param view		The view of the frame's camera
+ * @param width		The width of the image in pixels
+ * @param height	The height of the image in pixels
+ * @return			The lights to shade each tile with
+ */
+LightCulling cullLights(Frame& frame, View& view, int width, int height)
+{
+	LightCulling culling;
+	bool bounded = false;
+
+	// No material reflects more of a light than the brightest channels of any
+	// material in the frame
+	double diffuse = 0.0, specular = 0.0;
+	for (uint32_t m = 0; m < frame.materials.size(); m++) {
+		const Material& material = frame.materials[m];
+		diffuse = std::max({ diffuse, material.diffuse.r, material.diffuse.g, material.diffuse.b });
+		specular = std::max({ specular, material.specular.r, material.specular.g, material.specular.b });
+	}
+
+	// Each bounce adds the light at the next point again, scaled by the specular
+	// color of the surfaces on the way. Every sample is traced to the same depth,
+	// whatever the scene's MaxDepth.
+	double bounces = 0.0, weight = 1.0;
+	for (int i = 0; i < TRACE_DEPTH; i++, weight *= specular)
+		bounces += weight;
+
+	// Every skipped light could reach the same point, so each one gets an equal
+	// share of the cutoff
+	double threshold = LIGHT_CUTOFF / (std::max(diffuse, specular) * bounces * std::max<size_t>(frame.lights.size(), 1));
+
+	for (std::shared_ptr<Light>& light : frame.lights) {
+		culling.ranges.push_back(light->range(threshold));
+		bounded |= std::isfinite(culling.ranges.back());
+	}
+
+	// If every light reaches every point, each tile would list all of them
+	if (!bounded)
+		return culling;
+
+	culling.tilesX = (width + LIGHT_TILE_SIZE - 1) / LIGHT_TILE_SIZE;
+	int tilesY = (height + LIGHT_TILE_SIZE - 1) / LIGHT_TILE_SIZE;
+	culling.tiles.resize((size_t)culling.tilesX * tilesY);
+
+	for (int ty = 0; ty < tilesY; ty++) {
+		for (int tx = 0; tx < culling.tilesX; tx++) {
+			// Every sample of the tile's pixels lies within these bounds on the screen
+			double x0 = tx * LIGHT_TILE_SIZE, x1 = std::min((tx + 1) * LIGHT_TILE_SIZE, width);
+			double y0 = ty * LIGHT_TILE_SIZE, y1 = std::min((ty + 1) * LIGHT_TILE_SIZE, height);
+
+			glm::dvec3 corners[4] = {
+				view.ll + view.cx * x0 + view.cy * y0 - view.eye,
+				view.ll + view.cx * x1 + view.cy * y0 - view.eye,
+				view.ll + view.cx * x1 + view.cy * y1 - view.eye,
+				view.ll + view.cx * x0 + view.cy * y1 - view.eye,
+			};
+			glm::dvec3 center = (corners[0] + corners[1] + corners[2] + corners[3]) * 0.25;
+
+			// The sides of the pyramid, with their normals facing inwards
+			glm::dvec3 normals[4];
+			for (int i = 0; i < 4; i++) {
+				normals[i] = glm::normalize(glm::cross(corners[i], corners[(i + 1) % 4]));
+				if (glm::dot(normals[i], center) < 0.0)
+					normals[i] = -normals[i];
+			}
+
+			std::vector<int>& lights = culling.tiles[(size_t)ty * culling.tilesX + tx];
+			for (int l = 0; l < (int)frame.lights.size(); l++) {
+				glm::dvec3 position = frame.lights[l]->position - view.eye;
+				double range = culling.ranges[l];
+
+				bool inside = true;
+				for (int i = 0; i < 4 && inside; i++)
+					inside = glm::dot(normals[i], position) >= -range;
+
+				if (inside)
+					lights.push_back(l);
+			}
+		}
+	}
+
+	return culling;
+}
+
+/**
+ * Updates the window to display the current render
+ * 
+ * @param window The window to render to
+ */
+void updateWindow(SDL_Window* window)
+{
+	// If there is no window, just carry on
+	if (window == nullptr) return;
+	
+	// Keep track of the accumulated time and time of previous render
+	static uint32_t lastTime = SDL_GetTicks();
+	static uint32_t accTime = 0;
+
+
+	uint32_t curTime = SDL_GetTicks();
+	accTime += curTime - lastTime;
+	lastTime = curTime;
+
+	// Update the window every 50 milleseconds at max
+	if (accTime > 50) {
+		SDL_Event event;
+		while (SDL_PollEvent(&event)) {
+			if (event.type == SDL_QUIT)
+				exit(0);
+		}
+
+		SDL_UpdateWindowSurface(window);
+
+		accTime = 0;
+	}
+}
+
+/**
+ * Calculate the first intersection (not closest) with the objects in the scene. 
+ * This is used for lighting calculations.
+ * 
+ * @param origin	The origin of the ray.
+ * @param dir		The direction of the ray
+ * @param frame		The frame we are rendering
+ * @param maxT		Intersections at or beyond this distance along the ray are ignored
+ * @param tests		Incremented for every object the ray is tested against
+ * @return			The intersection calculated
+ */
+std::optional<Intersection> intersection(glm::dvec3 origin, glm::dvec3 dir, Frame& frame, double maxT, uint64_t& tests)
+{
+	for (std::shared_ptr<Object> o : frame.objects) {
+		auto opt = o->intersect(origin, dir);
+		tests++;
+
+		if (opt.has_value() && opt->t < maxT) {
+			return opt;
+		}
+	}
+
+	return std::optional<Intersection>();
+}
+
+/**
+ * Checks whether anything blocks a shadow ray. If the pixel has a shadow cache,
+ * the object that blocked the last shadow ray to the same light is tested first.
+ * 
+ * @param origin	The origin of the ray
+ * @param dir		The direction of the ray
+ * @param maxT		The distance to the light. Objects at or beyond it do not block the ray
+ * @param light		The index of the light the ray is traced towards
+ * @param context	The state of the pixel being traced
+ * @return			True if the ray is blocked
+ */
+bool occluded(glm::dvec3 origin, glm::dvec3 dir, double maxT, int light, TraceContext& context)
+{
+	ShadowCache* cache = context.shadowCache;
+	Object* cached = nullptr;
+
+	if (cache != nullptr) {
+		cache->rays++;
+		cached = cache->occluders[light];
+
+		if (cached != nullptr) {
+			context.primitiveTests++;
+			auto opt = cached->hit(origin, dir);
+
+			if (opt.has_value() && opt->t < maxT) {
+				cache->hits++;
+				return true;
+			}
+		}
+	}
+
+	Object* occluder = context.geometry->occluded(origin, dir, maxT, cached, context.primitiveTests);
+
+	if (occluder != nullptr && cache != nullptr)
+		cache->occluders[light] = occluder;
+
+	return occluder != nullptr;
+}
+
+/**
+ * Calculates phong lighting for the intersection and scene
+ *
+ * @param eye		The viewing location for the illumination calculation
+ * @param inter		The intersection info
+ * @param frame		The frame we are rendering
+ * @return			The RGB value of the lighting
+ * 
+ * @note This is no longer used, but was left here just in case I wanted to add an 
+ *       option to use it
+ */
+glm::dvec3 phong(glm::dvec3 eye, Intersection inter, Frame& frame)
+{
+	glm::dvec3 view = glm::normalize(eye - inter.pos);
+
+	glm::dvec3 finalColor(0.0);
+	uint64_t tests = 0;
+
+	// Go through all the lights in the scene and calculate all the all lighting,
+	// and average them together
+	for (std::shared_ptr<Light> l : frame.lights) {
+		glm::dvec3 lDir = glm::normalize(l->position - inter.pos);
+
+		auto opt = intersection(inter.pos, lDir, frame, glm::length(l->position - inter.pos), tests);
+		if (opt.has_value())
+			continue;
+
+		const Material& material = frame.materials[inter.material];
+
+		double 		sDiff = glm::max(glm::dot(inter.norm, lDir), 0.0);
+		glm::dvec3	diff = sDiff * material.diffuse * l->diffuse;
+
+		glm::dvec3 ref = glm::reflect(-lDir, inter.norm);
+
+		double sSpec = glm::pow(glm::max(glm::dot(view, ref), 0.0), material.shininess);
+		glm::dvec3 spec = sSpec * material.specular * l->specular;
+
+		finalColor += diff + spec;
+	}
+
+	return finalColor;
+}
+
+/**
+ * Calculates the blinn-phong lighting from a single light, assuming nothing
+ * blocks it
+ *
+ * @param view		The direction from the intersection to the eye
+ * @param inter		The intersection info
+ * @param material	The material at the intersection
+ * @param light		The light to shade with
+ * @param lDir		The direction from the intersection to the light
+ * @param distance	The distance from the intersection to the light
+ * @return			The RGB value of the lighting
+ */
+glm::dvec3 blinnUnshadowed(glm::dvec3 view, Intersection& inter, const Material& material, Light& light, glm::dvec3 lDir, double distance)
+{
+	double 		sDiff = glm::max(glm::dot(inter.norm, lDir), 0.0);
+	glm::dvec3	diff = sDiff * material.diffuse * light.diffuse;
+
+	glm::dvec3 halfway = glm::normalize(view + lDir);
+	double sSpec = glm::pow(glm::max(glm::dot(halfway, inter.norm), 0.0), 4.0 * material.shininess);
+	glm::dvec3 spec = sSpec * material.specular * light.specular;
+
+	return (diff + spec) * light.falloff(distance);
+}
+
+/**
+ * Calculates the blinn-phong lighting from a single light, if the light is not
+ * blocked by an object
+ * 
+ * @param view		The direction from the intersection to the eye
+ * @param inter		The intersection info
+ * @param index		The index of the light to shade with
+ * @param frame		The frame we are rendering
+ * @param context	The state of the pixel being traced
+ * @return			The RGB value of the lighting
+ */
+glm::dvec3 blinnLight(glm::dvec3 view, Intersection& inter, int index, Frame& frame, TraceContext& context)
+{
+	Light& light = *frame.lights[index];
+	glm::dvec3 lDir = glm::normalize(light.position - inter.pos);
+	double distance = glm::length(light.position - inter.pos);
+
+	// Lights that are too far away to matter do not need a shadow ray
+	if (context.lightRanges != nullptr && distance >= (*context.lightRanges)[index])
+		return glm::dvec3(0.0);
+
+	// The shadow ray runs from the hit point to the light
+	if (context.recordBounds)
+		context.rayBounds.extend(light.position);
+
+	context.rays++;
+	if (occluded(inter.pos, lDir, distance, index, context))
+		return glm::dvec3(0.0);
+
+	return blinnUnshadowed(view, inter, frame.materials[inter.material], light, lDir, distance);
+}
+
+/**
+ * Calculates blinn-phong lighting for the intersection and scene
+ * 
+ * @param eye		The viewing location for the illumination calculation
+ * @param inter		The intersection info
+ * @param frame		The frame we are rendering
+ * @param context	The state of the pixel being traced
+ * @param primary	Whether the intersection was seen directly from the eye
+ * @return			The RGB value of the lighting
+ */
+glm::dvec3 blinn(glm::dvec3 eye, Intersection inter, Frame& frame, TraceContext& context, bool primary)
+{
+	glm::dvec3 view = glm::normalize(eye - inter.pos);
+
+	glm::dvec3 finalColor(0.0);
+
+	// With many lights, only shade with a few that are picked by how much they are
+	// likely to contribute. Dividing by the chance of picking each light keeps the
+	// average the same as shading with every light.
+	if (context.lightTree != nullptr) {
+		for (int i = 0; i < context.lightSamples; i++) {
+			double pdf;
+			int index = context.lightTree->sample(inter.pos, context.random, pdf);
+
+			finalColor += blinnLight(view, inter, index, frame, context) / pdf;
+		}
+
+		return finalColor / (double)context.lightSamples;
+	}
+
+	// Points seen directly through a tile can only be reached by the tile's lights
+	if (primary && context.tileLights != nullptr) {
+		for (int i : *context.tileLights)
+			finalColor += blinnLight(view, inter, i, frame, context);
+
+		return finalColor;
+	}
+
+	for (int i = 0; i < (int)frame.lights.size(); i++) {
+		finalColor += blinnLight(view, inter, i, frame, context);
+	}
+
+	return finalColor;
+}
+
+/**
+ * Writes the color of a pixel to a surface
+ *
+ * @param surface	The surface to write to
+ * @param px		The x coordinate of the pixel
+ * @param py		The y coordinate of the pixel, counting up from the bottom of the image
+ * @param color		The color, which is clamped to 1
+ */
+void storePixel(SDL_Surface* surface, int px, int py, glm::dvec3 color)
+{
+	uint8_t r = glm::floor(color.r >= 1.0 ? 255 : color.r * 256.0);
+	uint8_t g = glm::floor(color.g >= 1.0 ? 255 : color.g * 256.0);
+	uint8_t b = glm::floor(color.b >= 1.0 ? 255 : color.b * 256.0);
+
+	uint8_t* row = (uint8_t*)surface->pixels + (size_t)(surface->h - py - 1) * surface->pitch;
+	((uint32_t*)row)[px] = (uint32_t)SDL_MapRGB(surface->format, r, g, b);
+}
+
+/**
+ * Traces a ray through the specified frame of a scene
+ * 
+ * @param orig		The origin of the ray
+ * @param dir		The direction of the ray
+ * @param frame		The frame to render
+ * @param maxDepth	The maximum number of reflectoins
+ * @param context	The state of the pixel being traced
+ * @param primary	Whether this is the ray from the eye, rather than a reflection
+ * @return			The traced color
+ * 
+ * @note While cleaning up the code a bit to upload to github, I found a few potential problems:
+ * - Lighting for reflections is always calculated using the camera position. It should probaby
+ *   be based off the ray we are tracing, not the camera's position
+ * - If the maximum depth is reached, we return black, not the background color
+ * - The calculation of the reflection color with the objects color probably needs another look.
+ *   Maybe the diffuse and specular components should be seperate? I'm not sure about this one.
+ * 
+ * I am currently too busy with helping my Dad in the garage, applying to places, and a minecraft
+ * project to fix these at the moment. 
+ */
+glm::dvec3 trace(glm::dvec3 orig, glm::dvec3 dir, Frame& frame, int maxDepth, TraceContext& context, bool primary = false)
+{	
+	// If we reached our max-depth, return 0
+	if (maxDepth == 0)
+		return { 0.0, 0.0, 0.0 };
+
+	context.rays++;
+
+	// Get the closest intersection, if any
+	auto interOpt = context.geometry->intersect(orig, dir, context.primitiveTests);
+
+	// Return the background if there is no intersection. A reflection that leaves
+	// the scene could be blocked by an object anywhere along the ray.
+	if (!interOpt.has_value()) {
+		if (context.recordBounds && !primary)
+			context.rayBounds = BoundingBox::infinite();
+
+		return frame.background;
+	}
+	
+	Intersection inter = interOpt.value();
+
+	// Every reflection and shadow ray starts at this point
+	if (context.recordBounds)
+		context.rayBounds.extend(inter.pos);
+
+	glm::dvec3 ref = glm::reflect(dir, inter.norm);
+
+	// Trace the reflection and get it's color
+	glm::dvec3 refColor = trace(inter.pos, ref, frame, maxDepth - 1, context);
+		
+	return refColor * frame.materials[inter.material].specular + blinn(frame.camera.position, interOpt.value(), frame, context, primary);
+}
+
+/**
+ * A ray waiting in a wavefront queue
+ */
+struct WavefrontRay
+{
+	/// The origin and direction of the ray
+	glm::dvec3	origin, dir;
+
+	/// How much the color found along the ray adds to its pixel
+	glm::dvec3	weight;
+
+	/// The index of the ray's pixel within the tile
+	int			pixel;
+
+	/// The index of the random numbers of the ray's sample
+	int			sample;
+};
+
+/**
+ * A ray of a wavefront queue that hit an object
+ */
+struct WavefrontHit
+{
+	/// The closest intersection along the ray
+	Intersection	inter;
+
+	/// The index of the ray in the queue
+	int				ray;
+};
+
+/**
+ * A shadow ray waiting to be traced, with the light it adds if nothing blocks it
+ */
+struct ShadowRay
+{
+	/// The origin and direction of the ray
+	glm::dvec3	origin, dir;
+
+	/// The distance to the light
+	double		maxT;
+
+	/// The index of the light
+	int			light;
+
+	/// The index of the ray's pixel within the tile
+	int			pixel;
+
+	/// The color added to the pixel if the light is not blocked
+	glm::dvec3	color;
+};
+
+/**
+ * The state of a pixel of the tile being traced
+ */
+struct WavefrontPixel
+{
+	/// The index of the pixel in the image
+	size_t		index;
+
+	/// The sum of the colors of the pixel's samples
+	glm::dvec3	color;
+
+	/// The number of rays traced and intersection tests done for the pixel
+	uint64_t	rays, tests;
+
+	/// Bounds of every reflection and shadow ray traced for the pixel
+	BoundingBox	rayBounds;
+};
+
+/**
+ * The queues used to trace a tile. Each thread keeps its own, so their memory
+ * is reused from tile to tile.
+ */
+struct WavefrontQueues
+{
+	std::vector<WavefrontPixel>	pixels;
+	std::vector<SampleRandom>	samples;
+	std::vector<WavefrontRay>	rays, next;
+	std::vector<WavefrontHit>	hits;
+	std::vector<ShadowRay>		shadows, sortedShadows;
+
+	/// Sort keys and the indices of the rays or hits they belong to
+	std::vector<std::pair<uint64_t, int>>	order;
+
+	/// The index of the first shadow ray to each light in the sorted shadow rays
+	std::vector<int>			lightStarts;
+};
+
+/**
+ * Spreads the lowest 10 bits of a number out so that there are two zero bits
+ * between each of them
+ *
+ * @param v	The number
+ * @return	The spread bits
+ */
+uint32_t spreadBits(uint32_t v)
+{
+	v &= 0x3ff;
+	v = (v | (v << 16)) & 0x030000ff;
+	v = (v | (v << 8)) & 0x0300f00f;
+	v = (v | (v << 4)) & 0x030c30c3;
+	v = (v | (v << 2)) & 0x09249249;
+
+	return v;
+}
+
+/**
+ * Gets which of the eight octants a direction points into
+ *
+ * @param dir	The direction
+ * @return		The octant, with one bit for the sign of each axis
+ */
+uint32_t octant(glm::dvec3 dir)
+{
+	return (dir.x < 0.0 ? 1 : 0) | (dir.y < 0.0 ? 2 : 0) | (dir.z < 0.0 ? 4 : 0);
+}
+
+/**
+ * Sorts the queued rays by the octant of their direction, then along a Morton
+ * curve through their origins, so that rays traced one after another take
+ * similar paths
+ *
+ * @param queues	The queues of the tile. The next queue is used as scratch space.
+ */
+void sortRays(WavefrontQueues& queues)
+{
+	BoundingBox bounds;
+	for (WavefrontRay& ray : queues.rays)
+		bounds.extend(ray.origin);
+
+	glm::dvec3 scale = 1023.0 / glm::max(bounds.max - bounds.min, glm::dvec3(1e-12));
+
+	// Sort small keys rather than the rays themselves
+	queues.order.clear();
+	for (int i = 0; i < (int)queues.rays.size(); i++) {
+		WavefrontRay& ray = queues.rays[i];
+		glm::uvec3 cell = glm::uvec3((ray.origin - bounds.min) * scale);
+		uint32_t morton = spreadBits(cell.x) | (spreadBits(cell.y) << 1) | (spreadBits(cell.z) << 2);
+		queues.order.push_back({ ((uint64_t)octant(ray.dir) << 30) | morton, i });
+	}
+
+	std::sort(queues.order.begin(), queues.order.end());
+
+	queues.next.clear();
+	for (std::pair<uint64_t, int>& entry : queues.order)
+		queues.next.push_back(queues.rays[entry.second]);
+
+	std::swap(queues.rays, queues.next);
+}
+
+/**
+ * Sorts the queued shadow rays by their light. Rays to the same light keep their
+ * order, so rays from neighbouring hits stay next to each other.
+ *
+ * @param queues	The queues of the tile
+ * @param lights	The number of lights in the frame
+ */
+void sortShadowRays(WavefrontQueues& queues, int lights)
+{
+	queues.lightStarts.assign(lights + 1, 0);
+	for (ShadowRay& shadow : queues.shadows)
+		queues.lightStarts[shadow.light + 1]++;
+
+	for (int l = 0; l < lights; l++)
+		queues.lightStarts[l + 1] += queues.lightStarts[l];
+
+	queues.sortedShadows.resize(queues.shadows.size());
+	for (ShadowRay& shadow : queues.shadows)
+		queues.sortedShadows[queues.lightStarts[shadow.light]++] = shadow;
+
+	std::swap(queues.shadows, queues.sortedShadows);
+}
+
+/**
+ * Adds the shadow ray from an intersection to a light to the queue, unless the
+ * light is too far away to matter
+ *
+ * @param queues	The queues of the tile
+ * @param frame		The frame we are rendering
+ * @param culling	The ranges of the lights
+ * @param view		The direction from the intersection to the eye
+ * @param inter		The intersection info
+ * @param ray		The ray that hit the intersection
+ * @param index		The index of the light
+ * @param scale		The factor the light's contribution is multiplied by
+ * @param recordBounds	Whether the bounds of the shadow ray should be recorded
+ */
+void queueShadowRay(WavefrontQueues& queues, Frame& frame, const LightCulling& culling, glm::dvec3 view, Intersection& inter,
+					WavefrontRay& ray, int index, double scale, bool recordBounds)
+{
+	Light& light = *frame.lights[index];
+	glm::dvec3 lDir = glm::normalize(light.position - inter.pos);
+	double distance = glm::length(light.position - inter.pos);
+
+	if (distance >= culling.ranges[index])
+		return;
+
+	WavefrontPixel& pixel = queues.pixels[ray.pixel];
+	if (recordBounds)
+		pixel.rayBounds.extend(light.position);
+
+	pixel.rays++;
+
+	glm::dvec3 color = blinnUnshadowed(view, inter, frame.materials[inter.material], light, lDir, distance) * scale * ray.weight;
+	queues.shadows.push_back({ inter.pos, lDir, distance, index, ray.pixel, color });
+}
+
+/**
+ * Traces every sample of a tile in wavefront order: all rays of one bounce are
+ * intersected, then all their hits are shaded, then all the shadow rays they
+ * spawned are traced, before moving on to the reflections. Each stage runs over
+ * a sorted queue, so neighbouring work touches the same objects and materials.
+ * Once few paths are left, they are finished one at a time with trace().
+ *
+ * The colors match trace() up to rounding. With a light tree, lights are picked
+ * in a different order, so the noise differs from trace().
+ *
+ * @param queues		The queues of the calling thread
+ * @param x0, y0		The first pixel of the tile
+ * @param x1, y1		One past the last pixel of the tile
+ * @param surface		The surface being rendered to
+ * @param frame			The frame we are rendering
+ * @param frameNumber	The number of the frame
+ * @param view			The view of the frame's camera
+ * @param sampler		The sample pattern
+ * @param config		The render configuration
+ * @param geometry		The objects of the frame
+ * @param lightTree		The tree to pick lights from, or NULL to shade with every light
+ * @param culling		The lights that can reach each tile
+ * @param cache			The shadow cache of the calling thread, or NULL to not use one
+ * @param history		The history of the frames, or NULL
+ * @param stats			The stats of the frame, which the pixels' costs are written to
+ * @return				The number of rays traced
+ */
+uint64_t traceTile(WavefrontQueues& queues, int x0, int y0, int x1, int y1, SDL_Surface* surface, Frame& frame, int frameNumber,
+				   View& view, Sampler& sampler, Configuration& config, const SceneGeometry& geometry, const LightTree* lightTree,
+				   const LightCulling& culling, ShadowCache* cache, FrameHistory* history, RenderStats& stats)
+{
+	bool incremental = history != nullptr && !history->dirty.empty();
+	bool recordBounds = history != nullptr;
+
+	queues.pixels.clear();
+	queues.samples.clear();
+	queues.rays.clear();
+
+	// Start with the primary ray of every sample of every pixel that needs tracing
+	for (int py = y0; py < y1; py++) {
+		for (int px = x0; px < x1; px++) {
+			size_t index = (size_t)py * surface->w + px;
+
+			if (incremental && !history->dirty[index])
+				continue;
+
+			int pixel = (int)queues.pixels.size();
+			queues.pixels.push_back({ index, glm::dvec3(0.0), 0, 0, BoundingBox() });
+
+			uint32_t pixelSeed = sampler.pixelSeed((uint32_t)index);
+			for (int s = 0; s < sampler.count(); s++) {
+				glm::dvec2 offset = sampler.sample(s, px, py, pixelSeed);
+				glm::dvec3 p = view.ll + view.cx * ((double)px + offset.x) + view.cy * ((double)py + offset.y);
+				// Normalized twice like the primary rays of renderFrame(), so both modes trace exactly the same rays
+				glm::dvec3 dir = glm::normalize(glm::normalize(p - view.eye));
+
+				queues.rays.push_back({ view.eye, dir, glm::dvec3(1.0), pixel, (int)queues.samples.size() });
+				queues.samples.push_back(SampleRandom(config.seed, frameNumber, (uint32_t)index, s));
+			}
+		}
+	}
+
+	if (queues.pixels.empty())
+		return 0;
+
+	uint64_t startCycles = config.heatmap ? readCycleCounter() : 0;
+
+	const std::vector<int>* tileLights = culling.tiles.empty() ? nullptr
+		: &culling.tiles[(size_t)(y0 / LIGHT_TILE_SIZE) * culling.tilesX + x0 / LIGHT_TILE_SIZE];
+
+	TraceContext shadowContext;
+	shadowContext.geometry = &geometry;
+	shadowContext.shadowCache = cache;
+
+	for (int depth = 0; depth < TRACE_DEPTH && !queues.rays.empty(); depth++) {
+		// Once only a few paths are left, there is little to gain from sorting them,
+		// and following each path on its own keeps its rays close together
+		if (depth > 0 && (int)queues.rays.size() < WAVEFRONT_MIN_RAYS) {
+			for (WavefrontRay& ray : queues.rays) {
+				WavefrontPixel& pixel = queues.pixels[ray.pixel];
+
+				TraceContext context;
+				context.recordBounds = recordBounds;
+				context.rayBounds = pixel.rayBounds;
+				context.random = queues.samples[ray.sample];
+				context.geometry = &geometry;
+				context.lightTree = lightTree;
+				context.lightSamples = config.lightSamples;
+				context.shadowCache = cache;
+				context.lightRanges = &culling.ranges;
+
+				pixel.color += ray.weight * trace(ray.origin, ray.dir, frame, TRACE_DEPTH - depth, context);
+
+				pixel.rayBounds = context.rayBounds;
+				pixel.rays += context.rays;
+				pixel.tests += context.primitiveTests;
+			}
+
+			break;
+		}
+
+		// Primary rays are already in order across the tile
+		if (depth > 0)
+			sortRays(queues);
+
+		queues.hits.clear();
+		for (int i = 0; i < (int)queues.rays.size(); i++) {
+			WavefrontRay& ray = queues.rays[i];
+			WavefrontPixel& pixel = queues.pixels[ray.pixel];
+
+			pixel.rays++;
+			auto inter = geometry.intersect(ray.origin, ray.dir, pixel.tests);
+
+			if (inter.has_value()) {
+				if (recordBounds)
+					pixel.rayBounds.extend(inter->pos);
+
+				queues.hits.push_back({ inter.value(), i });
+			}
+			else {
+				if (recordBounds && depth > 0)
+					pixel.rayBounds = BoundingBox::infinite();
+
+				pixel.color += ray.weight * frame.background;
+			}
+		}
+
+		// Shade hits on the same material together
+		queues.order.clear();
+		for (int i = 0; i < (int)queues.hits.size(); i++)
+			queues.order.push_back({ (uint64_t)queues.hits[i].inter.material, i });
+
+		std::sort(queues.order.begin(), queues.order.end());
+
+		queues.shadows.clear();
+		queues.next.clear();
+		for (std::pair<uint64_t, int>& entry : queues.order) {
+			WavefrontHit& hit = queues.hits[entry.second];
+			WavefrontRay& ray = queues.rays[hit.ray];
+			Intersection& inter = hit.inter;
+
+			glm::dvec3 view = glm::normalize(frame.camera.position - inter.pos);
+
+			if (lightTree != nullptr) {
+				for (int i = 0; i < config.lightSamples; i++) {
+					double pdf;
+					int index = lightTree->sample(inter.pos, queues.samples[ray.sample], pdf);
+
+					queueShadowRay(queues, frame, culling, view, inter, ray, index, 1.0 / (pdf * config.lightSamples), recordBounds);
+				}
+			}
+			else if (depth == 0 && tileLights != nullptr) {
+				for (int index : *tileLights)
+					queueShadowRay(queues, frame, culling, view, inter, ray, index, 1.0, recordBounds);
+			}
+			else {
+				for (int index = 0; index < (int)frame.lights.size(); index++)
+					queueShadowRay(queues, frame, culling, view, inter, ray, index, 1.0, recordBounds);
+			}
+
+			// Reflections that cannot add anything to the pixel are not traced
+			glm::dvec3 weight = ray.weight * frame.materials[inter.material].specular;
+			if (depth + 1 < TRACE_DEPTH && weight != glm::dvec3(0.0))
+				queues.next.push_back({ inter.pos, glm::reflect(ray.dir, inter.norm), weight, ray.pixel, ray.sample });
+		}
+
+		// Shadow rays to the same light are likely blocked by the same objects
+		sortShadowRays(queues, (int)frame.lights.size());
+
+		for (ShadowRay& shadow : queues.shadows) {
+			WavefrontPixel& pixel = queues.pixels[shadow.pixel];
+
+			shadowContext.primitiveTests = 0;
+			if (!occluded(shadow.origin, shadow.dir, shadow.maxT, shadow.light, shadowContext))
+				pixel.color += shadow.color;
+
+			pixel.tests += shadowContext.primitiveTests;
+		}
+
+		std::swap(queues.rays, queues.next);
+	}
+
+	uint64_t rays = 0;
+
+	// The cycles of the tile are shared evenly between its pixels
+	double cycles = config.heatmap ? (double)(readCycleCounter() - startCycles) / queues.pixels.size() : 0.0;
+
+	for (WavefrontPixel& pixel : queues.pixels) {
+		int px = (int)(pixel.index % surface->w);
+		int py = (int)(pixel.index / surface->w);
+
+		if (history != nullptr)
+			history->rayBounds[pixel.index] = pixel.rayBounds;
+
+		if (config.heatmap) {
+			float* cost = &stats.pixelCost[((size_t)(surface->h - py - 1) * surface->w + px) * 3];
+			cost[0] = (float)cycles;
+			cost[1] = (float)pixel.rays;
+			cost[2] = (float)pixel.tests;
+		}
+
+		rays += pixel.rays;
+		storePixel(surface, px, py, pixel.color / (double)sampler.count());
+	}
+
+	return rays;
+}
+
+/**
+ * Renders a frame tile by tile with traceTile()
+ *
+ * @param window		The window to display the render in, or NULL
+ * @param surface		The surface to render to
+ * @param frame			The frame to render
+ * @param frameNumber	The number of the frame
+ * @param view			The view of the frame's camera
+ * @param sampler		The sample pattern
+ * @param config		The render configuration
+ * @param geometry		The objects of the frame
+ * @param lightTree		The tree to pick lights from, or NULL to shade with every light
+ * @param culling		The lights that can reach each tile
+ * @param history		The history of the frames, or NULL
+ * @param stats			Set to the stats of the render
+ */
+void renderWavefront(SDL_Window* window, SDL_Surface* surface, Frame& frame, int frameNumber, View& view, Sampler& sampler,
+					 Configuration& config, const SceneGeometry& geometry, const LightTree* lightTree, const LightCulling& culling,
+					 FrameHistory* history, RenderStats& stats)
+{
+	int tilesX = (surface->w + LIGHT_TILE_SIZE - 1) / LIGHT_TILE_SIZE;
+	int tilesY = (surface->h + LIGHT_TILE_SIZE - 1) / LIGHT_TILE_SIZE;
+
+	uint64_t rays = 0, shadowRays = 0, shadowHits = 0;
+
+	#pragma omp parallel reduction(+:rays, shadowRays, shadowHits)
+	{
+		ShadowCache cache;
+		cache.occluders.resize(frame.lights.size(), nullptr);
+
+		WavefrontQueues queues;
+
+		// Tiles differ a lot in cost, so they are handed out one at a time
+		#pragma omp for schedule(dynamic)
+		for (int tile = 0; tile < tilesX * tilesY; tile++) {
+			TimelineScope tileScope("tile", "index", tile);
+
+			int x0 = (tile % tilesX) * LIGHT_TILE_SIZE;
+			int y0 = (tile / tilesX) * LIGHT_TILE_SIZE;
+			int x1 = std::min(x0 + LIGHT_TILE_SIZE, surface->w);
+			int y1 = std::min(y0 + LIGHT_TILE_SIZE, surface->h);
+
+			rays += traceTile(queues, x0, y0, x1, y1, surface, frame, frameNumber, view, sampler, config, geometry, lightTree,
+							  culling, config.shadowCache ? &cache : nullptr, history, stats);
+
+			if (window)
+				updateWindow(window);
+		}
+
+		shadowRays += cache.rays;
+		shadowHits += cache.hits;
+	}
+
+	stats.rays = rays;
+	stats.shadowRays = shadowRays;
+	stats.shadowCacheHits = shadowHits;
+}
+
+/**
+ * Traces every pixel of a frame, one row at a time on each thread. The loop is
+ * compiled for each number of samples it is commonly run with, so that the loop
+ * over the samples of a pixel can be unrolled. SAMPLES is the number of samples
+ * per pixel, or 0 to read it from the sampler.
+ *
+ * @param window		The window to display the render in, or NULL
+ * @param surface		The surface to render to
+ * @param frame			The frame to render
+ * @param frameNumber	The number of the frame
+ * @param view			The view of the frame's camera
+ * @param sampler		The sample pattern. When SAMPLES is not 0, it must have that many samples
+ * @param config		The render configuration
+ * @param geometry		The objects of the frame
+ * @param lightTree		The tree to pick lights from, or NULL to shade with every light
+ * @param culling		The lights that can reach each tile
+ * @param history		The history of the frames, or NULL
+ * @param incremental	Whether only the pixels marked dirty in the history are traced
+ * @param stats			Set to the stats of the render
+ */
+template <int SAMPLES>
+static void renderPixels(SDL_Window* window, SDL_Surface* surface, Frame& frame, int frameNumber, View& view, Sampler& sampler,
+						 Configuration& config, const SceneGeometry& geometry, const LightTree* lightTree, const LightCulling& culling,
+						 FrameHistory* history, bool incremental, RenderStats& stats)
+{
+	const bool display = window != nullptr;
+	const bool heatmap = config.heatmap;
+	const int samples = SAMPLES > 0 ? SAMPLES : sampler.count();
+
+	glm::dvec3	eye = view.eye;
+	glm::dvec3	ll	= view.ll;
+	glm::dvec3	cx	= view.cx;
+	glm::dvec3	cy	= view.cy;
+
+	uint64_t rays = 0, shadowRays = 0, shadowHits = 0;
+
+	// Use OpenMP to render many pixels at once. Parallelizing multiple rows 
+	// rather than individual pixels proved to be quicker when displaying to a window
+	#pragma omp parallel reduction(+:rays, shadowRays, shadowHits)
+	{
+		ShadowCache cache;
+		cache.occluders.resize(frame.lights.size(), nullptr);
+
+		#pragma omp for
+		for (int py = 0; py < surface->h; py++) {
+			TimelineScope rowScope("row", "y", py);
+
+			for (int px = 0; px < surface->w; px++) {
+				size_t index = (size_t)py * surface->w + px;
+
+				// Pixels that cannot have changed keep their color from the last frame
+				if (incremental && !history->dirty[index])
+					continue;
+
+				uint64_t startCycles = heatmap ? readCycleCounter() : 0;
+
+				glm::dvec3 color(0.0);
+
+				TraceContext context;
+				context.recordBounds = history != nullptr;
+				context.geometry = &geometry;
+				context.lightTree = lightTree;
+				context.lightSamples = config.lightSamples;
+				context.shadowCache = config.shadowCache ? &cache : nullptr;
+				context.lightRanges = &culling.ranges;
+
+				if (!culling.tiles.empty())
+					context.tileLights = &culling.tiles[(size_t)(py / LIGHT_TILE_SIZE) * culling.tilesX + px / LIGHT_TILE_SIZE];
+			
+				// Calculate subpixels (if enabled) 
+				uint32_t pixelSeed = sampler.pixelSeed((uint32_t)index);
+				for (int s = 0; s < samples; s++) {
+					context.random = SampleRandom(config.seed, frameNumber, (uint32_t)index, s);
+
+					glm::dvec2 offset = sampler.sample(s, px, py, pixelSeed);
+					double x = (double)px + offset.x;
+					double y = (double)py + offset.y;
+
+					//calculate the ray for this pixel
+					glm::dvec3 p = ll + cx * x + cy * y;
+					glm::dvec3 dir = glm::normalize(p - eye);
+
+					color += trace(eye, glm::normalize(dir), frame, TRACE_DEPTH, context, true);
+				}
+
+				if (history != nullptr)
+					history->rayBounds[index] = context.rayBounds;
+
+				rays += context.rays;
+
+				// The cost map is stored top row first, like the image
+				if (heatmap) {
+					float* cost = &stats.pixelCost[((size_t)(surface->h - py - 1) * surface->w + px) * 3];
+					cost[0] = (float)(readCycleCounter() - startCycles);
+					cost[1] = (float)context.rays;
+					cost[2] = (float)context.primitiveTests;
+				}
+
+				// Average the colors of our subpixels
+				storePixel(surface, px, py, color / (double)samples);
+			
+				// Update the window if we have one
+				if (display)
+					updateWindow(window);
+			}
+		}
+
+		shadowRays += cache.rays;
+		shadowHits += cache.hits;
+	}
+
+	stats.rays = rays;
+	stats.shadowRays = shadowRays;
+	stats.shadowCacheHits = shadowHits;
+}
+
+/// A loop over the pixels of a frame, compiled for a number of samples
+typedef void (*PixelLoop)(SDL_Window*, SDL_Surface*, Frame&, int, View&, Sampler&, Configuration&, const SceneGeometry&,
+						  const LightTree*, const LightCulling&, FrameHistory*, bool, RenderStats&);
+
+/**
+ * Picks the loop over the pixels compiled for a number of samples per pixel.
+ * Numbers of samples other than the square ones the grid pattern can have use a
+ * loop that reads the number of samples from the sampler.
+ *
+ * @param samples	The number of samples per pixel
+ * @return			The loop
+ */
+static PixelLoop pickPixelLoop(int samples)
+{
+	switch (samples) {
+	case 1:
+		return renderPixels<1>;
+	case 4:
+		return renderPixels<4>;
+	case 9:
+		return renderPixels<9>;
+	case 16:
+		return renderPixels<16>;
+	default:
+		return renderPixels<0>;
+	}
+}
+
+/**
+ * Prints how well the bounding volume hierarchy of a frame separates its objects:
+ * how much sibling nodes overlap, and how many nodes and objects a ray through the
+ * center of every pixel is tested against. Unless the frame is built with SAH, an
+ * SAH hierarchy is measured too, for comparison. Planes are left out, since they
+ * are not in the hierarchy.
+ *
+ * @param frame		The frame
+ * @param view		The view of the frame's camera
+ * @param width		The width of the image in pixels
+ * @param height	The height of the image in pixels
+ * @param config	The configuration, which decides how the hierarchy is built
+ */
+static void reportBvh(Frame& frame, const View& view, int width, int height, const Configuration& config)
+{
+	std::vector<Object*> bounded;
+	for (std::shared_ptr<Object>& object : frame.objects) {
+		if (object->type != ObjectType::PLANE && object->bounds().isFinite())
+			bounded.push_back(object.get());
+	}
+
+	BvhBuilder builder = config.bvhBuilder.value_or(BvhBuilder::SAH);
+	std::vector<BvhBuilder> builders = { BvhBuilder::SAH };
+	if (builder != BvhBuilder::SAH)
+		builders.push_back(builder);
+
+	const char* names[] = { "sah", "lbvh", "treelets", "sbvh" };
+	double sahSteps = 0.0;
+
+	for (BvhBuilder measured : builders) {
+		Bvh bvh(bounded, measured, config.bvhSplitBudget);
+
+		uint64_t steps = 0, tests = 0;
+		for (int y = 0; y < height; y++) {
+			for (int x = 0; x < width; x++) {
+				glm::dvec3 dir = glm::normalize(view.ll + view.cx * (x + 0.5) + view.cy * (y + 0.5) - view.eye);
+				bvh.intersect(view.eye, dir, std::numeric_limits<double>::infinity(), tests, &steps);
+			}
+		}
+
+		double pixels = std::max((double)width * height, 1.0);
+		std::cout << "BVH " << names[(int)measured] << ": " << bvh.nodeCount() << " nodes, "
+				  << bvh.referenceCount() << " references to " << bounded.size() << " objects, overlap "
+				  << std::fixed << std::setprecision(2) << bvh.overlap() << ", "
+				  << steps / pixels << " nodes and " << tests / pixels << " objects per primary ray";
+
+		if (measured == BvhBuilder::SAH)
+			sahSteps = steps / pixels;
+		else if (sahSteps > 0.0)
+			std::cout << " (" << std::setprecision(1) << 100.0 * (1.0 - steps / pixels / sahSteps) << "% fewer nodes than sah)";
+
+		std::cout << std::defaultfloat << std::endl;
+	}
+}
+
+RenderStats renderFrame(SDL_Window* window, SDL_Surface* surface, Frame& frame, int frameNumber, int maxDepth, int samples, SamplePattern pattern, Configuration config, FrameHistory* history)
+{
+	TimelineScope scope("renderFrame", "frame", frameNumber);
+
+	//Precalculate values that will be used for each pixel in the scene
+	View view = computeView(frame.camera, surface->w, surface->h);
+	Sampler sampler(pattern, samples, config.seed, frameNumber);
+
+	RenderStats stats;
+
+	std::optional<SceneGeometry> geometry;
+	{
+		TimelineScope scope("buildGeometry", "objects", frame.objects.size());
+		auto start = std::chrono::steady_clock::now();
+		geometry.emplace(frame, config.bvhBuilder.value_or(BvhBuilder::SAH), config.wideBvh, config.bvhSplitBudget, config.sphereGrid);
+		stats.buildTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		stats.bvhNodes = geometry->nodeCount();
+		stats.bvhMemory = geometry->memoryUsage();
+	}
+
+	if (config.bvhReport)
+		reportBvh(frame, view, surface->w, surface->h, config);
+
+	// Frames with no more lights than would be picked are shaded with every light
+	std::optional<LightTree> lightTree;
+	if (config.lightSamples > 0 && frame.lights.size() > (size_t)config.lightSamples) {
+		TimelineScope scope("buildLightTree", "lights", frame.lights.size());
+		lightTree.emplace(frame.lights);
+	}
+
+	LightCulling culling;
+	{
+		TimelineScope scope("cullLights", "lights", frame.lights.size());
+		culling = cullLights(frame, view, surface->w, surface->h);
+	}
+
+	bool incremental = history != nullptr && !history->dirty.empty();
+	if (history != nullptr)
+		history->rayBounds.resize((size_t)surface->w * surface->h);
+
+	if (config.heatmap)
+		stats.pixelCost.assign((size_t)surface->w * surface->h * 3, 0.0f);
+
+	auto traceStart = std::chrono::steady_clock::now();
+
+	if (config.wavefront) {
+		renderWavefront(window, surface, frame, frameNumber, view, sampler, config, geometry.value(), lightTree ? &lightTree.value() : nullptr,
+						culling, history, stats);
+		stats.traceTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - traceStart).count();
+		return stats;
+	}
+
+	PixelLoop loop = config.specialize ? pickPixelLoop(sampler.count()) : renderPixels<0>;
+	loop(window, surface, frame, frameNumber, view, sampler, config, geometry.value(), lightTree ? &lightTree.value() : nullptr,
+		 culling, history, incremental, stats);
+	stats.traceTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - traceStart).count();
+
+	return stats;
+}
+
+/**
+ * Finds the objects that changed between two frames. Only changes to bounded 
+ * objects can be tracked, so any other change means the whole frame has to be
+ * rendered again.
+ *
+ * @param previous	The frame that was rendered last
+ * @param current	The frame about to be rendered
+ * @return			The old and new bounds of every object that changed, or std::nullopt if
+ *					anything other than bounded objects changed
+ */
+std::optional<std::vector<BoundingBox>> findChanges(Frame& previous, Frame& current)
+{
+	if (previous.background != current.background || !previous.camera.equals(current.camera))
+		return std::nullopt;
+
+	if (previous.lights.size() != current.lights.size() || previous.objects.size() != current.objects.size())
+		return std::nullopt;
+
+	for (size_t i = 0; i < current.lights.size(); i++) {
+		if (!previous.lights[i]->equals(*current.lights[i]))
+			return std::nullopt;
+	}
+
+	// Objects refer to their materials by index, so an object can also change
+	// when the material at its index does
+	std::vector<bool> materialChanged(current.materials.size(), false);
+	bool anyMaterialChanged = false;
+	for (uint32_t m = 0; m < current.materials.size(); m++) {
+		materialChanged[m] = m >= previous.materials.size() || !(previous.materials[m] == current.materials[m]);
+		anyMaterialChanged = anyMaterialChanged || materialChanged[m];
+	}
+
+	auto usesChangedMaterial = [&](Object& object) {
+		if (!anyMaterialChanged)
+			return false;
+
+		if (materialChanged[object.material])
+			return true;
+
+		if (object.type == ObjectType::PARTICLES) {
+			for (uint32_t m : static_cast<Particles&>(object).materials) {
+				if (materialChanged[m])
+					return true;
+			}
+		}
+
+		return false;
+	};
+
+	std::vector<BoundingBox> changes;
+	for (size_t i = 0; i < current.objects.size(); i++) {
+		if (previous.objects[i]->equals(*current.objects[i]) && !usesChangedMaterial(*current.objects[i]))
+			continue;
+
+		BoundingBox box = previous.objects[i]->bounds();
+		box.extend(current.objects[i]->bounds());
+
+		if (!box.isFinite())
+			return std::nullopt;
+
+		// Pad the box slightly so that rays grazing the object are not missed
+		// because of rounding
+		glm::dvec3 pad = 1e-6 * (box.max - box.min) + 1e-9;
+		box.min -= pad;
+		box.max += pad;
+
+		changes.push_back(box);
+	}
+
+	return changes;
+}
+
+/**
+ * Marks the pixels whose primary rays could hit the passed box as dirty
+ *
+ * @param box		The box in world space
+ * @param view		The view of the camera
+ * @param width		The width of the image in pixels
+ * @param height	The height of the image in pixels
+ * @param dirty		The dirty flag for each pixel
+ */
+void markProjection(BoundingBox& box, View& view, int width, int height, std::vector<uint8_t>& dirty)
+{
+	double minX = width, maxX = -1.0;
+	double minY = height, maxY = -1.0;
+
+	for (int i = 0; i < 8; i++) {
+		glm::dvec3 corner(
+			(i & 1) ? box.max.x : box.min.x,
+			(i & 2) ? box.max.y : box.min.y,
+			(i & 4) ? box.max.z : box.min.z
+		);
+
+		glm::dvec3 w = corner - view.eye;
+		double depth = glm::dot(w, view.l);
+
+		// If part of the box is behind the eye, its projection is unbounded
+		if (depth <= 1e-9) {
+			std::fill(dirty.begin(), dirty.end(), 1);
+			return;
+		}
+
+		// Project onto the screen, inverting the calculation of the primary rays
+		double x = (glm::dot(w, view.v) * view.d / depth + view.a) * width / (2.0 * view.a);
+		double y = (glm::dot(w, view.u) * view.d / depth + 1.0) * height / 2.0;
+
+		minX = glm::min(minX, x);
+		maxX = glm::max(maxX, x);
+		minY = glm::min(minY, y);
+		maxY = glm::max(maxY, y);
+	}
+
+	// Every sample of a pixel lies within the pixel's square, so the covered pixels are the
+	// ones the projected rectangle touches. Add a pixel of margin for rounding.
+	int x0 = (int)glm::max(glm::floor(minX) - 1.0, 0.0);
+	int x1 = (int)glm::min(glm::floor(maxX) + 1.0, width - 1.0);
+	int y0 = (int)glm::max(glm::floor(minY) - 1.0, 0.0);
+	int y1 = (int)glm::min(glm::floor(maxY) + 1.0, height - 1.0);
+
+	for (int py = y0; py <= y1; py++) {
+		for (int px = x0; px <= x1; px++) {
+			dirty[(size_t)py * width + px] = 1;
+		}
+	}
+}
+
+/**
+ * Renders a frame of an animation, reusing as much of the previously rendered frame
+ * as possible. If the frame is identical to the last one, nothing is traced. If only
+ * bounded objects moved, only the pixels whose rays could see the old or new position 
+ * of those objects, either directly, in a reflection or through a shadow, are traced.
+ *
+ * @param window		The window to use for display, or NULL if we are not rendering to a window
+ * @param surface		The surface to render to
+ * @param frame			The frame to render
+ * @param animation		The animation being rendered
+ * @param config		The configuration settings for the renderer
+ * @param history		The information about the last frame rendered into the surface
+ * @param frameNumber	The number of the frame being rendered
+ * @param stats			Set to the statistics of the render, if the frame was rendered
+ * @return				The number of an earlier frame that is identical to this one, or -1 if
+ *						the frame was rendered
+ */
+int renderIncremental(SDL_Window* window, SDL_Surface* surface, Frame& frame, Animation& animation, Configuration& config, FrameHistory& history, int frameNumber, RenderStats& stats)
+{
+	if (!config.incremental) {
+		stats = renderFrame(window, surface, frame, frameNumber, animation.maxDepth, animation.samples, animation.pattern, config);
+		return -1;
+	}
+
+	history.dirty.clear();
+
+	if (history.valid) {
+		auto changes = findChanges(history.frame, frame);
+
+		if (changes.has_value() && changes->empty()) {
+			int reused = history.frameNumber;
+			history.frameNumber = frameNumber;
+			return reused;
+		}
+
+		// Random numbers are drawn differently for every frame, so with a randomized sample
+		// pattern or light sampling the pixels that were not traced again would not match
+		// the ones that were. Those frames are traced in full.
+		bool randomized = animation.pattern != SamplePattern::GRID || config.lightSamples > 0;
+
+		if (changes.has_value() && !randomized) {
+			TimelineScope scope("markDirty", "objects", changes->size());
+
+			View view = computeView(frame.camera, surface->w, surface->h);
+			history.dirty.resize((size_t)surface->w * surface->h, 0);
+
+			for (BoundingBox& box : *changes) {
+				markProjection(box, view, surface->w, surface->h, history.dirty);
+			}
+
+			// Pixels whose reflection or shadow rays pass through a changed object
+			#pragma omp parallel for
+			for (int i = 0; i < (int)history.dirty.size(); i++) {
+				for (size_t j = 0; j < changes->size() && !history.dirty[i]; j++) {
+					if (history.rayBounds[i].overlaps((*changes)[j]))
+						history.dirty[i] = 1;
+				}
+			}
+
+			size_t count = std::count(history.dirty.begin(), history.dirty.end(), 1);
+			std::cout << "tracing " << count << " of " << history.dirty.size() << " pixels, " << std::flush;
+		}
+	}
+
+	stats = renderFrame(window, surface, frame, frameNumber, animation.maxDepth, animation.samples, animation.pattern, config, &history);
+
+	history.valid = true;
+	history.frame = frame;
+	history.frameNumber = frameNumber;
+
+	return -1;
+}
+
+/**
+ * Interpolates the two passed frames based on the time value
+ * 
+ * @param f1	The start frame
+ * @param f2	The end frame
+ * @param alpha	The time value
+ * @return		The interpolated frame
+ */
+Frame interpolateFrames(Frame& f1, Frame& f2, double alpha)
+{
+	TimelineScope scope("interpolate");
+
+	// The new frame we calculated
+	Frame newFrame{};
+
+	// The new frame starts from the start frame's table, so every index taken over
+	// from the start frame stays valid. The end frame's table can be the smaller one,
+	// when a looping animation goes from the last keyframe back to the first.
+	newFrame.materials = f1.materials;
+
+	// Blends a material of the start frame with one of the end frame. Many objects
+	// share the same pair of materials, which is only blended once.
+	std::unordered_map<uint64_t, uint32_t> blended;
+	auto blend = [&](uint32_t a, uint32_t b) -> uint32_t {
+		if (f1.materials[a] == f2.materials[b])
+			return a;
+
+		uint64_t key = (uint64_t)a << 32 | b;
+		auto found = blended.find(key);
+		if (found != blended.end())
+			return found->second;
+
+		const Material& ma = f1.materials[a];
+		const Material& mb = f2.materials[b];
+
+		Material material;
+		material.diffuse = lerp(ma.diffuse, mb.diffuse, alpha);
+		material.specular = lerp(ma.specular, mb.specular, alpha);
+		material.shininess = lerp(ma.shininess, mb.shininess, alpha);
+
+		uint32_t index = newFrame.materials.add(material);
+		blended.emplace(key, index);
+		return index;
+	};
+	
+	//interpolate objects
+	int i = 0;
+	for ( ; i < f1.objects.size(); i++) {
+		// Interpolate the object as the class it was created as
+		std::shared_ptr<Object> newObject = visitObject(*f1.objects[i], [&](auto& start) -> std::shared_ptr<Object> {
+			auto typed = std::make_shared<std::decay_t<decltype(start)>>();
+			typed->interpolate(start, *f2.objects[i], alpha);
+			return typed;
+		});
+
+		newObject->material = blend(f1.objects[i]->material, f2.objects[i]->material);
+
+		if (newObject->type == ObjectType::PARTICLES) {
+			Particles& start = static_cast<Particles&>(*f1.objects[i]);
+			Particles& end = static_cast<Particles&>(*f2.objects[i]);
+			Particles& particles = static_cast<Particles&>(*newObject);
+
+			// Palettes of different lengths keep the start frame's indices
+			if (start.materials.size() == end.materials.size()) {
+				for (size_t m = 0; m < particles.materials.size(); m++)
+					particles.materials[m] = blend(start.materials[m], end.materials[m]);
+			}
+		}
+
+		newFrame.objects.push_back(newObject);
+	}
+
+	// Interpolate the lights in the scene
+	for (i = 0; i < f1.lights.size(); i++) {
+		std::shared_ptr<Light> newLight = std::make_shared<Light>();
+		newLight->interpolate(*f1.lights[i], *f2.lights[i], alpha);
+		newFrame.lights.push_back(newLight);
+	}
+
+	// Interpolate the background and camera 
+	newFrame.background = lerp(f1.background, f2.background, alpha);
+	newFrame.camera.interpolate(f1.camera, f2.camera, alpha);
+
+	return newFrame;
+}
+
+/**
+ * Checks whether a frame needs to be rendered. Frames outside of the selected
+ * range are skipped, as are frames that an earlier run already completed when
+ * resuming a render.
+ *
+ * @param frameNumber	The number of the frame
+ * @param animation		The animation being rendered
+ * @param config		The configuration settings for the renderer
+ * @param resuming		Whether frames from an earlier run can be reused
+ * @return				True if the frame should be rendered
+ */
+static bool shouldRender(int frameNumber, Animation& animation, Configuration& config, bool resuming)
+{
+	if (!config.frames.contains(frameNumber))
+		return false;
+
+	if (resuming && frameComplete(config, animation, frameNumber)) {
+		std::cout << "Skipping frame " << frameNumber << ": already rendered" << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+SDL_Surface* createFramebuffer(int width, int height)
+{
+	// Pad each row to whole cache lines, so no two threads write to the same line
+	// while rendering neighbouring rows
+	int pitch = (width * 4 + FRAMEBUFFER_ALIGNMENT - 1) / FRAMEBUFFER_ALIGNMENT * FRAMEBUFFER_ALIGNMENT;
+
+	uint8_t* memory = new uint8_t[(size_t)pitch * height + FRAMEBUFFER_ALIGNMENT - 1]();
+	uint8_t* pixels = (uint8_t*)(((uintptr_t)memory + FRAMEBUFFER_ALIGNMENT - 1) & ~(uintptr_t)(FRAMEBUFFER_ALIGNMENT - 1));
+
+	SDL_Surface* surface = SDL_CreateRGBSurfaceFrom(pixels, width, height, 32, pitch, 0x000000FF, 0x0000FF00, 0x00FF0000, 0xFF000000);
+	if (surface == nullptr) {
+		delete[] memory;
+		return nullptr;
+	}
+
+	// Keep the allocation so that it can be freed along with the surface
+	surface->userdata = memory;
+
+	return surface;
+}
+
+void freeFramebuffer(SDL_Surface* surface)
+{
+	if (surface == nullptr)
+		return;
+
+	uint8_t* memory = (uint8_t*)surface->userdata;
+	SDL_FreeSurface(surface);
+	delete[] memory;
+}
+
+void applySceneSettings(Configuration& config, const Animation& animation)
+{
+	if (!config.bvhBuilder.has_value())
+		config.bvhBuilder = animation.bvhBuilder;
+
+	config.bvhSplitBudget = animation.bvhSplitBudget;
+}
+
+void renderFrames(SDL_Window* window, SDL_Surface* surface, Animation animation, Configuration config) 
+{
+	applySceneSettings(config, animation);
+
+	// NOTE: The logic of this function could probably be simplified to have a single loop and less
+	//       branching based on special conditions
+
+	int frameNumber = 0;
+
+	if (animation.keyFrames.size() == 0) {
+		// Can't render if there are no keyframes
+		std::cerr << "Error: No Keyframes Found" << std::endl;
+		return;
+	}
+
+	// Frames left in the output folder can only be reused if they were rendered from the
+	// same scene with the same settings
+	bool resuming = false;
+	if (config.outputFormat != OutputFormat::NONE) {
+		bool manifestMatched = updateManifest(config, animation);
+		resuming = config.resume && manifestMatched;
+
+		if (config.resume && !manifestMatched)
+			std::cout << "Output folder does not match this scene and settings, rendering all frames" << std::endl;
+	}
+
+	if (animation.keyFrames.size() == 1) {
+		// If we only have one frame, render it without looping and without interpolation
+		if (!shouldRender(0, animation, config, resuming))
+			return;
+
+		RenderStats stats = renderFrame(window, surface, animation.keyFrames[0], 0, animation.maxDepth, animation.samples, animation.pattern, config);
+		if (config.outputFormat != OutputFormat::NONE) {
+			saveFrame(surface, config, 0);
+
+			if (config.heatmap)
+				saveCostMap(stats.pixelCost, surface->w, surface->h, config, 0);
+		}
+		return;
+	}
+
+	// for each pair of frames
+	int numKeyFrames = animation.keyFrames.size();
+
+	FrameHistory history;
+
+	for (int i = 0; i < numKeyFrames - (animation.loop ? 0 : 1); i++) {
+		// Get the first and last frames in the animation
+		Frame& startFrame = animation.keyFrames[i];
+		Frame& endFrame = animation.keyFrames[(i + 1) % numKeyFrames];
+
+		// Calculate our timestep between keyframes
+		int fps = animation.fps;
+		double deltaTime = startFrame.timeOffset;
+		int frameCount = deltaTime * fps;
+		double timeStep = deltaTime / (double)frameCount;
+		
+		double alpha = 0.0;
+
+		for (int j = 0; j < frameCount; j++, alpha += timeStep, frameNumber++) {
+			if (!shouldRender(frameNumber, animation, config, resuming))
+				continue;
+
+			TimelineScope scope("frame", "frame", frameNumber);
+
+			std::cout << "Rendering frame " << frameNumber << ": " << std::flush;
+			
+			uint32_t renderStartTime = SDL_GetTicks();
+
+			// If we have the start or end frame, render the frame as-is without interpolation. Otherwise,
+			// interpolate the nearest two frames
+			int reusedFrame;
+			RenderStats stats;
+			if (j == 0) {
+				reusedFrame = renderIncremental(window, surface, startFrame, animation, config, history, frameNumber, stats);
+			}
+			else if (j == frameCount - 1) {
+				reusedFrame = renderIncremental(window, surface, endFrame, animation, config, history, frameNumber, stats);
+			}
+			else {
+				Frame interpFrame = interpolateFrames(startFrame, endFrame, alpha);
+				reusedFrame = renderIncremental(window, surface, interpFrame, animation, config, history, frameNumber, stats);
+			}
+
+			uint32_t renderEndTime = SDL_GetTicks();
+			double seconds = (double)(renderEndTime - renderStartTime) / 1000.0;
+
+			if (reusedFrame >= 0) {
+				std::cout << "  Same as frame " << reusedFrame << std::endl;
+			}
+			else {
+				std::cout << "  Took " << seconds << "s to render (BVH built in " << std::fixed << std::setprecision(1)
+						  << stats.buildTime * 1000.0 << "ms, traced in " << stats.traceTime * 1000.0 << "ms"
+						  << std::defaultfloat << std::setprecision(6) << ")";
+
+				if (stats.shadowRays > 0 && config.shadowCache)
+					std::cout << ", " << stats.shadowCacheHits * 100 / stats.shadowRays << "% of shadow rays hit the cached occluder";
+
+				std::cout << std::endl;
+			}
+
+			// Output the frame we just rendered. Frames that did not change share the
+			// image of the earlier frame.
+			if (config.outputFormat != OutputFormat::NONE) {
+				if (reusedFrame >= 0)
+					linkFrame(config, reusedFrame, frameNumber);
+				else
+					saveFrame(surface, config, frameNumber);
+
+				if (config.heatmap && reusedFrame < 0)
+					saveCostMap(stats.pixelCost, surface->w, surface->h, config, frameNumber);
+			}
+		}
+	}
+}
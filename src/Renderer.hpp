@@ -1,65 +1,253 @@
-#ifndef RENDERER_HPP
-#define RENDERER_HPP
-
-#include <SDL2/SDL.h>
-#include <string>
-
-#include "Scene.hpp"
-
-/**
- * The output format to use for writing the frames
- */
-enum class OutputFormat
-{
-    /// Do not write any frames to an output folder
-    NONE,
-
-    /// Write the frames as a png
-    PNG,
-    
-    /// Write the frames as a JPEG
-    JPEG,
-};
-
-/**
- * The display mode selection for rendering to a window
- */
-enum class DisplayMode
-{
-    /// Do not display to a window
-    NONE,
-
-    /// Display one frame at a time
-    FRAME,
-
-    /// Display after each pixel update
-    PIXEL
-};
-
-/**
- * Configuration settings for the program
- */
-struct Configuration
-{
-    /// The display mode for rendering to a window
-    DisplayMode     display = DisplayMode::NONE;
-    
-    /// The folder to output rendered frames to
-    std::string     outputName = "output/";
-
-    /// The format to use for outputting
-    OutputFormat    outputFormat = OutputFormat::NONE;
-};
-
-/**
- * Renders all the frames within the passed animation
- *
- * @param window The window to use for display, or NULL if we are not rendering to a window
- * @param surface The surface to render to
- * @param animation The animation to render
- * @param config The configuration settings for the renderer
- */
-void renderFrames(SDL_Window* window, SDL_Surface* surface, Animation animation, Configuration config);
-
-#endif//RENDERER_HPP
-
+#ifndef RENDERER_HPP
+#define RENDERER_HPP
+
+#include <SDL2/SDL.h>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "Bvh.hpp"
+#include "CpuFeatures.hpp"
+#include "Scene.hpp"
+
+/**
+ * The output format to use for writing the frames
+ */
+enum class OutputFormat
+{
+    /// Do not write any frames to an output folder
+    NONE,
+
+    /// Write the frames as a png
+    PNG,
+    
+    /// Write the frames as a JPEG
+    JPEG,
+};
+
+/**
+ * The display mode selection for rendering to a window
+ */
+enum class DisplayMode
+{
+    /// Do not display to a window
+    NONE,
+
+    /// Display one frame at a time
+    FRAME,
+
+    /// Display after each pixel update
+    PIXEL
+};
+
+/**
+ * A selection of frame numbers to render, in the form start:end:step
+ */
+struct FrameRange
+{
+    /// The first frame to render
+    int     start = 0;
+
+    /// One past the last frame to render, or -1 to render until the end of the animation
+    int     end = -1;
+
+    /// The number of frames to advance between rendered frames
+    int     step = 1;
+
+    /**
+     * Checks whether a frame is part of this selection
+     *
+     * @param frame The frame number to check
+     * @return True if the frame should be rendered
+     */
+    bool contains(int frame) const
+    {
+        return frame >= start && (end < 0 || frame < end) && (frame - start) % step == 0;
+    }
+};
+
+/**
+ * Configuration settings for the program
+ */
+struct Configuration
+{
+    /// The display mode for rendering to a window
+    DisplayMode     display = DisplayMode::NONE;
+    
+    /// The folder to output rendered frames to
+    std::string     outputName = "output/";
+
+    /// The format to use for outputting
+    OutputFormat    outputFormat = OutputFormat::NONE;
+
+    /// The frames of the animation to render
+    FrameRange      frames;
+
+    /// Skip frames that a previous run already wrote to the output folder
+    bool            resume = false;
+
+    /// Only trace the pixels that could have changed since the previous frame
+    bool            incremental = true;
+
+    /// The seed for the random numbers used while rendering. Renders with the same
+    /// seed are identical, no matter how many threads are used
+    uint32_t        seed = 0;
+
+    /// The number of threads to render with, or 0 to use one per core
+    int             threads = 0;
+
+    /// The number of lights to pick at each intersection when shading, or 0 to shade
+    /// with every light. Frames with no more lights than this are shaded with every light
+    int             lightSamples = 0;
+
+    /// Test the object that blocked the last shadow ray to a light before any other
+    bool            shadowCache = true;
+
+    /// Trace the image tile by tile, one bounce at a time over sorted queues of rays,
+    /// instead of following each ray through all its reflections
+    bool            wavefront = false;
+
+    /// Intersect triangles with the watertight test, which never misses a ray
+    /// that passes exactly through a shared edge
+    bool            watertight = false;
+
+    /// How the bounding volume hierarchy over the objects is built for every frame.
+    /// When not set, the scene's RenderSettings decide.
+    std::optional<BvhBuilder> bvhBuilder;
+
+    /// For SBVH, the most references to objects spatial splits may add, as a fraction
+    /// of the number of objects. Taken from the scene.
+    double          bvhSplitBudget = BVH_DEFAULT_SPLIT_BUDGET;
+
+    /// Print how much the nodes of the hierarchy overlap and how many of them primary
+    /// rays visit, compared to an SAH hierarchy, for every frame
+    bool            bvhReport = false;
+
+    /// Collapse the bounding volume hierarchy into one with eight children per node,
+    /// whose children are tested against each ray together
+    bool            wideBvh = false;
+
+    /// Put the spheres of every frame in a uniform grid instead of the bounding
+    /// volume hierarchy, which is much faster to build for many moving particles
+    bool            sphereGrid = false;
+
+    /// Hash of the scene file's contents, used to check that resumed frames are still valid
+    uint64_t        sceneHash = 0;
+
+    /// The file to write a Chrome trace of the render to, or empty to not record one
+    std::string     timelinePath;
+
+    /// Write a map of how expensive each pixel was to trace next to every frame
+    bool            heatmap = false;
+
+    /// Trace the pixels with a loop compiled for the frame's number of samples,
+    /// rather than one that reads it from the sampler
+    bool            specialize = true;
+
+    /// The instruction set to run the vectorized kernels with, or std::nullopt for
+    /// the newest one the CPU supports
+    std::optional<IsaLevel> isa;
+};
+
+/**
+ * Statistics gathered while rendering a single frame
+ */
+struct RenderStats
+{
+    /// The number of rays traced, counting primary, reflection and shadow rays
+    uint64_t        rays = 0;
+
+    /// The number of shadow rays traced
+    uint64_t        shadowRays = 0;
+
+    /// The number of shadow rays that were blocked by the object cached for their light
+    uint64_t        shadowCacheHits = 0;
+
+    /// Seconds spent building the bounding volume hierarchy
+    double          buildTime = 0.0;
+
+    /// Seconds spent tracing the pixels
+    double          traceTime = 0.0;
+
+    /// The number of nodes in the bounding volume hierarchy, and the bytes it takes
+    size_t          bvhNodes = 0;
+    size_t          bvhMemory = 0;
+
+    /// If the heatmap is enabled, the cycles spent, rays traced and intersection tests
+    /// done for each pixel, as three floats per pixel starting with the top row.
+    /// Pixels that were not traced are zero.
+    std::vector<float> pixelCost;
+};
+
+// Forward declaration for the state kept between frames of an incremental render
+struct FrameHistory;
+
+/**
+ * Renders a single frame into the surface
+ *
+ * @param window The window to use for display, or NULL if we are not rendering to a window
+ * @param surface The surface to render to
+ * @param frame The frame to render
+ * @param frameNumber The number of the frame, used to key the random numbers
+ * @param maxDepth The maximum number of reflections
+ * @param samples The number of samples per pixel
+ * @param pattern The pattern to place the samples of each pixel in
+ * @param config The configuration settings for the renderer
+ * @param history If not NULL, only the dirty pixels are traced and the bounds of the rays
+ *                traced for each pixel are recorded for the next frame
+ * @return Statistics about the rays that were traced
+ */
+RenderStats renderFrame(SDL_Window* window, SDL_Surface* surface, Frame& frame, int frameNumber, int maxDepth, int samples, SamplePattern pattern, Configuration config, FrameHistory* history = nullptr);
+
+/// The alignment of the start and of every row of a framebuffer, in bytes
+const int FRAMEBUFFER_ALIGNMENT = 64;
+
+/**
+ * Creates a 32 bit RGBA surface to render into without a window. Unlike a window
+ * surface, this does not need the SDL video subsystem. The pixels and every row
+ * start on a cache line boundary.
+ *
+ * @param width The width of the surface
+ * @param height The height of the surface
+ * @return The surface, or NULL if it could not be created. Free it with freeFramebuffer
+ */
+SDL_Surface* createFramebuffer(int width, int height);
+
+/**
+ * Frees a surface created by createFramebuffer, along with its pixels
+ *
+ * @param surface The surface to free
+ */
+void freeFramebuffer(SDL_Surface* surface);
+
+/**
+ * Takes the settings a scene decides for itself into the configuration, except
+ * for those that were already given on the command line
+ *
+ * @param config The configuration to update
+ * @param animation The scene
+ */
+void applySceneSettings(Configuration& config, const Animation& animation);
+
+/**
+ * Interpolates between two keyframes
+ *
+ * @param f1 The start frame
+ * @param f2 The end frame
+ * @param alpha The time value, between 0 and 1
+ * @return The interpolated frame
+ */
+Frame interpolateFrames(Frame& f1, Frame& f2, double alpha);
+
+/**
+ * Renders all the frames within the passed animation
+ *
+ * @param window The window to use for display, or NULL if we are not rendering to a window
+ * @param surface The surface to render to
+ * @param animation The animation to render
+ * @param config The configuration settings for the renderer
+ */
+void renderFrames(SDL_Window* window, SDL_Surface* surface, Animation animation, Configuration config);
+
+#endif//RENDERER_HPP
+
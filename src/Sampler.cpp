@@ -0,0 +1,429 @@
+#include "Sampler.hpp"
+
+#include <cmath>
+#include <algorithm>
+
+#include "Random.hpp"
+
+/// The size of each side of the blue noise tiles
+const int TILE_SIZE = 64;
+
+/// The sample index used for the random stream that scrambles a pixel's pattern.
+/// Samples use the indices starting at 0, so this never collides with them.
+const uint32_t PATTERN_STREAM = 0xFFFFFFFFu;
+
+/**
+ * Hashes a 32 bit integer
+ *
+ * @param x	The integer to hash
+ * @return	The hashed integer
+ */
+static uint32_t hashUint(uint32_t x)
+{
+	x ^= x >> 16;
+	x *= 0x7feb352du;
+	x ^= x >> 15;
+	x *= 0x846ca68bu;
+	x ^= x >> 16;
+	return x;
+}
+
+/**
+ * Reverses the order of the bits in an integer
+ *
+ * @param x	The integer to reverse
+ * @return	The integer with its bits reversed
+ */
+static uint32_t reverseBits(uint32_t x)
+{
+	x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+	x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+	x = ((x >> 4) & 0x0F0F0F0Fu) | ((x & 0x0F0F0F0Fu) << 4);
+	x = ((x >> 8) & 0x00FF00FFu) | ((x & 0x00FF00FFu) << 8);
+	return (x >> 16) | (x << 16);
+}
+
+/**
+ * Computes the second dimension of the Sobol sequence. The first dimension is
+ * simply reverseBits(index).
+ *
+ * @param index	The index of the point in the sequence
+ * @return		The coordinate as a 32 bit fixed point fraction
+ */
+static uint32_t sobolSecond(uint32_t index)
+{
+	uint32_t result = 0;
+
+	for (uint32_t v = 1u << 31; index != 0; index >>= 1, v ^= v >> 1) {
+		if (index & 1)
+			result ^= v;
+	}
+
+	return result;
+}
+
+/**
+ * Applies Owen scrambling to a 32 bit fixed point fraction, using the hash based
+ * approach described by Burley in "Practical Hash-based Owen Scrambling"
+ *
+ * @param x		The value to scramble
+ * @param seed	The seed for the scramble
+ * @return		The scrambled value
+ */
+static uint32_t owenScramble(uint32_t x, uint32_t seed)
+{
+	x = reverseBits(x);
+
+	x += seed;
+	x ^= x * 0x6c50b47cu;
+	x ^= x * 0xb82f1e52u;
+	x ^= x * 0xc7afe638u;
+	x ^= x * 0x8d22f6e6u;
+
+	return reverseBits(x);
+}
+
+/**
+ * Computes the radical inverse of an index with Owen scrambling. Every digit is
+ * permuted based on the digits before it, so the sequence keeps its
+ * stratification while being randomized.
+ *
+ * @param index	The index of the point in the sequence
+ * @param base	The base of the radical inverse
+ * @param seed	The seed for the scramble
+ * @return		The scrambled radical inverse, in [0, 1)
+ */
+static double scrambledRadicalInverse(uint32_t index, uint32_t base, uint32_t seed)
+{
+	double invBase = 1.0 / base;
+	double factor = invBase;
+	double result = 0.0;
+
+	// The hash of the digits seen so far selects the permutation for the next digit
+	uint32_t prefix = hashUint(seed);
+
+	// Keep going after the index runs out of digits, since scrambled zeros are not zero
+	while (factor > 1e-10) {
+		uint32_t digit = index % base;
+		index /= base;
+
+		// Shuffle the digits of the base with the hash of the prefix
+		uint32_t permutation[8];
+		uint32_t hash = prefix;
+		for (uint32_t i = 0; i < base; i++)
+			permutation[i] = i;
+		for (uint32_t i = base - 1; i > 0; i--) {
+			hash = hashUint(hash);
+			std::swap(permutation[i], permutation[hash % (i + 1)]);
+		}
+
+		result += permutation[digit] * factor;
+		factor *= invBase;
+
+		prefix = hashUint(prefix ^ (digit + 1) * 0x9E3779B9u);
+	}
+
+	return glm::min(result, 1.0 - 1e-16);
+}
+
+/**
+ * Permutes an index with a hash, from Kensler's "Correlated Multi-Jittered Sampling"
+ *
+ * @param i	The index to permute
+ * @param l	The number of indices in the permutation
+ * @param p	The seed of the permutation
+ * @return	The permuted index
+ */
+static uint32_t permute(uint32_t i, uint32_t l, uint32_t p)
+{
+	uint32_t w = l - 1;
+	w |= w >> 1;
+	w |= w >> 2;
+	w |= w >> 4;
+	w |= w >> 8;
+	w |= w >> 16;
+
+	do {
+		i ^= p;				i *= 0xe170893du;
+		i ^= p >> 16;
+		i ^= (i & w) >> 4;
+		i ^= p >> 8;		i *= 0x0929eb3fu;
+		i ^= p >> 23;
+		i ^= (i & w) >> 1;	i *= 1 | p >> 27;
+							i *= 0x6935fa69u;
+		i ^= (i & w) >> 11; i *= 0x74dcb303u;
+		i ^= (i & w) >> 2;	i *= 0x9e501cc3u;
+		i ^= (i & w) >> 2;	i *= 0xc860a3dfu;
+		i &= w;
+		i ^= i >> 5;
+	} while (i >= l);
+
+	return (i + p) % l;
+}
+
+/**
+ * Hashes an index to a random number in [0, 1), from Kensler's "Correlated
+ * Multi-Jittered Sampling"
+ *
+ * @param i	The index to hash
+ * @param p	The seed of the hash
+ * @return	The random number
+ */
+static double randomFraction(uint32_t i, uint32_t p)
+{
+	i ^= p;
+	i ^= i >> 17;
+	i ^= i >> 10;	i *= 0xb36534e5u;
+	i ^= i >> 12;
+	i ^= i >> 21;	i *= 0x93fc4795u;
+	i ^= 0xdf6e307fu;
+	i ^= i >> 17;	i *= 1 | p >> 18;
+
+	return i * (1.0 / 4294967808.0);
+}
+
+/**
+ * Generates a tile of blue noise using Ulichney's void and cluster method. Each
+ * entry of the tile gets a unique rank, and neighbouring entries have ranks that
+ * are as far apart as possible.
+ *
+ * @param seed	The seed for the initial random pattern
+ * @return		The rank of each entry, scaled into [0, 1)
+ */
+static std::vector<double> generateBlueNoise(uint32_t seed)
+{
+	const int count = TILE_SIZE * TILE_SIZE;
+	const double sigma = 1.5;
+
+	// The gaussian energy of a point, indexed by the wrapped offset from it
+	std::vector<double> kernel(count);
+	for (int y = 0; y < TILE_SIZE; y++) {
+		for (int x = 0; x < TILE_SIZE; x++) {
+			int dx = glm::min(x, TILE_SIZE - x);
+			int dy = glm::min(y, TILE_SIZE - y);
+			kernel[y * TILE_SIZE + x] = std::exp(-(dx * dx + dy * dy) / (2.0 * sigma * sigma));
+		}
+	}
+
+	std::vector<uint8_t> pattern(count, 0);
+	std::vector<double> energy(count, 0.0);
+
+	// Adds or removes the energy of a point
+	auto update = [&](int point, double sign) {
+		int px = point % TILE_SIZE;
+		int py = point / TILE_SIZE;
+
+		for (int y = 0; y < TILE_SIZE; y++) {
+			int ky = (y - py + TILE_SIZE) % TILE_SIZE;
+			for (int x = 0; x < TILE_SIZE; x++) {
+				int kx = (x - px + TILE_SIZE) % TILE_SIZE;
+				energy[y * TILE_SIZE + x] += sign * kernel[ky * TILE_SIZE + kx];
+			}
+		}
+	};
+
+	// The point in the densest part of the pattern
+	auto tightestCluster = [&]() {
+		int best = -1;
+		for (int i = 0; i < count; i++) {
+			if (pattern[i] && (best < 0 || energy[i] > energy[best]))
+				best = i;
+		}
+		return best;
+	};
+
+	// The empty spot furthest from any point of the pattern
+	auto largestVoid = [&]() {
+		int best = -1;
+		for (int i = 0; i < count; i++) {
+			if (!pattern[i] && (best < 0 || energy[i] < energy[best]))
+				best = i;
+		}
+		return best;
+	};
+
+	// Start with a tenth of the points placed at random
+	SampleRandom random(seed, 0, 0, 0);
+	int initialCount = 0;
+	while (initialCount < count / 10) {
+		int point = random.nextUint() % count;
+		if (!pattern[point]) {
+			pattern[point] = 1;
+			update(point, 1.0);
+			initialCount++;
+		}
+	}
+
+	// Spread the initial points out by moving the tightest cluster into the largest
+	// void until that no longer changes anything
+	for (int iteration = 0; iteration < count; iteration++) {
+		int cluster = tightestCluster();
+		pattern[cluster] = 0;
+		update(cluster, -1.0);
+
+		int largest = largestVoid();
+		pattern[largest] = 1;
+		update(largest, 1.0);
+
+		if (largest == cluster)
+			break;
+	}
+
+	std::vector<int> rank(count);
+	std::vector<uint8_t> initialPattern = pattern;
+	std::vector<double> initialEnergy = energy;
+
+	// Rank the initial points by removing the tightest cluster one at a time
+	for (int r = initialCount - 1; r >= 0; r--) {
+		int cluster = tightestCluster();
+		pattern[cluster] = 0;
+		update(cluster, -1.0);
+		rank[cluster] = r;
+	}
+
+	// Rank the remaining points by filling the largest void one at a time. Past half
+	// full, the tightest cluster of empty spots is also the spot with the lowest energy,
+	// so the same selection works for both halves.
+	pattern = initialPattern;
+	energy = initialEnergy;
+	for (int r = initialCount; r < count; r++) {
+		int largest = largestVoid();
+		pattern[largest] = 1;
+		update(largest, 1.0);
+		rank[largest] = r;
+	}
+
+	std::vector<double> tile(count);
+	for (int i = 0; i < count; i++)
+		tile[i] = (rank[i] + 0.5) / count;
+
+	return tile;
+}
+
+/**
+ * Gets the blue noise tiles used to offset the samples in the x and y directions.
+ * The tiles are generated the first time they are needed.
+ *
+ * @param dimension	0 for the x offsets, 1 for the y offsets
+ * @return			The tile
+ */
+static const std::vector<double>& blueNoiseTile(int dimension)
+{
+	static const std::vector<double> tiles[2] = {
+		generateBlueNoise(0x2545F491u),
+		generateBlueNoise(0x9E3779B9u),
+	};
+
+	return tiles[dimension];
+}
+
+Sampler::Sampler(SamplePattern _pattern, int samples, uint32_t _seed, uint32_t _frame) :
+	pattern(_pattern),
+	sampleCount(glm::max(samples, 1)),
+	gridSize(1),
+	seed(_seed),
+	frame(_frame),
+	tileOffsetX(0),
+	tileOffsetY(0)
+{
+	if (pattern == SamplePattern::GRID) {
+		gridSize = glm::max((int)glm::floor(glm::sqrt((double)samples)), 1);
+		sampleCount = gridSize * gridSize;
+	}
+	else if (pattern == SamplePattern::BLUE_NOISE) {
+		// Move the tile around between frames so the noise is not fixed to the screen
+		SampleRandom random(seed, frame, PATTERN_STREAM, PATTERN_STREAM);
+		tileOffsetX = random.nextUint() % TILE_SIZE;
+		tileOffsetY = random.nextUint() % TILE_SIZE;
+
+		blueNoiseTile(0);
+	}
+}
+
+uint32_t Sampler::pixelSeed(uint32_t pixel) const
+{
+	return SampleRandom(seed, frame, pixel, PATTERN_STREAM).nextUint();
+}
+
+glm::dvec2 Sampler::sample(int index, int px, int py, uint32_t pixelSeed) const
+{
+	switch (pattern) {
+	case SamplePattern::JITTERED: {
+		// Correlated multi-jittered sampling handles any number of samples by
+		// using a grid of m x n cells, with m * n >= count
+		int m = (int)glm::sqrt((double)sampleCount);
+		int n = (sampleCount + m - 1) / m;
+
+		uint32_t s = permute(index, sampleCount, pixelSeed * 0x51633e2du);
+		uint32_t sx = permute(s % m, m, pixelSeed * 0x68bc21ebu);
+		uint32_t sy = permute(s / m, n, pixelSeed * 0x02e5be93u);
+		double jx = randomFraction(s, pixelSeed * 0x967a889bu);
+		double jy = randomFraction(s, pixelSeed * 0x368cc8b7u);
+
+		return {
+			(sx + (sy + jx) / n) / m,
+			(s / m + (sx + jy) / m) / n
+		};
+	}
+
+	case SamplePattern::SOBOL: {
+		// Shuffle the order of the points, then scramble each dimension
+		uint32_t i = owenScramble(index, hashUint(pixelSeed));
+		uint32_t x = owenScramble(reverseBits(i), hashUint(pixelSeed ^ 0x68bc21ebu));
+		uint32_t y = owenScramble(sobolSecond(i), hashUint(pixelSeed ^ 0x02e5be93u));
+
+		return { x * (1.0 / 4294967296.0), y * (1.0 / 4294967296.0) };
+	}
+
+	case SamplePattern::HALTON:
+		return {
+			scrambledRadicalInverse(index, 2, pixelSeed),
+			scrambledRadicalInverse(index, 3, hashUint(pixelSeed))
+		};
+
+	case SamplePattern::BLUE_NOISE: {
+		// Offset an unscrambled Sobol pattern by the blue noise value of the pixel.
+		// Neighbouring pixels get very different offsets, so their errors do not
+		// line up into visible structure.
+		int tx = (px + tileOffsetX) % TILE_SIZE;
+		int ty = (py + tileOffsetY) % TILE_SIZE;
+		int tileIndex = ty * TILE_SIZE + tx;
+
+		double x = reverseBits(index) * (1.0 / 4294967296.0) + blueNoiseTile(0)[tileIndex];
+		double y = sobolSecond(index) * (1.0 / 4294967296.0) + blueNoiseTile(1)[tileIndex];
+
+		return { x >= 1.0 ? x - 1.0 : x, y >= 1.0 ? y - 1.0 : y };
+	}
+
+	case SamplePattern::GRID:
+	default:
+		// A regular grid, in the same order the samples have always been taken
+		return {
+			(double)(index % gridSize) / (double)gridSize,
+			(double)(index / gridSize) / (double)gridSize
+		};
+	}
+}
+
+std::optional<SamplePattern> parseSamplePattern(const std::string& name)
+{
+	if (name == "grid")			return SamplePattern::GRID;
+	if (name == "jittered")		return SamplePattern::JITTERED;
+	if (name == "sobol")		return SamplePattern::SOBOL;
+	if (name == "halton")		return SamplePattern::HALTON;
+	if (name == "bluenoise")	return SamplePattern::BLUE_NOISE;
+
+	return std::nullopt;
+}
+
+const char* samplePatternName(SamplePattern pattern)
+{
+	switch (pattern) {
+	case SamplePattern::JITTERED:	return "jittered";
+	case SamplePattern::SOBOL:		return "sobol";
+	case SamplePattern::HALTON:		return "halton";
+	case SamplePattern::BLUE_NOISE:	return "bluenoise";
+	case SamplePattern::GRID:
+	default:						return "grid";
+	}
+}
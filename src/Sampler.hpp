@@ -0,0 +1,97 @@
+#ifndef SAMPLER_HPP
+#define SAMPLER_HPP
+
+#include <string>
+#include <optional>
+#include <vector>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+#include "Scene.hpp"
+
+/**
+ * Generates the positions of the samples within each pixel.
+ *
+ * All of the patterns except the grid work with any number of samples. The
+ * randomized patterns are scrambled differently for every pixel using a seed
+ * that is derived from the pixel's random number stream, so they stay
+ * deterministic no matter how the pixels are split between threads.
+ */
+class Sampler
+{
+public:
+	/**
+	 * Creates a sampler for a frame
+	 *
+	 * @param pattern	The pattern to place samples in
+	 * @param samples	The number of samples requested for each pixel
+	 * @param seed		The seed for the render
+	 * @param frame		The number of the frame being rendered
+	 */
+	Sampler(SamplePattern pattern, int samples, uint32_t seed, uint32_t frame);
+
+	/**
+	 * Returns the number of samples actually taken for each pixel. This is the
+	 * requested count, except for the grid which rounds down to a square.
+	 *
+	 * @return The number of samples per pixel
+	 */
+	int count() const { return sampleCount; }
+
+	/**
+	 * Computes the seed used to scramble the pattern of a pixel
+	 *
+	 * @param pixel	The index of the pixel within the frame
+	 * @return		The scrambling seed of the pixel
+	 */
+	uint32_t pixelSeed(uint32_t pixel) const;
+
+	/**
+	 * Computes the position of a sample within its pixel
+	 *
+	 * @param index		The index of the sample within the pixel
+	 * @param px		The x coordinate of the pixel
+	 * @param py		The y coordinate of the pixel
+	 * @param pixelSeed	The scrambling seed of the pixel, from pixelSeed()
+	 * @return			The offset of the sample from the pixel's corner, in [0, 1)
+	 */
+	glm::dvec2 sample(int index, int px, int py, uint32_t pixelSeed) const;
+
+protected:
+	/// The pattern samples are placed in
+	SamplePattern	pattern;
+
+	/// The number of samples per pixel
+	int				sampleCount;
+
+	/// The number of samples along each side of the grid pattern
+	int				gridSize;
+
+	/// The seed for the render
+	uint32_t		seed;
+
+	/// The frame being rendered
+	uint32_t		frame;
+
+	/// Offset into the blue noise tile for this frame, so the noise changes between frames
+	int				tileOffsetX, tileOffsetY;
+};
+
+/**
+ * Converts the name of a sample pattern from a scene file
+ *
+ * @param name	The lowercase name of the pattern
+ * @return		The pattern, or std::nullopt if the name is unknown
+ */
+std::optional<SamplePattern> parseSamplePattern(const std::string& name);
+
+/**
+ * Gets the name of a sample pattern as it is written in a scene file
+ *
+ * @param pattern	The pattern
+ * @return			The pattern's name
+ */
+const char* samplePatternName(SamplePattern pattern);
+
+#endif//SAMPLER_HPP
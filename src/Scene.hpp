@@ -1,70 +1,106 @@
-#ifndef FRAME_HPP
-#define FRAME_HPP
-
-#include <vector>
-#include <memory>
-#include <string> 
-
-#include "Objects.hpp"
-#include "Structures.hpp"
-
-/**  
- * Stores the information for a single frame, such as the objects, lights, camera
- * and the offset from the previous frame
- */
-struct Frame
-{
-	/// List of objects in the frame
-	std::vector<std::shared_ptr<Object>>	objects;
-
-	/// List of lights in the frame
-	std::vector<std::shared_ptr<Light>>		lights;
-	
-	/// List of names given to objects in the frame
-	std::vector<std::string>				objectNames;
-	
-	/// List of names given to the lights in the frame
-	std::vector<std::string>				lightNames;
-
-	/// The background color for this frame 
-	glm::dvec3								background;
-
-	/// The camera for this frame
-	Camera									camera;
-
-	/// The name of the camera in this frame 
-	std::string								cameraName;
-
-	/// Time offset in seconds that this frame occurs, after the first frame
-	double									timeOffset;
-};
-
-/** 
- * Stores the information needed to render an animation, including the
- * quality settings and a list of keyframes.
- */
-struct Animation
-{
-	/// A list of keyframes to render for the animation
-	std::vector<Frame>	keyFrames;
-
-	/// Animation framerate
-	int					fps			= 24;
-	
-	/// Width of the render
-	int					width		= 720;
-
-	/// Height of the render
-	int					height		= 480;
-
-	/// Max number of reflections to calculate
-	int					maxDepth	= 4;
-
-	/// The square root of the number of samples to render.
-	int					samples		= 3;
-
-	/// Loop the animation back to the beginning after the last frame?
-	bool				loop		= false;
-};
-
+#ifndef FRAME_HPP
+#define FRAME_HPP
+
+#include <vector>
+#include <memory>
+#include <string> 
+
+#include "Bvh.hpp"
+#include "Objects.hpp"
+#include "Structures.hpp"
+
+/**  
+ * Stores the information for a single frame, such as the objects, lights, camera
+ * and the offset from the previous frame
+ */
+struct Frame
+{
+	/// List of objects in the frame
+	std::vector<std::shared_ptr<Object>>	objects;
+
+	/// List of lights in the frame
+	std::vector<std::shared_ptr<Light>>		lights;
+	
+	/// List of names given to objects in the frame
+	std::vector<std::string>				objectNames;
+	
+	/// List of names given to the lights in the frame
+	std::vector<std::string>				lightNames;
+
+	/// The materials of the objects in the frame, which refer to them by index
+	MaterialTable							materials;
+
+	/// The background color for this frame 
+	glm::dvec3								background;
+
+	/// The camera for this frame
+	Camera									camera;
+
+	/// The name of the camera in this frame 
+	std::string								cameraName;
+
+	/// Time offset in seconds that this frame occurs, after the first frame
+	double									timeOffset;
+};
+
+/**
+ * The pattern used to place the samples within each pixel
+ */
+enum class SamplePattern
+{
+	/// A regular grid of floor(sqrt(samples)) x floor(sqrt(samples)) samples
+	GRID,
+
+	/// Correlated multi-jittered samples, stratified in both dimensions
+	JITTERED,
+
+	/// The Sobol sequence with Owen scrambling
+	SOBOL,
+
+	/// The Halton sequence with Owen scrambling
+	HALTON,
+
+	/// A Sobol pattern offset for each pixel by a blue noise tile, which spreads
+	/// the remaining error as high frequency noise across the image
+	BLUE_NOISE,
+};
+
+/** 
+ * Stores the information needed to render an animation, including the
+ * quality settings and a list of keyframes.
+ */
+struct Animation
+{
+	/// A list of keyframes to render for the animation
+	std::vector<Frame>	keyFrames;
+
+	/// Animation framerate
+	int					fps			= 24;
+	
+	/// Width of the render
+	int					width		= 720;
+
+	/// Height of the render
+	int					height		= 480;
+
+	/// Max number of reflections to calculate
+	int					maxDepth	= 4;
+
+	/// The number of samples to render for each pixel
+	int					samples		= 9;
+
+	/// How the samples are placed within each pixel
+	SamplePattern		pattern		= SamplePattern::GRID;
+
+	/// Loop the animation back to the beginning after the last frame?
+	bool				loop		= false;
+
+	/// How the bounding volume hierarchy is built for every frame
+	BvhBuilder			bvhBuilder	= BvhBuilder::SAH;
+
+	/// For SBVH, the most references to objects spatial splits may add, as a
+	/// fraction of the number of objects
+	double				bvhSplitBudget = BVH_DEFAULT_SPLIT_BUDGET;
+};
+
 #endif//FRAME_HPP
\ No newline at end of file
@@ -0,0 +1,235 @@
+#include "SceneGeometry.hpp"
+
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define PLANESET_SSE2
+#endif
+
+/// The number of planes a ray is tested against at once
+#ifdef PLANESET_SSE2
+const size_t PLANE_LANES = 2;
+#else
+const size_t PLANE_LANES = 1;
+#endif
+
+/// Rays closer than this to parallel with a plane, or hitting it closer than this
+/// to their origin, miss it. This has to match Plane::intersect().
+const double PLANE_EPSILON = 1e-8;
+
+void PlaneSet::add(Plane* plane)
+{
+	// Drop the padding, which is added back after the new plane
+	px.resize(planes.size());
+	py.resize(planes.size());
+	pz.resize(planes.size());
+	nx.resize(planes.size());
+	ny.resize(planes.size());
+	nz.resize(planes.size());
+
+	planes.push_back(plane);
+
+	px.push_back(plane->point.x);
+	py.push_back(plane->point.y);
+	pz.push_back(plane->point.z);
+	nx.push_back(plane->norm.x);
+	ny.push_back(plane->norm.y);
+	nz.push_back(plane->norm.z);
+
+	// The padding has a zero normal, which every ray is parallel to
+	size_t padded = (planes.size() + PLANE_LANES - 1) / PLANE_LANES * PLANE_LANES;
+	px.resize(padded, 0.0);
+	py.resize(padded, 0.0);
+	pz.resize(padded, 0.0);
+	nx.resize(padded, 0.0);
+	ny.resize(padded, 0.0);
+	nz.resize(padded, 0.0);
+}
+
+inline void PlaneSet::distances(size_t first, glm::dvec3 origin, glm::dvec3 dir, double* t) const
+{
+	// Both versions do the same operations in the same order as Plane::intersect(),
+	// so that they find exactly the same distances
+#ifdef PLANESET_SSE2
+	__m128d nxs = _mm_loadu_pd(&nx[first]);
+	__m128d nys = _mm_loadu_pd(&ny[first]);
+	__m128d nzs = _mm_loadu_pd(&nz[first]);
+
+	__m128d ddn = _mm_add_pd(_mm_add_pd(
+		_mm_mul_pd(_mm_set1_pd(dir.x), nxs),
+		_mm_mul_pd(_mm_set1_pd(dir.y), nys)),
+		_mm_mul_pd(_mm_set1_pd(dir.z), nzs));
+
+	__m128d num = _mm_add_pd(_mm_add_pd(
+		_mm_mul_pd(_mm_sub_pd(_mm_loadu_pd(&px[first]), _mm_set1_pd(origin.x)), nxs),
+		_mm_mul_pd(_mm_sub_pd(_mm_loadu_pd(&py[first]), _mm_set1_pd(origin.y)), nys)),
+		_mm_mul_pd(_mm_sub_pd(_mm_loadu_pd(&pz[first]), _mm_set1_pd(origin.z)), nzs));
+
+	__m128d dist = _mm_div_pd(num, ddn);
+
+	__m128d epsilon = _mm_set1_pd(PLANE_EPSILON);
+	__m128d hit = _mm_and_pd(
+		_mm_or_pd(_mm_cmple_pd(ddn, _mm_set1_pd(-PLANE_EPSILON)), _mm_cmpge_pd(ddn, epsilon)),
+		_mm_cmpge_pd(dist, epsilon));
+
+	dist = _mm_or_pd(_mm_and_pd(hit, dist), _mm_andnot_pd(hit, _mm_set1_pd(std::numeric_limits<double>::infinity())));
+	_mm_storeu_pd(t, dist);
+#else
+	double ddn = dir.x * nx[first] + dir.y * ny[first] + dir.z * nz[first];
+	double dist = ((px[first] - origin.x) * nx[first] + (py[first] - origin.y) * ny[first]) + (pz[first] - origin.z) * nz[first];
+	dist /= ddn;
+
+	bool hit = (ddn <= -PLANE_EPSILON || ddn >= PLANE_EPSILON) && dist >= PLANE_EPSILON;
+	t[0] = hit ? dist : std::numeric_limits<double>::infinity();
+#endif
+}
+
+Plane* PlaneSet::closest(glm::dvec3 origin, glm::dvec3 dir, double& t) const
+{
+	Plane* closest = nullptr;
+	t = std::numeric_limits<double>::infinity();
+
+	for (size_t first = 0; first < planes.size(); first += PLANE_LANES) {
+		double dist[PLANE_LANES];
+		distances(first, origin, dir, dist);
+
+		for (size_t i = 0; i < PLANE_LANES; i++) {
+			if (dist[i] < t) {
+				t = dist[i];
+				closest = planes[first + i];
+			}
+		}
+	}
+
+	return closest;
+}
+
+Plane* PlaneSet::occluded(glm::dvec3 origin, glm::dvec3 dir, double maxT) const
+{
+	for (size_t first = 0; first < planes.size(); first += PLANE_LANES) {
+		double dist[PLANE_LANES];
+		distances(first, origin, dir, dist);
+
+		for (size_t i = 0; i < PLANE_LANES; i++) {
+			if (dist[i] < maxT)
+				return planes[first + i];
+		}
+	}
+
+	return nullptr;
+}
+
+SceneGeometry::SceneGeometry(Frame& frame, BvhBuilder builder, bool wide, double splitBudget, bool sphereGrid)
+{
+	std::vector<Object*> bounded;
+	std::vector<Sphere*> spheres;
+
+	for (std::shared_ptr<Object>& object : frame.objects) {
+		if (object->type == ObjectType::PLANE)
+			planes.add(static_cast<Plane*>(object.get()));
+		else if (sphereGrid && object->type == ObjectType::SPHERE)
+			spheres.push_back(static_cast<Sphere*>(object.get()));
+		else if (object->bounds().isFinite())
+			bounded.push_back(object.get());
+		else
+			unbounded.push_back(object.get());
+	}
+
+	// Spheres too large for the cells of the grid go in the hierarchy instead
+	if (!spheres.empty()) {
+		std::vector<glm::dvec4> centers(spheres.size());
+		for (size_t i = 0; i < spheres.size(); i++)
+			centers[i] = glm::dvec4(spheres[i]->position, spheres[i]->radius);
+
+		std::vector<int> large;
+		grid = SphereGrid(std::move(centers), large);
+		gridSpheres = std::move(spheres);
+
+		for (int index : large)
+			bounded.push_back(gridSpheres[index]);
+	}
+
+	bvh = Bvh(bounded, builder, splitBudget);
+
+	if (wide) {
+		wideBvh = WideBvh(bvh);
+		bvh = Bvh();
+	}
+}
+
+std::optional<Intersection> SceneGeometry::intersect(glm::dvec3 origin, glm::dvec3 dir, uint64_t& tests) const
+{
+	std::optional<Hit> closest;
+	double tMax = std::numeric_limits<double>::infinity();
+
+	// Nothing behind the closest plane can be seen, so it limits the search through
+	// the rest of the objects
+	tests += planes.size();
+	double planeT;
+	Plane* plane = planes.closest(origin, dir, planeT);
+
+	if (plane != nullptr) {
+		closest = plane->hit(origin, dir);
+		if (closest.has_value())
+			tMax = closest->t;
+	}
+
+	for (Object* object : unbounded) {
+		tests++;
+		auto opt = hitObject(*object, origin, dir);
+
+		if (opt.has_value() && opt->t < tMax) {
+			tMax = opt->t;
+			closest = opt;
+		}
+	}
+
+	double gridT;
+	int sphere = grid.closest(origin, dir, tMax, gridT, tests);
+	if (sphere >= 0) {
+		closest = Hit{ gridSpheres[sphere], gridT, 0, 0.0, 0.0 };
+		tMax = gridT;
+	}
+
+	auto opt = wideBvh.empty() ? bvh.intersect(origin, dir, tMax, tests) : wideBvh.intersect(origin, dir, tMax, tests);
+	if (opt.has_value())
+		closest = opt;
+
+	// Only the closest hit needs its point, normal and material
+	if (!closest.has_value())
+		return std::optional<Intersection>();
+
+	return closest->object->attributes(origin, dir, closest.value());
+}
+
+Object* SceneGeometry::occluded(glm::dvec3 origin, glm::dvec3 dir, double maxT, const Object* skip, uint64_t& tests) const
+{
+	tests += planes.size();
+	Plane* plane = planes.occluded(origin, dir, maxT);
+
+	if (plane != nullptr)
+		return plane;
+
+	for (Object* object : unbounded) {
+		if (object == skip)
+			continue;
+
+		tests++;
+		auto opt = hitObject(*object, origin, dir);
+
+		if (opt.has_value() && opt->t < maxT)
+			return object;
+	}
+
+	// Spheres are not skipped, since one that was already tested cannot block the
+	// ray anyway
+	int sphere = grid.occluded(origin, dir, maxT, tests);
+	if (sphere >= 0)
+		return gridSpheres[sphere];
+
+	if (!wideBvh.empty())
+		return wideBvh.occluded(origin, dir, maxT, skip, tests);
+
+	return bvh.occluded(origin, dir, maxT, skip, tests);
+}
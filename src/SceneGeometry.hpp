@@ -0,0 +1,160 @@
+#ifndef SCENEGEOMETRY_HPP
+#define SCENEGEOMETRY_HPP
+
+#include <vector>
+#include <optional>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+#include "Bvh.hpp"
+#include "Objects.hpp"
+#include "Scene.hpp"
+#include "SphereGrid.hpp"
+#include "Structures.hpp"
+#include "WideBvh.hpp"
+
+/**
+ * The infinite planes of a frame, stored so that a ray can be tested against
+ * several of them at once.
+ *
+ * The points and normals of the planes are kept in separate arrays for each
+ * component, padded with planes that no ray can hit to a multiple of the
+ * number of planes tested at once.
+ */
+class PlaneSet
+{
+public:
+	/**
+	 * Adds a plane to the set
+	 *
+	 * @param plane		The plane. It must outlive the set
+	 */
+	void add(Plane* plane);
+
+	/**
+	 * Finds the closest plane hit by a ray
+	 *
+	 * @param origin	The origin of the ray
+	 * @param dir		The direction of the ray
+	 * @param t			Set to the distance to the closest plane, if one is hit
+	 * @return			The closest plane, or NULL if the ray hits none
+	 */
+	Plane* closest(glm::dvec3 origin, glm::dvec3 dir, double& t) const;
+
+	/**
+	 * Finds any plane that blocks a ray
+	 *
+	 * @param origin	The origin of the ray
+	 * @param dir		The direction of the ray
+	 * @param maxT		Planes at or beyond this distance along the ray do not block it
+	 * @return			The plane blocking the ray, or NULL if there is none
+	 */
+	Plane* occluded(glm::dvec3 origin, glm::dvec3 dir, double maxT) const;
+
+	/**
+	 * Gets the number of planes in the set
+	 */
+	size_t size() const { return planes.size(); }
+
+protected:
+	/**
+	 * Computes the distance along a ray to a group of planes
+	 *
+	 * @param first		The index of the first plane of the group
+	 * @param origin	The origin of the ray
+	 * @param dir		The direction of the ray
+	 * @param t			Set to the distance to each plane of the group, or infinity
+	 *					for the planes the ray does not hit
+	 */
+	void distances(size_t first, glm::dvec3 origin, glm::dvec3 dir, double* t) const;
+
+	/// A point on each plane
+	std::vector<double>	px, py, pz;
+
+	/// The normal of each plane
+	std::vector<double>	nx, ny, nz;
+
+	/// The planes, without the padding
+	std::vector<Plane*>	planes;
+};
+
+/**
+ * Everything rays are traced against in a frame.
+ *
+ * Rays are tested against the planes first, since they cannot go in the bounding
+ * volume hierarchy. The closest plane hit then limits how far into the hierarchy
+ * the ray is followed, so floors and walls cut off most of it for rays that hit them.
+ * Spheres can instead be put in a grid, which is much faster to build for every
+ * frame of an animation with many moving particles.
+ */
+class SceneGeometry
+{
+public:
+	/**
+	 * Sorts the objects of a frame into planes, other unbounded objects, and a
+	 * hierarchy over the bounded objects
+	 *
+	 * @param frame		The frame. It must outlive the geometry
+	 * @param builder	How to build the hierarchy
+	 * @param wide		Whether to collapse the hierarchy into one with eight children per node
+	 * @param splitBudget	For SBVH, the most references to objects spatial splits may
+	 *						add, as a fraction of the number of objects
+	 * @param sphereGrid	Whether to put the spheres in a grid instead of the hierarchy
+	 */
+	SceneGeometry(Frame& frame, BvhBuilder builder, bool wide = false, double splitBudget = BVH_DEFAULT_SPLIT_BUDGET, bool sphereGrid = false);
+
+	/**
+	 * Finds the closest intersection of a ray with the objects of the frame
+	 *
+	 * @param origin	The origin of the ray
+	 * @param dir		The direction of the ray
+	 * @param tests		Incremented for every object the ray is tested against
+	 * @return			The closest intersection, or std::nullopt if there is none
+	 */
+	std::optional<Intersection> intersect(glm::dvec3 origin, glm::dvec3 dir, uint64_t& tests) const;
+
+	/**
+	 * Finds any object that blocks a ray
+	 *
+	 * @param origin	The origin of the ray
+	 * @param dir		The direction of the ray
+	 * @param maxT		Objects at or beyond this distance along the ray do not block it
+	 * @param skip		An object that has already been tested, or NULL. Planes are
+	 *					always tested, since they are tested together
+	 * @param tests		Incremented for every object the ray is tested against
+	 * @return			The object blocking the ray, or NULL if there is none
+	 */
+	Object* occluded(glm::dvec3 origin, glm::dvec3 dir, double maxT, const Object* skip, uint64_t& tests) const;
+
+	/**
+	 * Gets the number of nodes in the hierarchy that rays are traced through
+	 */
+	size_t nodeCount() const { return wideBvh.empty() ? bvh.nodeCount() : wideBvh.nodeCount(); }
+
+	/**
+	 * Gets the number of bytes taken by the hierarchy that rays are traced through
+	 */
+	size_t memoryUsage() const { return (wideBvh.empty() ? bvh.memoryUsage() : wideBvh.memoryUsage()) + grid.memoryUsage(); }
+
+protected:
+	/// The planes of the frame
+	PlaneSet				planes;
+
+	/// Objects other than planes that have no bounds
+	std::vector<Object*>	unbounded;
+
+	/// The hierarchy over the bounded objects, unless it was collapsed
+	Bvh						bvh;
+
+	/// The collapsed hierarchy over the bounded objects, if one was asked for
+	WideBvh					wideBvh;
+
+	/// The grid over the spheres, if one was asked for
+	SphereGrid				grid;
+
+	/// The spheres in the grid, by their index in it
+	std::vector<Sphere*>	gridSpheres;
+};
+
+#endif//SCENEGEOMETRY_HPP
@@ -0,0 +1,363 @@
+#include "SphereGrid.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+
+#include "Objects.hpp"
+#include "RadixSort.hpp"
+
+/// Grids over fewer spheres than this are built on a single thread
+const int GRID_MIN_PARALLEL = 1024;
+
+/// The most cells along any axis, so that the keys of the cells fit in 63 bits
+const int GRID_MAX_RESOLUTION = (1 << 21) - 1;
+
+/// The number of cells for each sphere a grid is aimed at, where the spheres are
+/// so spread out that their size does not decide the size of the cells
+const double GRID_CELLS_PER_SPHERE = 4.0;
+
+/// Spheres with a radius of more than this many cells are left out of the grid
+const double GRID_MAX_RADIUS_CELLS = 2.0;
+
+/// Spheres are put in the cells their bounds reach, widened by this fraction of a
+/// cell, so that rounding where a ray crosses between cells cannot miss one
+const double GRID_PADDING = 1e-9;
+
+/// The number of spheres a ray remembers having been tested against, so that it
+/// does not test them again in the next cells they overlap. Must be a power of two.
+const int GRID_MAILBOX = 8;
+
+/**
+ * Finds the cell a coordinate is in along an axis, clamped to the grid
+ *
+ * @param x				The coordinate
+ * @param origin		The coordinate of the grid's lowest corner
+ * @param cellSize		The length of the cells
+ * @param resolution	The number of cells along the axis
+ * @return				The index of the cell
+ */
+static inline int cellOf(double x, double origin, double cellSize, int resolution)
+{
+	return (int)std::clamp(std::floor((x - origin) / cellSize), 0.0, (double)(resolution - 1));
+}
+
+/**
+ * Finds the number of bits needed to store the index of any cell along an axis
+ *
+ * @param resolution	The number of cells along the axis
+ * @return				The number of bits
+ */
+static inline int bitsFor(int resolution)
+{
+	int bits = 0;
+	while ((1 << bits) < resolution)
+		bits++;
+	return bits;
+}
+
+double SphereGrid::pickCellSize(double meanRadius, double radiusSpread, const BoundingBox& bounds, size_t count)
+{
+	glm::dvec3 extent = glm::max(bounds.max - bounds.min, glm::dvec3(0.0));
+	double volume = extent.x * extent.y * extent.z;
+
+	double size = 2.0 * (meanRadius + radiusSpread);
+	size = std::max(size, std::cbrt(volume / (count * GRID_CELLS_PER_SPHERE)));
+
+	// The grid must fit in the keys
+	double longest = std::max(extent.x, std::max(extent.y, extent.z));
+	size = std::max(size, longest / GRID_MAX_RESOLUTION);
+
+	return size > 0.0 ? size : 1.0;
+}
+
+SphereGrid::SphereGrid(std::vector<glm::dvec4> input, std::vector<int>& large) :
+	spheres(std::move(input))
+{
+	int count = (int)spheres.size();
+	if (count == 0)
+		return;
+
+	// The statistics of the radii decide the size of the cells
+	double radiusSum = 0.0, radiusSquares = 0.0;
+	BoundingBox bounds;
+
+	#pragma omp parallel if(count >= GRID_MIN_PARALLEL)
+	{
+		double localSum = 0.0, localSquares = 0.0;
+		BoundingBox local;
+
+		#pragma omp for
+		for (int i = 0; i < count; i++) {
+			glm::dvec3 center(spheres[i]);
+			double radius = spheres[i].w;
+			localSum += radius;
+			localSquares += radius * radius;
+			local.extend(center - radius);
+			local.extend(center + radius);
+		}
+
+		#pragma omp critical
+		{
+			radiusSum += localSum;
+			radiusSquares += localSquares;
+			bounds.extend(local);
+		}
+	}
+
+	double meanRadius = radiusSum / count;
+	double radiusSpread = std::sqrt(std::max(radiusSquares / count - meanRadius * meanRadius, 0.0));
+	cellSize = pickCellSize(meanRadius, radiusSpread, bounds, spheres.size());
+
+	origin = bounds.min;
+	for (int axis = 0; axis < 3; axis++) {
+		double cells = std::ceil((bounds.max[axis] - bounds.min[axis]) / cellSize);
+		resolution[axis] = (int)std::clamp(cells, 1.0, (double)GRID_MAX_RESOLUTION);
+	}
+
+	shiftY = bitsFor(resolution.x);
+	shiftZ = shiftY + bitsFor(resolution.y);
+	int keyBits = shiftZ + bitsFor(resolution.z);
+
+	// Count the cells each sphere overlaps, so every thread knows where to write
+	// the keys of its spheres
+	std::vector<int64_t> offsets(count + 1, 0);
+
+	#pragma omp parallel for if(count >= GRID_MIN_PARALLEL)
+	for (int i = 0; i < count; i++) {
+		const glm::dvec4& sphere = spheres[i];
+		if (sphere.w > GRID_MAX_RADIUS_CELLS * cellSize)
+			continue;
+
+		double reach = sphere.w + GRID_PADDING * cellSize;
+		int64_t cells = 1;
+		for (int axis = 0; axis < 3; axis++) {
+			int lo = cellOf(sphere[axis] - reach, origin[axis], cellSize, resolution[axis]);
+			int hi = cellOf(sphere[axis] + reach, origin[axis], cellSize, resolution[axis]);
+			cells *= hi - lo + 1;
+		}
+
+		offsets[i + 1] = cells;
+	}
+
+	for (int i = 0; i < count; i++) {
+		if (offsets[i + 1] == 0)
+			large.push_back(i);
+		offsets[i + 1] += offsets[i];
+	}
+
+	std::vector<SortKey> keys((size_t)offsets[count]);
+
+	#pragma omp parallel for if(count >= GRID_MIN_PARALLEL)
+	for (int i = 0; i < count; i++) {
+		if (offsets[i + 1] == offsets[i])
+			continue;
+
+		const glm::dvec4& sphere = spheres[i];
+		double reach = sphere.w + GRID_PADDING * cellSize;
+		glm::ivec3 lo, hi;
+		for (int axis = 0; axis < 3; axis++) {
+			lo[axis] = cellOf(sphere[axis] - reach, origin[axis], cellSize, resolution[axis]);
+			hi[axis] = cellOf(sphere[axis] + reach, origin[axis], cellSize, resolution[axis]);
+		}
+
+		int64_t next = offsets[i];
+		for (int z = lo.z; z <= hi.z; z++) {
+			for (int y = lo.y; y <= hi.y; y++) {
+				for (int x = lo.x; x <= hi.x; x++)
+					keys[(size_t)next++] = { cellKey(x, y, z), i };
+			}
+		}
+	}
+
+	// Sorting by cell puts the spheres of each cell next to each other
+	radixSort(keys, keyBits);
+
+	items.resize(keys.size());
+
+	#pragma omp parallel for if(count >= GRID_MIN_PARALLEL)
+	for (int64_t i = 0; i < (int64_t)keys.size(); i++)
+		items[(size_t)i] = keys[(size_t)i].index;
+
+	if (keys.empty())
+		return;
+
+	// Every run of equal keys becomes a cell of the hash table, which is kept at
+	// most half full
+	cellKeys = 1;
+	for (size_t i = 1; i < keys.size(); i++) {
+		if (keys[i].code != keys[i - 1].code)
+			cellKeys++;
+	}
+
+	size_t capacity = 2;
+	hashShift = 63;
+	while (capacity < cellKeys * 2) {
+		capacity *= 2;
+		hashShift--;
+	}
+
+	cells.assign(capacity, { EMPTY_CELL, 0, 0 });
+
+	size_t first = 0;
+	for (size_t i = 1; i <= keys.size(); i++) {
+		if (i < keys.size() && keys[i].code == keys[first].code)
+			continue;
+
+		size_t slot = slotOf(keys[first].code);
+		while (cells[slot].key != EMPTY_CELL)
+			slot = (slot + 1) & (capacity - 1);
+
+		cells[slot] = { keys[first].code, (int)first, (int)(i - first) };
+		first = i;
+	}
+}
+
+const SphereGrid::Cell* SphereGrid::find(uint64_t key) const
+{
+	size_t mask = cells.size() - 1;
+
+	for (size_t slot = slotOf(key); ; slot = (slot + 1) & mask) {
+		if (cells[slot].key == key)
+			return &cells[slot];
+		if (cells[slot].key == EMPTY_CELL)
+			return nullptr;
+	}
+}
+
+template <typename Visit>
+void SphereGrid::walk(const glm::dvec3& rayOrigin, const glm::dvec3& dir, double tMax, Visit visit) const
+{
+	// Clip the ray to the grid. A ray in the plane of a side gives NaN, which
+	// std::min and std::max drop when it is passed second.
+	glm::dvec3 invDir = 1.0 / dir;
+	glm::dvec3 t0 = (origin - rayOrigin) * invDir;
+	glm::dvec3 t1 = (origin + glm::dvec3(resolution) * cellSize - rayOrigin) * invDir;
+
+	double tEnter = 0.0;
+	double tExit = tMax;
+	for (int axis = 0; axis < 3; axis++) {
+		tEnter = std::max(tEnter, std::min(t0[axis], t1[axis]));
+		tExit = std::min(tExit, std::max(t0[axis], t1[axis]));
+	}
+
+	if (tEnter > tExit)
+		return;
+
+	// The cell the ray enters the grid in, and the distances at which it crosses
+	// into the next cell along each axis
+	glm::dvec3 start = rayOrigin + dir * tEnter;
+	glm::ivec3 cell, step;
+	glm::dvec3 tNext, tDelta;
+
+	for (int axis = 0; axis < 3; axis++) {
+		cell[axis] = cellOf(start[axis], origin[axis], cellSize, resolution[axis]);
+
+		if (dir[axis] > 0.0) {
+			step[axis] = 1;
+			tNext[axis] = (origin[axis] + (cell[axis] + 1) * cellSize - rayOrigin[axis]) * invDir[axis];
+			tDelta[axis] = cellSize * invDir[axis];
+		}
+		else if (dir[axis] < 0.0) {
+			step[axis] = -1;
+			tNext[axis] = (origin[axis] + cell[axis] * cellSize - rayOrigin[axis]) * invDir[axis];
+			tDelta[axis] = -cellSize * invDir[axis];
+		}
+		else {
+			step[axis] = 0;
+			tNext[axis] = std::numeric_limits<double>::infinity();
+			tDelta[axis] = 0.0;
+		}
+	}
+
+	while (true) {
+		int axis = tNext.x < tNext.y ? (tNext.x < tNext.z ? 0 : 2) : (tNext.y < tNext.z ? 1 : 2);
+
+		const Cell* found = find(cellKey(cell.x, cell.y, cell.z));
+		if (found != nullptr)
+			tExit = std::min(tExit, visit(*found));
+
+		// Anything found so far is closer than every cell after this one
+		if (tNext[axis] >= tExit)
+			break;
+
+		cell[axis] += step[axis];
+		if (cell[axis] < 0 || cell[axis] >= resolution[axis])
+			break;
+
+		tNext[axis] += tDelta[axis];
+	}
+}
+
+int SphereGrid::closest(glm::dvec3 origin, glm::dvec3 dir, double tMax, double& t, uint64_t& tests) const
+{
+	int closest = -1;
+
+	if (cells.empty())
+		return closest;
+
+	int mailbox[GRID_MAILBOX];
+	std::fill(mailbox, mailbox + GRID_MAILBOX, -1);
+
+	walk(origin, dir, tMax, [&](const Cell& cell) {
+		for (int i = cell.first; i < cell.first + cell.count; i++) {
+			int index = items[i];
+
+			int& box = mailbox[index & (GRID_MAILBOX - 1)];
+			if (box == index)
+				continue;
+			box = index;
+
+			tests++;
+			const glm::dvec4& sphere = spheres[index];
+			double distance = Sphere::distance(origin, dir, glm::dvec3(sphere), sphere.w);
+
+			if (distance < tMax) {
+				tMax = distance;
+				closest = index;
+			}
+		}
+
+		return tMax;
+	});
+
+	if (closest >= 0)
+		t = tMax;
+
+	return closest;
+}
+
+int SphereGrid::occluded(glm::dvec3 origin, glm::dvec3 dir, double maxT, uint64_t& tests) const
+{
+	int blocker = -1;
+
+	if (cells.empty())
+		return blocker;
+
+	int mailbox[GRID_MAILBOX];
+	std::fill(mailbox, mailbox + GRID_MAILBOX, -1);
+
+	walk(origin, dir, maxT, [&](const Cell& cell) {
+		for (int i = cell.first; i < cell.first + cell.count; i++) {
+			int index = items[i];
+
+			int& box = mailbox[index & (GRID_MAILBOX - 1)];
+			if (box == index)
+				continue;
+			box = index;
+
+			tests++;
+			const glm::dvec4& sphere = spheres[index];
+
+			if (Sphere::distance(origin, dir, glm::dvec3(sphere), sphere.w) < maxT) {
+				blocker = index;
+				return -std::numeric_limits<double>::infinity();
+			}
+		}
+
+		return maxT;
+	});
+
+	return blocker;
+}
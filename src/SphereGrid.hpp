@@ -0,0 +1,180 @@
+#ifndef SPHEREGRID_HPP
+#define SPHEREGRID_HPP
+
+#include <vector>
+#include <optional>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+#include "Structures.hpp"
+
+/**
+ * A grid of equal cells over many spheres of similar size, such as particles.
+ *
+ * Only the cells that spheres overlap are stored, in a hash table keyed by the
+ * cell's coordinates, so clustered spheres do not need a cell for all the empty
+ * space around them. Rays step through the cells they pass in order, so the first
+ * hit found in a cell ends the search. Building the grid is a parallel sort of the
+ * cells every sphere overlaps, which is much faster than building a hierarchy, so
+ * it can be rebuilt for every frame as the spheres move.
+ */
+class SphereGrid
+{
+public:
+	/**
+	 * Creates an empty grid that no ray intersects
+	 */
+	SphereGrid() = default;
+
+	/**
+	 * Builds the grid over the passed spheres. The size of the cells is picked from
+	 * the radii of the spheres and how densely they fill their bounds. Spheres much
+	 * larger than the cells would fill too many of them, so they are left out.
+	 *
+	 * @param spheres	The center of each sphere, with its radius as the fourth component
+	 * @param large		Set to the indices of the spheres that were left out of the grid
+	 */
+	SphereGrid(std::vector<glm::dvec4> spheres, std::vector<int>& large);
+
+	/**
+	 * Finds the closest sphere hit by a ray. Only the distance is computed, so the
+	 * caller finds the point and normal of the one hit it keeps.
+	 *
+	 * @param origin	The origin of the ray
+	 * @param dir		The direction of the ray
+	 * @param tMax		Hits at or beyond this distance along the ray are ignored
+	 * @param t			Set to the distance to the closest sphere, if one is hit
+	 * @param tests		Incremented for every sphere the ray is tested against
+	 * @return			The index of the closest sphere, or -1 if there is none before tMax
+	 */
+	int closest(glm::dvec3 origin, glm::dvec3 dir, double tMax, double& t, uint64_t& tests) const;
+
+	/**
+	 * Finds any sphere that blocks a ray
+	 *
+	 * @param origin	The origin of the ray
+	 * @param dir		The direction of the ray
+	 * @param maxT		Spheres at or beyond this distance along the ray do not block it
+	 * @param tests		Incremented for every sphere the ray is tested against
+	 * @return			The index of the sphere blocking the ray, or -1 if there is none
+	 */
+	int occluded(glm::dvec3 origin, glm::dvec3 dir, double maxT, uint64_t& tests) const;
+
+	/**
+	 * Checks whether the grid has no spheres
+	 */
+	bool empty() const { return cells.empty(); }
+
+	/**
+	 * Gets the number of cells that hold at least one sphere
+	 */
+	size_t cellCount() const { return cellKeys; }
+
+	/**
+	 * Gets the number of bytes taken by the cells and the lists of spheres
+	 */
+	size_t memoryUsage() const { return cells.size() * sizeof(Cell) + items.size() * sizeof(int) + spheres.size() * sizeof(glm::dvec4); }
+
+	/**
+	 * Picks the size of the cells for a grid over some spheres: at least the diameter
+	 * of most spheres, so that each sphere is in few cells, and at least large enough
+	 * that there are not many more cells than spheres in the bounds.
+	 *
+	 * @param meanRadius	The mean radius of the spheres
+	 * @param radiusSpread	The standard deviation of the radii
+	 * @param bounds		The bounds of the spheres
+	 * @param count			The number of spheres
+	 * @return				The length of the sides of the cells
+	 */
+	static double pickCellSize(double meanRadius, double radiusSpread, const BoundingBox& bounds, size_t count);
+
+protected:
+	/**
+	 * A slot of the hash table of cells
+	 */
+	struct Cell
+	{
+		/// The coordinates of the cell packed by cellKey, or EMPTY_CELL if the slot
+		/// is free
+		uint64_t	key;
+
+		/// The first sphere of the cell in the list of items
+		int			first;
+
+		/// The number of spheres in the cell
+		int			count;
+	};
+
+	/// The key of an unused slot of the hash table
+	static const uint64_t EMPTY_CELL = ~(uint64_t)0;
+
+	/**
+	 * Packs the coordinates of a cell into a key, with just enough bits for each
+	 * axis that sorting the keys takes as few passes as possible
+	 */
+	uint64_t cellKey(int x, int y, int z) const
+	{
+		return (uint64_t)x | (uint64_t)y << shiftY | (uint64_t)z << shiftZ;
+	}
+
+	/**
+	 * Finds the slot of the hash table a key goes in first
+	 */
+	size_t slotOf(uint64_t key) const
+	{
+		// Multiplying by a large odd constant mixes the coordinates into the high bits
+		return (size_t)((key * 0x9e3779b97f4a7c15ull) >> hashShift);
+	}
+
+	/**
+	 * Finds a cell in the hash table
+	 *
+	 * @param key	The key of the cell
+	 * @return		The cell, or NULL if no sphere overlaps it
+	 */
+	const Cell* find(uint64_t key) const;
+
+	/**
+	 * Steps a ray through the cells it passes, calling a function for the spheres of
+	 * each cell in order along the ray until the function asks to stop
+	 *
+	 * @param rayOrigin	The origin of the ray
+	 * @param dir		The direction of the ray
+	 * @param tMax		The distance along the ray at which to stop
+	 * @param visit		Called with each cell that holds spheres. Returns the distance to
+	 *					stop at, which can be lowered as hits are found
+	 */
+	template <typename Visit>
+	void walk(const glm::dvec3& rayOrigin, const glm::dvec3& dir, double tMax, Visit visit) const;
+
+	/// The corner of the grid with the smallest coordinates
+	glm::dvec3				origin{ 0.0 };
+
+	/// The length of the sides of the cells
+	double					cellSize = 1.0;
+
+	/// The number of cells along each axis
+	glm::ivec3				resolution{ 0 };
+
+	/// Where the y and z coordinates of a cell start in its key
+	int						shiftY = 0, shiftZ = 0;
+
+	/// The hash table of cells, whose size is a power of two
+	std::vector<Cell>		cells;
+
+	/// The number of cells in the hash table
+	size_t					cellKeys = 0;
+
+	/// The amount to shift the hash of a key right by to get a slot
+	int						hashShift = 64;
+
+	/// The spheres, as their center and radius
+	std::vector<glm::dvec4>	spheres;
+
+	/// The indices of the spheres of every cell, with those of each cell next to
+	/// each other
+	std::vector<int>		items;
+};
+
+#endif//SPHEREGRID_HPP
@@ -1,42 +1,224 @@
-#ifndef STRUCTURES_HPP
-#define STRUCTURES_HPP
-
-#include <glm/glm.hpp>
-
-/**
- * Material for an object the scene
- */
-struct Material
-{
-public:
-	/// The diffuse color for this material
-	glm::dvec3	diffuse{0.0, 0.0, 0.0};
-
-	/// The specular color for this material
-	glm::dvec3	specular{0.0, 0.0, 0.0};
-
-	/// The shininess for this material
-	double		shininess{0.0};
-};
-
-/**
- * Represents an intersection with an object.
- * 
- * This is all of the information needed from a specific intersection
- */
-struct Intersection
-{
-	/// The material found at the intersection point
-	Material*	material;
-
-	/// The point that the intersection occured.
-	glm::dvec3	pos;
-
-	/// The normal to the surface at the point of intersection 
-	glm::dvec3	norm;
-
-	/// The T parameter along the ray that the intersection occured
-	double		t;	
-};
-
+#ifndef STRUCTURES_HPP
+#define STRUCTURES_HPP
+
+#include <limits>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#include <cstdint>
+#include <glm/glm.hpp>
+
+// Asks the compiler to inline a small function into the loops that call it, even
+// where its own heuristics would not
+#if defined(_MSC_VER)
+#define FORCE_INLINE __forceinline
+#elif defined(__GNUC__) || defined(__clang__)
+#define FORCE_INLINE inline __attribute__((always_inline))
+#else
+#define FORCE_INLINE inline
+#endif
+
+// Forward declaration for the object of a hit
+class Object;
+
+/**
+ * Material for an object the scene
+ */
+struct Material
+{
+public:
+	/// The diffuse color for this material
+	glm::dvec3	diffuse{0.0, 0.0, 0.0};
+
+	/// The specular color for this material
+	glm::dvec3	specular{0.0, 0.0, 0.0};
+
+	/// The shininess for this material
+	double		shininess{0.0};
+
+	/**
+	 * Checks if two materials are exactly the same
+	 */
+	bool operator==(const Material& other) const
+	{
+		return diffuse == other.diffuse && specular == other.specular && shininess == other.shininess;
+	}
+};
+
+/**
+ * The materials of a frame, each stored once. Objects refer to their material by
+ * its index in the table, so many objects sharing a few materials do not each
+ * carry a copy, and shading reads from a table small enough to stay in the cache.
+ */
+class MaterialTable
+{
+public:
+	/**
+	 * Creates a table holding only the default material, at index 0
+	 */
+	MaterialTable()
+	{
+		add(Material());
+	}
+
+	/**
+	 * Adds a material to the table, unless an equal one is already in it
+	 *
+	 * @param material	The material
+	 * @return			The index of the material in the table
+	 */
+	uint32_t add(const Material& material)
+	{
+		auto found = indices.find(material);
+		if (found != indices.end())
+			return found->second;
+
+		uint32_t index = (uint32_t)materials.size();
+		materials.push_back(material);
+		indices.emplace(material, index);
+		return index;
+	}
+
+	/**
+	 * Gets the material at an index
+	 */
+	const Material& operator[](uint32_t index) const { return materials[index]; }
+
+	/**
+	 * Gets the number of materials in the table
+	 */
+	size_t size() const { return materials.size(); }
+
+	/**
+	 * Checks if two tables hold the same materials at the same indices
+	 */
+	bool operator==(const MaterialTable& other) const { return materials == other.materials; }
+	bool operator!=(const MaterialTable& other) const { return materials != other.materials; }
+
+protected:
+	/**
+	 * Hashes the colors and shininess of a material
+	 */
+	struct MaterialHash
+	{
+		size_t operator()(const Material& material) const
+		{
+			std::hash<double> hash;
+			size_t value = 0;
+			for (int i = 0; i < 3; i++) {
+				value = value * 31 + hash(material.diffuse[i]);
+				value = value * 31 + hash(material.specular[i]);
+			}
+			return value * 31 + hash(material.shininess);
+		}
+	};
+
+	/// The materials, by index
+	std::vector<Material>							materials;
+
+	/// The index of every material in the table
+	std::unordered_map<Material, uint32_t, MaterialHash>	indices;
+};
+
+/**
+ * An axis aligned bounding box. A default constructed box is empty.
+ */
+struct BoundingBox
+{
+	/// The corner of the box with the smallest coordinates
+	glm::dvec3	min{ std::numeric_limits<double>::infinity() };
+
+	/// The corner of the box with the largest coordinates
+	glm::dvec3	max{ -std::numeric_limits<double>::infinity() };
+
+	/**
+	 * Returns a box that contains all of space
+	 */
+	static BoundingBox infinite()
+	{
+		return { 
+			glm::dvec3(-std::numeric_limits<double>::infinity()), 
+			glm::dvec3(std::numeric_limits<double>::infinity()) 
+		};
+	}
+
+	/**
+	 * Grows the box to contain the passed point
+	 */
+	void extend(const glm::dvec3& point)
+	{
+		min = glm::min(min, point);
+		max = glm::max(max, point);
+	}
+
+	/**
+	 * Grows the box to contain the passed box
+	 */
+	void extend(const BoundingBox& box)
+	{
+		min = glm::min(min, box.min);
+		max = glm::max(max, box.max);
+	}
+
+	/**
+	 * Checks if this box and the passed box share any points
+	 */
+	bool overlaps(const BoundingBox& box) const
+	{
+		return glm::all(glm::lessThanEqual(min, box.max)) && glm::all(glm::lessThanEqual(box.min, max));
+	}
+
+	/**
+	 * Checks that none of the sides of the box are at infinity
+	 */
+	bool isFinite() const
+	{
+		return glm::all(glm::lessThan(max, glm::dvec3(std::numeric_limits<double>::infinity()))) &&
+			   glm::all(glm::greaterThan(min, glm::dvec3(-std::numeric_limits<double>::infinity())));
+	}
+};
+
+/**
+ * A hit of a ray on an object, found while searching for the closest one.
+ *
+ * This is only what is needed to compare hits and to compute the rest of the
+ * intersection later, with Object::attributes().
+ */
+struct Hit
+{
+	/// The object that was hit
+	Object*		object;
+
+	/// The T parameter along the ray that the hit occured
+	double		t;
+
+	/// The part of the object that was hit, for objects made of many, such as particles
+	int			primitive;
+
+	/// The barycentric coordinates of the hit on a triangle, weighting its second
+	/// and third vertices
+	double		u, v;
+};
+
+/**
+ * Represents an intersection with an object.
+ * 
+ * This is all of the information needed from a specific intersection
+ */
+struct Intersection
+{
+	/// The index of the material found at the intersection point, in the frame's
+	/// table of materials
+	uint32_t	material;
+
+	/// The point that the intersection occured.
+	glm::dvec3	pos;
+
+	/// The normal to the surface at the point of intersection 
+	glm::dvec3	norm;
+
+	/// The T parameter along the ray that the intersection occured
+	double		t;	
+};
+
 #endif//STRUCTURES_HPP
\ No newline at end of file
@@ -0,0 +1,123 @@
+#include "Timeline.hpp"
+
+#include <fstream>
+#include <iomanip>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <chrono>
+
+bool timelineEnabled = false;
+
+/**
+ * A single finished event
+ */
+struct TimelineEvent
+{
+	/// The name of the event
+	const char*	name;
+
+	/// The name of the event's argument, or NULL for none
+	const char*	argName;
+
+	/// The value of the event's argument
+	int64_t		argValue;
+
+	/// When the event started and how long it took, in nanoseconds
+	int64_t		start, duration;
+};
+
+/**
+ * The events recorded by a single thread
+ */
+struct TimelineBuffer
+{
+	/// The id the thread is shown with in the trace
+	int							thread;
+
+	/// The events recorded by the thread, in the order they finished
+	std::vector<TimelineEvent>	events;
+};
+
+/// The time that timestamps are measured from
+static std::chrono::steady_clock::time_point timelineEpoch;
+
+/// Guards the list of buffers. Only taken when a thread records its first event
+/// and when the timeline is written.
+static std::mutex buffersMutex;
+
+/// The buffers of every thread that recorded an event. The buffers outlive their
+/// threads, so events from threads that already exited still get written.
+static std::vector<std::unique_ptr<TimelineBuffer>> buffers;
+
+void enableTimeline()
+{
+	timelineEpoch = std::chrono::steady_clock::now();
+	timelineEnabled = true;
+}
+
+int64_t timelineNow()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - timelineEpoch).count();
+}
+
+/**
+ * Creates the buffer for the calling thread
+ *
+ * @return The new buffer
+ */
+static TimelineBuffer* createBuffer()
+{
+	std::lock_guard<std::mutex> lock(buffersMutex);
+
+	auto buffer = std::make_unique<TimelineBuffer>();
+	buffer->thread = (int)buffers.size();
+	buffer->events.reserve(4096);
+	buffers.push_back(std::move(buffer));
+
+	return buffers.back().get();
+}
+
+void recordTimelineEvent(const char* name, const char* argName, int64_t argValue, int64_t start)
+{
+	thread_local TimelineBuffer* buffer = createBuffer();
+
+	buffer->events.push_back({ name, argName, argValue, start, timelineNow() - start });
+}
+
+bool writeTimeline(const std::string& path)
+{
+	std::lock_guard<std::mutex> lock(buffersMutex);
+
+	std::ofstream out(path);
+	if (!out)
+		return false;
+
+	// Chrome traces use microseconds
+	out << std::fixed << std::setprecision(3);
+	out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+
+	bool first = true;
+	for (auto& buffer : buffers) {
+		std::string threadName = buffer->thread == 0 ? "Main" : "Worker " + std::to_string(buffer->thread);
+
+		out << (first ? "" : ",\n")
+			<< "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->thread
+			<< ",\"args\":{\"name\":\"" << threadName << "\"}}";
+		first = false;
+
+		for (TimelineEvent& event : buffer->events) {
+			out << ",\n{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->thread
+				<< ",\"ts\":" << event.start / 1000.0 << ",\"dur\":" << event.duration / 1000.0;
+
+			if (event.argName != nullptr)
+				out << ",\"args\":{\"" << event.argName << "\":" << event.argValue << "}";
+
+			out << "}";
+		}
+	}
+
+	out << "\n]}\n";
+
+	return (bool)out;
+}
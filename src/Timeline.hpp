@@ -0,0 +1,94 @@
+#ifndef TIMELINE_HPP
+#define TIMELINE_HPP
+
+#include <string>
+#include <cstdint>
+
+/// Whether timeline events are being recorded. This is only changed before
+/// rendering starts, so it is read without synchronization.
+extern bool timelineEnabled;
+
+/**
+ * Starts recording timeline events. Timestamps are measured from this call.
+ */
+void enableTimeline();
+
+/**
+ * Gets the time since the timeline was enabled
+ *
+ * @return The time in nanoseconds
+ */
+int64_t timelineNow();
+
+/**
+ * Adds a finished event to the calling thread's buffer. Every thread records
+ * into its own buffer, so no locking is needed after a thread's first event.
+ *
+ * @param name		The name of the event. Must be a string literal
+ * @param argName	The name of the argument shown with the event, or NULL for none.
+ *					Must be a string literal
+ * @param argValue	The value of the argument
+ * @param start		The time the event started, from timelineNow()
+ */
+void recordTimelineEvent(const char* name, const char* argName, int64_t argValue, int64_t start);
+
+/**
+ * Writes every recorded event as a Chrome trace, which can be opened in
+ * chrome://tracing or ui.perfetto.dev. No events may be recorded while this runs.
+ *
+ * @param path	The file to write
+ * @return		True if the file was written
+ */
+bool writeTimeline(const std::string& path);
+
+/**
+ * Records an event spanning the lifetime of the scope it is declared in. When
+ * the timeline is disabled this only costs a check of a flag.
+ */
+class TimelineScope
+{
+public:
+	/**
+	 * Starts the event
+	 *
+	 * @param name		The name of the event. Must be a string literal
+	 * @param argName	The name of the argument shown with the event, or NULL for none.
+	 *					Must be a string literal
+	 * @param argValue	The value of the argument
+	 */
+	TimelineScope(const char* name, const char* argName = nullptr, int64_t argValue = 0) :
+		name(name),
+		argName(argName),
+		argValue(argValue)
+	{
+		if (timelineEnabled)
+			start = timelineNow();
+	}
+
+	/**
+	 * Ends the event and records it
+	 */
+	~TimelineScope()
+	{
+		if (start >= 0)
+			recordTimelineEvent(name, argName, argValue, start);
+	}
+
+	TimelineScope(const TimelineScope&) = delete;
+	TimelineScope& operator=(const TimelineScope&) = delete;
+
+protected:
+	/// The name of the event
+	const char*	name;
+
+	/// The name of the event's argument, or NULL for none
+	const char*	argName;
+
+	/// The value of the event's argument
+	int64_t		argValue;
+
+	/// The time the event started, or -1 if the timeline is disabled
+	int64_t		start = -1;
+};
+
+#endif//TIMELINE_HPP
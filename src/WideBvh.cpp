@@ -0,0 +1,539 @@
+#include "WideBvh.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <utility>
+
+#include "CpuFeatures.hpp"
+
+#ifdef CPU_X86
+#include <immintrin.h>
+#endif
+
+/// The number of children of a node
+const int WIDE_BVH_WIDTH = 8;
+
+/// The number of children that can wait to be visited while tracing a ray. Each
+/// node visited replaces itself with at most eight children, and the tree is no
+/// deeper than the binary tree it is collapsed from.
+const int WIDE_BVH_STACK_SIZE = 1024;
+
+/// The exponents of the grid cells are kept in this range, so that the scale of a
+/// cell times one over the ray direction cannot overflow a float
+const int WIDE_BVH_MIN_EXPONENT = -100;
+const int WIDE_BVH_MAX_EXPONENT = 60;
+
+/// The distances to the children are computed in floats on the rounded out grid.
+/// Widening them by this fraction covers the rounding, so that a child the ray
+/// passes through is never missed.
+const float WIDE_BVH_PADDING = 1.0f / (1 << 18);
+
+/// The components of ray directions are kept at least this far from zero, so that
+/// one over them stays finite
+const double WIDE_BVH_MIN_DIRECTION = 1e-20;
+
+/**
+ * Computes a power of two as a float
+ *
+ * @param exponent	The exponent, which must give a normal float
+ * @return			2 to the power of exponent
+ */
+static inline float powerOfTwo(int exponent)
+{
+	uint32_t bits = (uint32_t)(exponent + 127) << 23;
+	float value;
+	std::memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+/**
+ * Converts a distance along a ray to a float, keeping distances too large for a
+ * float infinite
+ *
+ * @param t		The distance
+ * @return		The distance as a float
+ */
+static inline float toFloat(double t)
+{
+	return t < std::numeric_limits<float>::max() ? (float)t : std::numeric_limits<float>::infinity();
+}
+
+/**
+ * Computes the surface area of a box
+ *
+ * @param box	The box
+ * @return		The surface area of the box, or 0 if it is empty
+ */
+static double surfaceArea(const BoundingBox& box)
+{
+	glm::dvec3 size = glm::max(box.max - box.min, glm::dvec3(0.0));
+	return 2.0 * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+WideBvh::WideBvh(const Bvh& bvh)
+{
+	switch (activeIsa()) {
+	case IsaLevel::SSE42:
+		intersectChildren = intersectChildrenSse42;
+		break;
+	case IsaLevel::AVX2:
+		intersectChildren = intersectChildrenAvx2;
+		break;
+	case IsaLevel::AVX512:
+		intersectChildren = intersectChildrenAvx512;
+		break;
+	default:
+		intersectChildren = intersectChildrenScalar;
+		break;
+	}
+
+	if (bvh.nodes.empty())
+		return;
+
+	objects.reserve(bvh.objects.size());
+
+	// The binary nodes still to be collapsed, and the wide nodes they become. The
+	// children of each wide node are added to the end of the list together, so
+	// that they are next to each other.
+	std::vector<std::pair<int, int>> queue;
+	queue.push_back({ 0, 0 });
+	nodes.emplace_back();
+
+	for (size_t next = 0; next < queue.size(); next++) {
+		const Bvh::Node& source = bvh.nodes[queue[next].first];
+		int index = queue[next].second;
+
+		// Open up the largest child node until there are eight children, or only
+		// leaves are left. A leaf at the root becomes the only child.
+		int children[WIDE_BVH_WIDTH];
+		int childCount = 0;
+
+		if (source.count > 0) {
+			children[childCount++] = queue[next].first;
+		}
+		else {
+			children[childCount++] = source.left;
+			children[childCount++] = source.right;
+		}
+
+		while (childCount < WIDE_BVH_WIDTH) {
+			int largest = -1;
+			double largestArea = -1.0;
+
+			for (int i = 0; i < childCount; i++) {
+				const Bvh::Node& child = bvh.nodes[children[i]];
+				double area = surfaceArea(child.bounds);
+
+				if (child.count == 0 && area > largestArea) {
+					largest = i;
+					largestArea = area;
+				}
+			}
+
+			if (largest < 0)
+				break;
+
+			const Bvh::Node& opened = bvh.nodes[children[largest]];
+			children[largest] = opened.left;
+			children[childCount++] = opened.right;
+		}
+
+		// Slot s is visited first by rays going towards the negative side of the axes
+		// whose bit is set in s, so it should hold the child furthest along the
+		// opposite direction. The best matches are taken first.
+		glm::dvec3 center = (source.bounds.min + source.bounds.max) * 0.5;
+		double score[WIDE_BVH_WIDTH][WIDE_BVH_WIDTH];
+
+		for (int i = 0; i < childCount; i++) {
+			const BoundingBox& bounds = bvh.nodes[children[i]].bounds;
+			glm::dvec3 offset = (bounds.min + bounds.max) * 0.5 - center;
+
+			for (int slot = 0; slot < WIDE_BVH_WIDTH; slot++) {
+				score[i][slot] = (slot & 1 ? offset.x : -offset.x)
+					+ (slot & 2 ? offset.y : -offset.y)
+					+ (slot & 4 ? offset.z : -offset.z);
+			}
+		}
+
+		int slots[WIDE_BVH_WIDTH];
+		std::fill(slots, slots + WIDE_BVH_WIDTH, -1);
+		bool placed[WIDE_BVH_WIDTH] = {};
+
+		for (int n = 0; n < childCount; n++) {
+			int bestChild = -1, bestSlot = -1;
+			double best = -std::numeric_limits<double>::infinity();
+
+			for (int i = 0; i < childCount; i++) {
+				if (placed[i])
+					continue;
+
+				for (int slot = 0; slot < WIDE_BVH_WIDTH; slot++) {
+					if (slots[slot] < 0 && (bestChild < 0 || score[i][slot] > best)) {
+						bestChild = i;
+						bestSlot = slot;
+						best = score[i][slot];
+					}
+				}
+			}
+
+			placed[bestChild] = true;
+			slots[bestSlot] = bestChild;
+		}
+
+		// The grid starts at the low corner of the node, rounded down to a float, and
+		// its cells are the smallest power of two that covers the node in 255 of them
+		Node node = {};
+		double scale[3];
+
+		for (int axis = 0; axis < 3; axis++) {
+			float origin = (float)source.bounds.min[axis];
+			if ((double)origin > source.bounds.min[axis])
+				origin = std::nextafter(origin, -std::numeric_limits<float>::infinity());
+
+			double extent = source.bounds.max[axis] - origin;
+			int exponent = WIDE_BVH_MIN_EXPONENT;
+			if (extent > 0.0)
+				exponent = std::max(exponent, (int)std::ceil(std::log2(extent / 255.0)));
+			while (exponent < WIDE_BVH_MAX_EXPONENT && std::ldexp(255.0, exponent) < extent)
+				exponent++;
+			exponent = std::min(exponent, WIDE_BVH_MAX_EXPONENT);
+
+			node.origin[axis] = origin;
+			node.exponent[axis] = (int8_t)exponent;
+			scale[axis] = std::ldexp(1.0, -exponent);
+		}
+
+		node.childBase = (int32_t)nodes.size();
+		node.objectBase = (int32_t)objects.size();
+		int childNodes = 0;
+
+		for (int slot = 0; slot < WIDE_BVH_WIDTH; slot++) {
+			if (slots[slot] < 0)
+				continue;
+
+			int childIndex = children[slots[slot]];
+			const Bvh::Node& child = bvh.nodes[childIndex];
+
+			for (int axis = 0; axis < 3; axis++) {
+				double lo = std::floor((child.bounds.min[axis] - node.origin[axis]) * scale[axis]);
+				double hi = std::ceil((child.bounds.max[axis] - node.origin[axis]) * scale[axis]);
+				node.lo[axis][slot] = (uint8_t)std::clamp(lo, 0.0, 255.0);
+				node.hi[axis][slot] = (uint8_t)std::clamp(hi, 0.0, 255.0);
+			}
+
+			node.slots |= 1 << slot;
+
+			if (child.count == 0) {
+				node.offset[slot] = (uint8_t)childNodes;
+				node.count[slot] = INTERIOR_CHILD;
+				queue.push_back({ childIndex, node.childBase + childNodes });
+				childNodes++;
+			}
+			else {
+				node.offset[slot] = (uint8_t)(objects.size() - node.objectBase);
+				node.count[slot] = (uint8_t)child.count;
+				objects.insert(objects.end(), bvh.objects.begin() + child.first, bvh.objects.begin() + child.first + child.count);
+			}
+		}
+
+		nodes[index] = node;
+		nodes.resize(nodes.size() + childNodes);
+	}
+}
+
+uint32_t WideBvh::intersectChildrenScalar(const Node& node, const NodeRay& ray, float tMax, float* tNear)
+{
+	// The distance to a side of a child is (lo * scale - origin) / dir, which is
+	// computed as lo * (scale / dir) - origin / dir with the ray origin relative
+	// to the grid. Since tNear starts at 0, rays going along a side cannot give
+	// NaN: the components of one over the direction are finite. The other versions
+	// do the same operations in the same order, so they find the same children.
+	float scale[3], offset[3];
+	for (int axis = 0; axis < 3; axis++) {
+		float origin = (float)(ray.origin[axis] - node.origin[axis]);
+		scale[axis] = powerOfTwo(node.exponent[axis]) * ray.invDir[axis];
+		offset[axis] = origin * ray.invDir[axis];
+	}
+
+	uint32_t hits = 0;
+	for (int slot = 0; slot < WIDE_BVH_WIDTH; slot++) {
+		float nearT = 0.0f;
+		float farT = tMax;
+
+		for (int axis = 0; axis < 3; axis++) {
+			float t0 = node.lo[axis][slot] * scale[axis] - offset[axis];
+			float t1 = node.hi[axis][slot] * scale[axis] - offset[axis];
+			nearT = std::max(nearT, std::min(t0, t1));
+			farT = std::min(farT, std::max(t0, t1));
+		}
+
+		nearT *= 1.0f - WIDE_BVH_PADDING;
+		farT *= 1.0f + WIDE_BVH_PADDING;
+		tNear[slot] = nearT;
+
+		if (nearT <= farT)
+			hits |= 1 << slot;
+	}
+
+	return hits & node.slots;
+}
+
+#ifdef CPU_X86
+ISA_TARGET("sse4.2")
+uint32_t WideBvh::intersectChildrenSse42(const Node& node, const NodeRay& ray, float tMax, float* tNear)
+{
+	// The eight children are tested as two groups of four
+	__m128 nearT[2] = { _mm_setzero_ps(), _mm_setzero_ps() };
+	__m128 farT[2] = { _mm_set1_ps(tMax), _mm_set1_ps(tMax) };
+
+	for (int axis = 0; axis < 3; axis++) {
+		float origin = (float)(ray.origin[axis] - node.origin[axis]);
+		__m128 scale = _mm_set1_ps(powerOfTwo(node.exponent[axis]) * ray.invDir[axis]);
+		__m128 offset = _mm_set1_ps(origin * ray.invDir[axis]);
+
+		for (int half = 0; half < 2; half++) {
+			int32_t loBytes, hiBytes;
+			std::memcpy(&loBytes, &node.lo[axis][half * 4], 4);
+			std::memcpy(&hiBytes, &node.hi[axis][half * 4], 4);
+
+			__m128 lo = _mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(loBytes)));
+			__m128 hi = _mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(hiBytes)));
+
+			__m128 t0 = _mm_sub_ps(_mm_mul_ps(lo, scale), offset);
+			__m128 t1 = _mm_sub_ps(_mm_mul_ps(hi, scale), offset);
+
+			nearT[half] = _mm_max_ps(nearT[half], _mm_min_ps(t0, t1));
+			farT[half] = _mm_min_ps(farT[half], _mm_max_ps(t0, t1));
+		}
+	}
+
+	uint32_t hits = 0;
+	for (int half = 0; half < 2; half++) {
+		__m128 n = _mm_mul_ps(nearT[half], _mm_set1_ps(1.0f - WIDE_BVH_PADDING));
+		__m128 f = _mm_mul_ps(farT[half], _mm_set1_ps(1.0f + WIDE_BVH_PADDING));
+		_mm_storeu_ps(tNear + half * 4, n);
+
+		hits |= (uint32_t)_mm_movemask_ps(_mm_cmple_ps(n, f)) << (half * 4);
+	}
+
+	return hits & node.slots;
+}
+
+ISA_TARGET("avx2")
+uint32_t WideBvh::intersectChildrenAvx2(const Node& node, const NodeRay& ray, float tMax, float* tNear)
+{
+	__m256 nearT = _mm256_setzero_ps();
+	__m256 farT = _mm256_set1_ps(tMax);
+
+	for (int axis = 0; axis < 3; axis++) {
+		float origin = (float)(ray.origin[axis] - node.origin[axis]);
+		__m256 scale = _mm256_set1_ps(powerOfTwo(node.exponent[axis]) * ray.invDir[axis]);
+		__m256 offset = _mm256_set1_ps(origin * ray.invDir[axis]);
+
+		__m256 lo = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)node.lo[axis])));
+		__m256 hi = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)node.hi[axis])));
+
+		__m256 t0 = _mm256_sub_ps(_mm256_mul_ps(lo, scale), offset);
+		__m256 t1 = _mm256_sub_ps(_mm256_mul_ps(hi, scale), offset);
+
+		nearT = _mm256_max_ps(nearT, _mm256_min_ps(t0, t1));
+		farT = _mm256_min_ps(farT, _mm256_max_ps(t0, t1));
+	}
+
+	nearT = _mm256_mul_ps(nearT, _mm256_set1_ps(1.0f - WIDE_BVH_PADDING));
+	farT = _mm256_mul_ps(farT, _mm256_set1_ps(1.0f + WIDE_BVH_PADDING));
+	_mm256_storeu_ps(tNear, nearT);
+
+	return (uint32_t)_mm256_movemask_ps(_mm256_cmp_ps(nearT, farT, _CMP_LE_OQ)) & node.slots;
+}
+
+ISA_TARGET("avx512f,avx512vl")
+uint32_t WideBvh::intersectChildrenAvx512(const Node& node, const NodeRay& ray, float tMax, float* tNear)
+{
+	// The low and high sides of all eight children are converted and scaled
+	// together in one register, with the low sides in the bottom half
+	__m256 nearT = _mm256_setzero_ps();
+	__m256 farT = _mm256_set1_ps(tMax);
+
+	for (int axis = 0; axis < 3; axis++) {
+		float origin = (float)(ray.origin[axis] - node.origin[axis]);
+		__m512 scale = _mm512_set1_ps(powerOfTwo(node.exponent[axis]) * ray.invDir[axis]);
+		__m512 offset = _mm512_set1_ps(origin * ray.invDir[axis]);
+
+		__m128i bytes = _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i*)node.lo[axis]), _mm_loadl_epi64((const __m128i*)node.hi[axis]));
+		__m512 sides = _mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(bytes));
+		__m512 t = _mm512_sub_ps(_mm512_mul_ps(sides, scale), offset);
+
+		__m256 t0 = _mm512_castps512_ps256(t);
+		__m256 t1 = _mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(t), 1));
+
+		nearT = _mm256_max_ps(nearT, _mm256_min_ps(t0, t1));
+		farT = _mm256_min_ps(farT, _mm256_max_ps(t0, t1));
+	}
+
+	nearT = _mm256_mul_ps(nearT, _mm256_set1_ps(1.0f - WIDE_BVH_PADDING));
+	farT = _mm256_mul_ps(farT, _mm256_set1_ps(1.0f + WIDE_BVH_PADDING));
+	_mm256_storeu_ps(tNear, nearT);
+
+	return (uint32_t)_mm256_cmp_ps_mask(nearT, farT, _CMP_LE_OQ) & node.slots;
+}
+#else
+uint32_t WideBvh::intersectChildrenSse42(const Node& node, const NodeRay& ray, float tMax, float* tNear)
+{
+	return intersectChildrenScalar(node, ray, tMax, tNear);
+}
+
+uint32_t WideBvh::intersectChildrenAvx2(const Node& node, const NodeRay& ray, float tMax, float* tNear)
+{
+	return intersectChildrenScalar(node, ray, tMax, tNear);
+}
+
+uint32_t WideBvh::intersectChildrenAvx512(const Node& node, const NodeRay& ray, float tMax, float* tNear)
+{
+	return intersectChildrenScalar(node, ray, tMax, tNear);
+}
+#endif
+
+/**
+ * A child waiting to be visited while tracing a ray
+ */
+struct WideBvhEntry
+{
+	/// The distance at which the ray enters the child
+	float	tNear;
+
+	/// The index of the child node, or of the leaf's first object
+	int32_t	index;
+
+	/// The number of objects in the leaf, or 0 for a child node
+	int32_t	count;
+};
+
+/**
+ * Prepares the direction of a ray for testing against the nodes of a wide BVH
+ *
+ * @param dir		The direction of the ray
+ * @param invDir	Set to one over each component of the direction, kept finite
+ * @param octant	Set to a bit for each negative component of the direction
+ */
+static inline void prepareRay(const glm::dvec3& dir, float* invDir, int& octant)
+{
+	octant = 0;
+	for (int axis = 0; axis < 3; axis++) {
+		double d = dir[axis];
+		if (std::abs(d) < WIDE_BVH_MIN_DIRECTION)
+			d = std::signbit(d) ? -WIDE_BVH_MIN_DIRECTION : WIDE_BVH_MIN_DIRECTION;
+
+		invDir[axis] = (float)(1.0 / d);
+		if (std::signbit(d))
+			octant |= 1 << axis;
+	}
+}
+
+std::optional<Hit> WideBvh::intersect(glm::dvec3 origin, glm::dvec3 dir, double tMax, uint64_t& tests) const
+{
+	std::optional<Hit> closest;
+
+	if (nodes.empty())
+		return closest;
+
+	NodeRay ray;
+	ray.origin = origin;
+	prepareRay(dir, ray.invDir, ray.octant);
+
+	WideBvhEntry stack[WIDE_BVH_STACK_SIZE];
+	int size = 0;
+	stack[size++] = { 0.0f, 0, 0 };
+
+	while (size > 0) {
+		WideBvhEntry entry = stack[--size];
+
+		// Something closer may have been found since the child was pushed
+		if (entry.tNear > tMax)
+			continue;
+
+		if (entry.count > 0) {
+			tests += entry.count;
+
+			for (int i = entry.index; i < entry.index + entry.count; i++) {
+				auto opt = hitObject(*objects[i], origin, dir);
+
+				if (opt.has_value() && opt->t < tMax) {
+					tMax = opt->t;
+					closest = opt;
+				}
+			}
+
+			continue;
+		}
+
+		const Node& node = nodes[entry.index];
+		float tNear[WIDE_BVH_WIDTH];
+		uint32_t hits = intersectChildren(node, ray, toFloat(tMax), tNear);
+
+		// Push the children that are visited first last
+		for (int i = WIDE_BVH_WIDTH - 1; i >= 0; i--) {
+			int slot = i ^ ray.octant;
+			if (!(hits & (1 << slot)))
+				continue;
+
+			if (node.count[slot] == INTERIOR_CHILD)
+				stack[size++] = { tNear[slot], node.childBase + node.offset[slot], 0 };
+			else
+				stack[size++] = { tNear[slot], node.objectBase + node.offset[slot], node.count[slot] };
+		}
+	}
+
+	return closest;
+}
+
+Object* WideBvh::occluded(glm::dvec3 origin, glm::dvec3 dir, double maxT, const Object* skip, uint64_t& tests) const
+{
+	if (nodes.empty())
+		return nullptr;
+
+	NodeRay ray;
+	ray.origin = origin;
+	prepareRay(dir, ray.invDir, ray.octant);
+
+	WideBvhEntry stack[WIDE_BVH_STACK_SIZE];
+	int size = 0;
+	stack[size++] = { 0.0f, 0, 0 };
+
+	while (size > 0) {
+		WideBvhEntry entry = stack[--size];
+
+		if (entry.count > 0) {
+			for (int i = entry.index; i < entry.index + entry.count; i++) {
+				if (objects[i] == skip)
+					continue;
+
+				tests++;
+				auto opt = hitObject(*objects[i], origin, dir);
+
+				if (opt.has_value() && opt->t < maxT)
+					return objects[i];
+			}
+
+			continue;
+		}
+
+		const Node& node = nodes[entry.index];
+		float tNear[WIDE_BVH_WIDTH];
+		uint32_t hits = intersectChildren(node, ray, toFloat(maxT), tNear);
+
+		for (int slot = 0; slot < WIDE_BVH_WIDTH; slot++) {
+			if (!(hits & (1 << slot)))
+				continue;
+
+			if (node.count[slot] == INTERIOR_CHILD)
+				stack[size++] = { tNear[slot], node.childBase + node.offset[slot], 0 };
+			else
+				stack[size++] = { tNear[slot], node.objectBase + node.offset[slot], node.count[slot] };
+		}
+	}
+
+	return nullptr;
+}
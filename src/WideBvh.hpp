@@ -0,0 +1,161 @@
+#ifndef WIDEBVH_HPP
+#define WIDEBVH_HPP
+
+#include <vector>
+#include <optional>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+#include "Bvh.hpp"
+#include "Objects.hpp"
+#include "Structures.hpp"
+
+/**
+ * A bounding volume hierarchy with up to eight children per node, collapsed from
+ * a binary one.
+ *
+ * The bounds of a node's children are stored as 8 bit offsets on a grid over the
+ * node, so a node with eight children takes about as much memory as a single node
+ * of the binary tree, and a ray is tested against all eight children at once. The
+ * children are placed in the node by direction, so that visiting them in an order
+ * that only depends on the signs of the ray's direction visits the near ones first.
+ */
+class WideBvh
+{
+public:
+	/**
+	 * Creates an empty hierarchy that no ray intersects
+	 */
+	WideBvh() = default;
+
+	/**
+	 * Collapses a binary hierarchy. Its leaves must hold at most 31 objects.
+	 *
+	 * @param bvh	The binary hierarchy
+	 */
+	WideBvh(const Bvh& bvh);
+
+	/**
+	 * Finds the closest hit of a ray on the objects. Only the hit is found, so the
+	 * caller computes the intersection for the one it keeps.
+	 *
+	 * @param origin	The origin of the ray
+	 * @param dir		The direction of the ray
+	 * @param tMax		Hits at or beyond this distance along the ray are ignored
+	 * @param tests		Incremented for every object the ray is tested against
+	 * @return			The closest hit, or std::nullopt if there is none before tMax
+	 */
+	std::optional<Hit> intersect(glm::dvec3 origin, glm::dvec3 dir, double tMax, uint64_t& tests) const;
+
+	/**
+	 * Finds any object that blocks a ray
+	 *
+	 * @param origin	The origin of the ray
+	 * @param dir		The direction of the ray
+	 * @param maxT		Objects at or beyond this distance along the ray do not block it
+	 * @param skip		An object that has already been tested, or NULL
+	 * @param tests		Incremented for every object the ray is tested against
+	 * @return			The object blocking the ray, or NULL if there is none
+	 */
+	Object* occluded(glm::dvec3 origin, glm::dvec3 dir, double maxT, const Object* skip, uint64_t& tests) const;
+
+	/**
+	 * Checks whether the hierarchy has no objects
+	 */
+	bool empty() const { return nodes.empty(); }
+
+	/**
+	 * Gets the number of nodes in the hierarchy
+	 */
+	size_t nodeCount() const { return nodes.size(); }
+
+	/**
+	 * Gets the number of bytes taken by the nodes and the list of objects
+	 */
+	size_t memoryUsage() const { return nodes.size() * sizeof(Node) + objects.size() * sizeof(Object*); }
+
+protected:
+	/**
+	 * A node of the tree. Each child is either another node, or a leaf holding
+	 * a range of the objects.
+	 */
+	struct Node
+	{
+		/// The corner of the grid the children's bounds are stored on
+		float		origin[3];
+
+		/// The size of a grid cell along each axis is 2 to the power of this
+		int8_t		exponent[3];
+
+		/// A bit for each slot that holds a child
+		uint8_t		slots;
+
+		/// The index of the first child node. The other child nodes follow it.
+		int32_t		childBase;
+
+		/// The index of the first object of the first leaf. The objects of the
+		/// other leaves follow them.
+		int32_t		objectBase;
+
+		/// For each slot, the offset of the child node from childBase, or of the
+		/// leaf's first object from objectBase
+		uint8_t		offset[8];
+
+		/// For each slot, the number of objects in the leaf, INTERIOR_CHILD for a
+		/// child node, or 0 for an empty slot
+		uint8_t		count[8];
+
+		/// For each axis and slot, the low and high sides of the child's bounds in
+		/// grid cells, rounded outwards
+		uint8_t		lo[3][8], hi[3][8];
+	};
+
+	/// The count of a slot holding a child node
+	static const uint8_t INTERIOR_CHILD = 255;
+
+	/**
+	 * A ray prepared for testing against the nodes
+	 */
+	struct NodeRay
+	{
+		/// The origin of the ray
+		glm::dvec3	origin;
+
+		/// One over each component of the direction, kept finite
+		float		invDir[3];
+
+		/// The signs of the direction, as one bit per axis that is set for negative
+		/// components. Slots are visited in the order of their index xor this.
+		int			octant;
+	};
+
+	/**
+	 * Tests a ray against all the children of a node. There is a version of the
+	 * test for each instruction set, which all give the same results.
+	 *
+	 * @param node	The node
+	 * @param ray	The ray
+	 * @param tMax	The distance beyond which children are not needed
+	 * @param tNear	Set to the distance at which the ray enters each child
+	 * @return		A bit for each slot whose child the ray passes through before tMax
+	 */
+	typedef uint32_t (*ChildTest)(const Node& node, const NodeRay& ray, float tMax, float* tNear);
+
+	static uint32_t intersectChildrenScalar(const Node& node, const NodeRay& ray, float tMax, float* tNear);
+	static uint32_t intersectChildrenSse42(const Node& node, const NodeRay& ray, float tMax, float* tNear);
+	static uint32_t intersectChildrenAvx2(const Node& node, const NodeRay& ray, float tMax, float* tNear);
+	static uint32_t intersectChildrenAvx512(const Node& node, const NodeRay& ray, float tMax, float* tNear);
+
+	/// The version of the test of a node's children for the instruction set picked
+	/// when the hierarchy was built
+	ChildTest				intersectChildren = intersectChildrenScalar;
+
+	/// The nodes of the tree, with the root first
+	std::vector<Node>		nodes;
+
+	/// The objects, ordered so that the leaves of each node are next to each other
+	std::vector<Object*>	objects;
+};
+
+#endif//WIDEBVH_HPP